@@ -0,0 +1,104 @@
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+
+/**
+ * Runs a command a number of times with its output discarded, and prints
+ * the medians of the wall time, user and system CPU time (in seconds) and
+ * context switches of a run. CPU time and context switches are counted over
+ * the command and every process it waited for.
+ *
+ * Usage: measure RUNS COMMAND [ARGUMENT...]
+ */
+
+static double measure_seconds(struct timeval tv);
+static double measure_median(double * values,
+                             int values_sz);
+static int measure_compare(const void * a,
+                           const void * b);
+
+int main(int argc, char * argv[])
+{
+    if (argc < 3 || atoi(argv[1]) < 1) {
+        fprintf(stderr, "Usage: %s RUNS COMMAND [ARGUMENT...]\n", argv[0]);
+        return 2;
+    }
+    int runs = atoi(argv[1]);
+    double * wall = malloc(runs * sizeof(double));
+    double * user = malloc(runs * sizeof(double));
+    double * sys = malloc(runs * sizeof(double));
+    double * switches = malloc(runs * sizeof(double));
+    struct rusage before;
+    getrusage(RUSAGE_CHILDREN, &before);
+    for (int i = 0; i < runs; ++i) {
+        struct timespec start, end;
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        pid_t pid = fork();
+        if (pid < 0) {
+            perror("fork");
+            return 1;
+        }
+        if (0 == pid) {
+            int null = open("/dev/null", O_WRONLY);
+            dup2(null, STDOUT_FILENO);
+            dup2(null, STDERR_FILENO);
+            execvp(argv[2], argv + 2);
+            _exit(127);
+        }
+        int status;
+        if (waitpid(pid, &status, 0) < 0) {
+            perror("waitpid");
+            return 1;
+        }
+        clock_gettime(CLOCK_MONOTONIC, &end);
+        if (!WIFEXITED(status) || 0 != WEXITSTATUS(status)) {
+            fprintf(stderr, "%s: %s exited with status %d\n", argv[0], argv[2],
+                    WIFEXITED(status) ? WEXITSTATUS(status) : 128 + WTERMSIG(status));
+            return 1;
+        }
+        // Children's usage only ever grows, so each run is the difference.
+        struct rusage after;
+        getrusage(RUSAGE_CHILDREN, &after);
+        wall[i] = (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9;
+        user[i] = measure_seconds(after.ru_utime) - measure_seconds(before.ru_utime);
+        sys[i] = measure_seconds(after.ru_stime) - measure_seconds(before.ru_stime);
+        switches[i] = (after.ru_nvcsw + after.ru_nivcsw) -
+                      (before.ru_nvcsw + before.ru_nivcsw);
+        before = after;
+    }
+    printf("%.3f %.3f %.3f %.0f\n", measure_median(wall, runs),
+           measure_median(user, runs), measure_median(sys, runs),
+           measure_median(switches, runs));
+    free(wall);
+    free(user);
+    free(sys);
+    free(switches);
+    return 0;
+}
+
+static double measure_seconds(struct timeval tv)
+{
+    return tv.tv_sec + tv.tv_usec / 1e6;
+}
+
+static double measure_median(double * values,
+                             int values_sz)
+{
+    qsort(values, values_sz, sizeof(double), measure_compare);
+    if (0 == values_sz % 2) {
+        return (values[values_sz / 2 - 1] + values[values_sz / 2]) / 2;
+    }
+    return values[values_sz / 2];
+}
+
+static int measure_compare(const void * a,
+                           const void * b)
+{
+    double x = *(const double *) a;
+    double y = *(const double *) b;
+    return (x > y) - (x < y);
+}
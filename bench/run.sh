@@ -0,0 +1,68 @@
+#!/bin/sh
+# Runs each workload through nephesh, bash, dash and dgsh (those that are
+# installed and have a version of it) and prints, per shell, the median wall
+# time, user and system CPU time and context switches over BENCH_RUNS runs
+# (default 5), and the system calls of one run under strace, if installed.
+# The output of every shell is checked against that of the first to run
+# (bash, if installed).
+#
+# Usage: run.sh [NEPHESH]
+
+set -e
+
+here=$(cd "$(dirname "$0")" && pwd)
+nephesh=${1:-"$here/../src/nephesh"}
+nephesh=$(cd "$(dirname "$nephesh")" && pwd)/$(basename "$nephesh")
+runs=${BENCH_RUNS:-5}
+work=$(mktemp -d)
+trap 'rm -rf "$work"' EXIT
+
+# The timing helper is built with the scratch files, out of the tree.
+measure=$work/measure
+cc -O2 -Wall -o "$measure" "$here/measure.c"
+
+# The workloads run in the scratch directory, on inputs made here.
+cd "$work"
+seq 1 1000000 >numbers
+
+printf '%-9s %-8s %8s %8s %8s %9s %9s\n' \
+    workload shell wall user sys switches syscalls
+for workload in linear fanout redirect short stream shard; do
+    reference=
+    for shell in bash dash nephesh dgsh; do
+        case $shell in
+            nephesh) command=$nephesh; script=$here/workloads/$workload.nfsh ;;
+            dgsh) command=dgsh; script=$here/workloads/$workload.dgsh ;;
+            *) command=$shell; script=$here/workloads/$workload.sh ;;
+        esac
+        if [ ! -f "$script" ]; then
+            continue
+        fi
+        if ! command -v "$command" >/dev/null 2>&1; then
+            printf '%-9s %-8s %s\n' "$workload" "$shell" "not installed"
+            continue
+        fi
+        # Concurrent readers may finish in any order.
+        rm -f out out.*
+        "$command" "$script" 2>/dev/null | sort >"$shell.out" || true
+        cat out out.* 2>/dev/null | sort >>"$shell.out" || true
+        if [ -z "$reference" ]; then
+            reference=$shell
+        elif ! cmp -s "$reference.out" "$shell.out"; then
+            printf '%-9s %-8s %s\n' "$workload" "$shell" "output differs from $reference"
+            continue
+        fi
+        if ! result=$("$measure" "$runs" "$command" "$script"); then
+            printf '%-9s %-8s %s\n' "$workload" "$shell" "failed"
+            continue
+        fi
+        syscalls=-
+        if command -v strace >/dev/null 2>&1 &&
+                strace -f -c -o strace.out "$command" "$script" >/dev/null 2>&1; then
+            syscalls=$(awk '$NF == "total" { print $4 }' strace.out)
+        fi
+        set -- $result
+        printf '%-9s %-8s %8s %8s %8s %9s %9s\n' \
+            "$workload" "$shell" "$1" "$2" "$3" "$4" "$syscalls"
+    done
+done
@@ -0,0 +1,5 @@
+fifos=$(mktemp -d)
+mkfifo "$fifos/3" "$fifos/4" "$fifos/5"
+tee /dev/fd/3 /dev/fd/4 /dev/fd/5 <numbers 3>"$fifos/3" 4>"$fifos/4" 5>"$fifos/5" |
+    sh -c 'wc -l <&3 & wc -l <&4 & wc -l <&5 & wc -l; wait' 3<"$fifos/3" 4<"$fifos/4" 5<"$fifos/5"
+rm -r "$fifos"
@@ -0,0 +1 @@
+cat numbers | grep 7 | sort | uniq -c | wc -l
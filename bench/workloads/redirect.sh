@@ -0,0 +1,2 @@
+cat numbers >out
+cat numbers | grep 5 >out.5
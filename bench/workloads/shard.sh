@@ -0,0 +1 @@
+cat numbers | sed -n s/7/x/p | wc -l
@@ -0,0 +1,500 @@
+/bin/true
+/bin/true
+/bin/true
+/bin/true
+/bin/true
+/bin/true
+/bin/true
+/bin/true
+/bin/true
+/bin/true
+/bin/true
+/bin/true
+/bin/true
+/bin/true
+/bin/true
+/bin/true
+/bin/true
+/bin/true
+/bin/true
+/bin/true
+/bin/true
+/bin/true
+/bin/true
+/bin/true
+/bin/true
+/bin/true
+/bin/true
+/bin/true
+/bin/true
+/bin/true
+/bin/true
+/bin/true
+/bin/true
+/bin/true
+/bin/true
+/bin/true
+/bin/true
+/bin/true
+/bin/true
+/bin/true
+/bin/true
+/bin/true
+/bin/true
+/bin/true
+/bin/true
+/bin/true
+/bin/true
+/bin/true
+/bin/true
+/bin/true
+/bin/true
+/bin/true
+/bin/true
+/bin/true
+/bin/true
+/bin/true
+/bin/true
+/bin/true
+/bin/true
+/bin/true
+/bin/true
+/bin/true
+/bin/true
+/bin/true
+/bin/true
+/bin/true
+/bin/true
+/bin/true
+/bin/true
+/bin/true
+/bin/true
+/bin/true
+/bin/true
+/bin/true
+/bin/true
+/bin/true
+/bin/true
+/bin/true
+/bin/true
+/bin/true
+/bin/true
+/bin/true
+/bin/true
+/bin/true
+/bin/true
+/bin/true
+/bin/true
+/bin/true
+/bin/true
+/bin/true
+/bin/true
+/bin/true
+/bin/true
+/bin/true
+/bin/true
+/bin/true
+/bin/true
+/bin/true
+/bin/true
+/bin/true
+/bin/true
+/bin/true
+/bin/true
+/bin/true
+/bin/true
+/bin/true
+/bin/true
+/bin/true
+/bin/true
+/bin/true
+/bin/true
+/bin/true
+/bin/true
+/bin/true
+/bin/true
+/bin/true
+/bin/true
+/bin/true
+/bin/true
+/bin/true
+/bin/true
+/bin/true
+/bin/true
+/bin/true
+/bin/true
+/bin/true
+/bin/true
+/bin/true
+/bin/true
+/bin/true
+/bin/true
+/bin/true
+/bin/true
+/bin/true
+/bin/true
+/bin/true
+/bin/true
+/bin/true
+/bin/true
+/bin/true
+/bin/true
+/bin/true
+/bin/true
+/bin/true
+/bin/true
+/bin/true
+/bin/true
+/bin/true
+/bin/true
+/bin/true
+/bin/true
+/bin/true
+/bin/true
+/bin/true
+/bin/true
+/bin/true
+/bin/true
+/bin/true
+/bin/true
+/bin/true
+/bin/true
+/bin/true
+/bin/true
+/bin/true
+/bin/true
+/bin/true
+/bin/true
+/bin/true
+/bin/true
+/bin/true
+/bin/true
+/bin/true
+/bin/true
+/bin/true
+/bin/true
+/bin/true
+/bin/true
+/bin/true
+/bin/true
+/bin/true
+/bin/true
+/bin/true
+/bin/true
+/bin/true
+/bin/true
+/bin/true
+/bin/true
+/bin/true
+/bin/true
+/bin/true
+/bin/true
+/bin/true
+/bin/true
+/bin/true
+/bin/true
+/bin/true
+/bin/true
+/bin/true
+/bin/true
+/bin/true
+/bin/true
+/bin/true
+/bin/true
+/bin/true
+/bin/true
+/bin/true
+/bin/true
+/bin/true
+/bin/true
+/bin/true
+/bin/true
+/bin/true
+/bin/true
+/bin/true
+/bin/true
+/bin/true
+/bin/true
+/bin/true
+/bin/true
+/bin/true
+/bin/true
+/bin/true
+/bin/true
+/bin/true
+/bin/true
+/bin/true
+/bin/true
+/bin/true
+/bin/true
+/bin/true
+/bin/true
+/bin/true
+/bin/true
+/bin/true
+/bin/true
+/bin/true
+/bin/true
+/bin/true
+/bin/true
+/bin/true
+/bin/true
+/bin/true
+/bin/true
+/bin/true
+/bin/true
+/bin/true
+/bin/true
+/bin/true
+/bin/true
+/bin/true
+/bin/true
+/bin/true
+/bin/true
+/bin/true
+/bin/true
+/bin/true
+/bin/true
+/bin/true
+/bin/true
+/bin/true
+/bin/true
+/bin/true
+/bin/true
+/bin/true
+/bin/true
+/bin/true
+/bin/true
+/bin/true
+/bin/true
+/bin/true
+/bin/true
+/bin/true
+/bin/true
+/bin/true
+/bin/true
+/bin/true
+/bin/true
+/bin/true
+/bin/true
+/bin/true
+/bin/true
+/bin/true
+/bin/true
+/bin/true
+/bin/true
+/bin/true
+/bin/true
+/bin/true
+/bin/true
+/bin/true
+/bin/true
+/bin/true
+/bin/true
+/bin/true
+/bin/true
+/bin/true
+/bin/true
+/bin/true
+/bin/true
+/bin/true
+/bin/true
+/bin/true
+/bin/true
+/bin/true
+/bin/true
+/bin/true
+/bin/true
+/bin/true
+/bin/true
+/bin/true
+/bin/true
+/bin/true
+/bin/true
+/bin/true
+/bin/true
+/bin/true
+/bin/true
+/bin/true
+/bin/true
+/bin/true
+/bin/true
+/bin/true
+/bin/true
+/bin/true
+/bin/true
+/bin/true
+/bin/true
+/bin/true
+/bin/true
+/bin/true
+/bin/true
+/bin/true
+/bin/true
+/bin/true
+/bin/true
+/bin/true
+/bin/true
+/bin/true
+/bin/true
+/bin/true
+/bin/true
+/bin/true
+/bin/true
+/bin/true
+/bin/true
+/bin/true
+/bin/true
+/bin/true
+/bin/true
+/bin/true
+/bin/true
+/bin/true
+/bin/true
+/bin/true
+/bin/true
+/bin/true
+/bin/true
+/bin/true
+/bin/true
+/bin/true
+/bin/true
+/bin/true
+/bin/true
+/bin/true
+/bin/true
+/bin/true
+/bin/true
+/bin/true
+/bin/true
+/bin/true
+/bin/true
+/bin/true
+/bin/true
+/bin/true
+/bin/true
+/bin/true
+/bin/true
+/bin/true
+/bin/true
+/bin/true
+/bin/true
+/bin/true
+/bin/true
+/bin/true
+/bin/true
+/bin/true
+/bin/true
+/bin/true
+/bin/true
+/bin/true
+/bin/true
+/bin/true
+/bin/true
+/bin/true
+/bin/true
+/bin/true
+/bin/true
+/bin/true
+/bin/true
+/bin/true
+/bin/true
+/bin/true
+/bin/true
+/bin/true
+/bin/true
+/bin/true
+/bin/true
+/bin/true
+/bin/true
+/bin/true
+/bin/true
+/bin/true
+/bin/true
+/bin/true
+/bin/true
+/bin/true
+/bin/true
+/bin/true
+/bin/true
+/bin/true
+/bin/true
+/bin/true
+/bin/true
+/bin/true
+/bin/true
+/bin/true
+/bin/true
+/bin/true
+/bin/true
+/bin/true
+/bin/true
+/bin/true
+/bin/true
+/bin/true
+/bin/true
+/bin/true
+/bin/true
+/bin/true
+/bin/true
+/bin/true
+/bin/true
+/bin/true
+/bin/true
+/bin/true
+/bin/true
+/bin/true
+/bin/true
+/bin/true
+/bin/true
+/bin/true
+/bin/true
+/bin/true
+/bin/true
+/bin/true
+/bin/true
+/bin/true
+/bin/true
+/bin/true
+/bin/true
+/bin/true
+/bin/true
+/bin/true
+/bin/true
+/bin/true
+/bin/true
+/bin/true
+/bin/true
+/bin/true
+/bin/true
+/bin/true
+/bin/true
+/bin/true
+/bin/true
+/bin/true
+/bin/true
+/bin/true
+/bin/true
+/bin/true
+/bin/true
+/bin/true
+/bin/true
+/bin/true
+/bin/true
+/bin/true
+/bin/true
+/bin/true
+/bin/true
+/bin/true
+/bin/true
+/bin/true
+/bin/true
+/bin/true
+/bin/true
+/bin/true
+/bin/true
+/bin/true
+/bin/true
+/bin/true
+/bin/true
+/bin/true
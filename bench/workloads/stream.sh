@@ -0,0 +1 @@
+head -c 268435456 /dev/zero | cat | cat | wc -c
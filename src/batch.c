@@ -0,0 +1,186 @@
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <wait.h>
+#include "batch.h"
+
+extern char **environ;
+
+static int batch_parse_count(const char * text,
+                             long * count);
+static size_t batch_size(char * const argv[],
+                         size_t argc);
+static void batch_collect(pid_t pid,
+                          int * highest);
+
+int batch_run(char * const argv[])
+{
+    const char * usage = "Usage: batch [-P N] [-k K] COMMAND [ARG]...\n";
+    long jobs = 1;
+    long kept = -1;
+    size_t i = 1;
+    for (; NULL != argv[i] && '-' == argv[i][0]; ++i) {
+        long * count = NULL;
+        if ('P' == argv[i][1]) {
+            count = &jobs;
+        } else if ('k' == argv[i][1]) {
+            count = &kept;
+        } else {
+            fputs(usage, stderr);
+            return 2;
+        }
+        const char * text = &argv[i][2];
+        if ('\0' == *text && NULL != argv[i + 1]) {
+            text = argv[++i];
+        }
+        if (!batch_parse_count(text, count)) {
+            fputs(usage, stderr);
+            return 2;
+        }
+    }
+    if (NULL == argv[i]) {
+        fputs(usage, stderr);
+        return 2;
+    }
+    if (0 == jobs) {
+        jobs = sysconf(_SC_NPROCESSORS_ONLN);
+        if (jobs < 1) {
+            jobs = 1;
+        }
+    }
+    char * const * command = &argv[i];
+    size_t argc = 0;
+    while (NULL != command[argc]) {
+        argc++;
+    }
+    // The command and the arguments every batch gets.
+    size_t fixed = 1;
+    if (kept >= 0) {
+        fixed = ((size_t) kept < argc - 1) ? (size_t) kept + 1 : argc;
+    }
+    long arg_max = sysconf(_SC_ARG_MAX);
+    if (arg_max <= 0) {
+        arg_max = 131072;
+    }
+    size_t environ_sz = 0;
+    while (NULL != environ[environ_sz]) {
+        environ_sz++;
+    }
+    size_t room = (size_t) arg_max;
+    size_t taken = batch_size(environ, environ_sz) + batch_size(command, fixed) +
+        BATCH_HEADROOM;
+    room = (taken < room) ? room - taken : 0;
+    // Everything fits, as it nearly always does: no batches at all.
+    if (batch_size(&command[fixed], argc - fixed) <= room) {
+        execvp(command[0], command);
+        fprintf(stderr, "%s: %s\n", command[0], strerror(errno));
+        return (ENOENT == errno) ? 127 : 126;
+    }
+    // Which arguments a command needs in every run, such as the pattern of
+    // grep, cannot be told from the outside, and guessing wrong would go
+    // unnoticed.
+    if (kept < 0) {
+        fprintf(stderr, "batch: the arguments of %s do not fit; use -k K to give "
+                "the number that every batch needs\n", command[0]);
+        return 2;
+    }
+    char ** batch = malloc((argc + 1) * sizeof(char *));
+    if (NULL == batch) {
+        fputs("batch: out of memory\n", stderr);
+        return 1;
+    }
+    memcpy(batch, command, fixed * sizeof(char *));
+    int highest = 0;
+    long running = 0;
+    unsigned int batches = 0;
+    size_t next = fixed;
+    // A command that cannot be found is not tried again.
+    while (next < argc && 127 != highest) {
+        // As many arguments as fit, and at least one.
+        size_t end = next;
+        size_t used = 0;
+        do {
+            used += batch_size(&command[end], 1);
+            end++;
+        } while (end < argc && used + batch_size(&command[end], 1) <= room);
+        memcpy(&batch[fixed], &command[next], (end - next) * sizeof(char *));
+        batch[fixed + end - next] = NULL;
+        next = end;
+        if (running == jobs) {
+            batch_collect(-1, &highest);
+            running--;
+        }
+        fflush(stderr);
+        pid_t pid = fork();
+        if (pid < 0) {
+            perror("batch");
+            highest = (highest > 1) ? highest : 1;
+            break;
+        }
+        if (0 == pid) {
+            execvp(batch[0], batch);
+            fprintf(stderr, "%s: %s\n", batch[0], strerror(errno));
+            _exit((ENOENT == errno) ? 127 : 126);
+        }
+        running++;
+        batches++;
+        if (1 == jobs) {
+            batch_collect(pid, &highest);
+            running--;
+        }
+    }
+    while (running-- > 0) {
+        batch_collect(-1, &highest);
+    }
+    free(batch);
+    fprintf(stderr, "batch: %s: %zu arguments in %u batches\n",
+            command[0], argc - fixed, batches);
+    return highest;
+}
+
+static int batch_parse_count(const char * text,
+                             long * count)
+{
+    char * end = NULL;
+    long value = strtol(text, &end, 10);
+    if ('\0' == *text || '\0' != *end || value < 0) {
+        return 0;
+    }
+    *count = value;
+    return 1;
+}
+
+/**
+ * Returns the space argc strings take up in the arguments or environment of
+ * a new program: the strings with their terminators, and a pointer each.
+ */
+static size_t batch_size(char * const argv[],
+                         size_t argc)
+{
+    size_t size = 0;
+    for (size_t i = 0; i < argc; ++i) {
+        size += strlen(argv[i]) + 1 + sizeof(char *);
+    }
+    return size;
+}
+
+/**
+ * Waits for the batch pid, or any if it is -1, keeping the highest exit
+ * status.
+ */
+static void batch_collect(pid_t pid,
+                          int * highest)
+{
+    int status;
+    while (waitpid(pid, &status, 0) < 0) {
+        if (EINTR != errno) {
+            return;
+        }
+    }
+    int code = WIFSIGNALED(status) ? 128 + WTERMSIG(status) : WEXITSTATUS(status);
+    if (code > *highest) {
+        *highest = code;
+    }
+}
@@ -0,0 +1,24 @@
+#ifndef BATCH_H_
+#define BATCH_H_
+
+/**
+ * Bytes of the argument space left unused, as xargs does, for what the
+ * kernel adds to it.
+ */
+#define BATCH_HEADROOM 2048
+
+/**
+ * Runs `batch [-P N] [-k K] COMMAND [ARG]...`: executes COMMAND with its
+ * arguments if they fit in the space the kernel allows for arguments and
+ * the environment, and otherwise runs it once per batch of arguments, each
+ * as large as fits, and reports how many batches it took. The first K
+ * arguments are passed to every batch; without -k, arguments that do not
+ * fit are refused, as there is no telling which ones every batch needs.
+ * Batches run one after the other, or N at a time with -P, 0 meaning one per
+ * processor. Meant to be run by a forked stage, in place of executing a
+ * command. Returns the exit status: the highest of any batch, or 2 if argv
+ * is not understood or the arguments do not fit without -k.
+ */
+int batch_run(char * const argv[]);
+
+#endif
@@ -1,32 +1,107 @@
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include "command.h"
+#include "stats.h"
 #include <utlist.h>
 
 command_t * command_new(void)
 {
+    stats_allocated();
     command_t * command = malloc(sizeof(command_t));
+    if (NULL == command) {
+        return NULL;
+    }
+    stats_allocated();
+    command->argv = malloc(COMMAND_INITIAL_ARGS * sizeof(char *));
+    if (NULL == command->argv) {
+        free(command);
+        return NULL;
+    }
     command->argv[0] = NULL;
     command->argc = 0;
+    command->argv_capacity = COMMAND_INITIAL_ARGS;
+    command->input = NULL;
     command->pipec = 0;
     return command;
 }
 
 void command_delete(command_t * command)
 {
+    free(command->argv);
     free(command);
 }
 
+int command_add_arg(command_t * command,
+                    char * arg)
+{
+    if (command->argc + 1 >= command->argv_capacity) {
+        unsigned int capacity = 2 * command->argv_capacity;
+        stats_allocated();
+        char ** argv = realloc(command->argv, capacity * sizeof(char *));
+        if (NULL == argv) {
+            return 0;
+        }
+        command->argv = argv;
+        command->argv_capacity = capacity;
+    }
+    command->argv[command->argc++] = arg;
+    command->argv[command->argc] = NULL;
+    return 1;
+}
+
 void command_debug_dump(command_t * commands)
 {
     command_t * command;
     DL_FOREACH(commands, command) {
-        printf("Command: #args = %u, #pipes = %u\n", command->argc, command->pipec);
+        fprintf(stderr, "Command: #args = %u, #pipes = %u\n", command->argc, command->pipec);
         for (unsigned int i = 0; i < command->argc; ++i) {
-            printf("    arg%u = %s\n", i, command->argv[i]);
+            fprintf(stderr, "    arg%u = %s\n", i, command->argv[i]);
+        }
+        if (NULL != command->input) {
+            fprintf(stderr, "    input = %s\n", command->input);
         }
         for (unsigned int i = 0; i < command->pipec; ++i) {
-            printf("    pipe%u = %d -> %d\n", i, command->pipes[i][0], command->pipes[i][1]);
+            fprintf(stderr, "    pipe%u = %d -> %d\n", i, command->pipes[i][0],
+                    command->pipes[i][1]);
+        }
+    }
+}
+
+void command_print(command_t * commands,
+                   FILE * stream)
+{
+    command_t * command;
+    DL_FOREACH(commands, command) {
+        for (unsigned int i = 0; i < command->argc; ++i) {
+            const char * arg = command->argv[i];
+            const char * quote = "";
+            if ('\0' == arg[0] || '\0' != arg[strcspn(arg, " \t<>|@'\"")]) {
+                quote = (NULL == strchr(arg, '\'')) ? "'" : "\"";
+            }
+            fprintf(stream, "%s%s%s%s", (0 == i) ? "" : " ", quote, arg, quote);
+        }
+        if (NULL != command->input) {
+            fprintf(stream, " (reads %s)", command->input);
+        }
+        if (1 == command->pipec && 1 == command->pipes[0][0] && 0 == command->pipes[0][1]) {
+            fputs(" <|> ", stream);
+        } else if (1 == command->pipec && 1 == command->pipes[0][0] &&
+                   -1 == command->pipes[0][1]) {
+            fputs(" <|@> ", stream);
+        } else if (command->pipec > 0) {
+            fputs(" <", stream);
+            for (unsigned int i = 0; i < command->pipec; ++i) {
+                int to = command->pipes[i][1];
+                fprintf(stream, "%s%d|", (0 == i) ? "" : " ", command->pipes[i][0]);
+                if (-1 == to) {
+                    fputc('@', stream);
+                } else {
+                    fprintf(stream, "%d", to);
+                }
+            }
+            fputs("> ", stream);
         }
     }
+    fputc('\n', stream);
 }
@@ -1,12 +1,26 @@
 #ifndef COMMAND_H_
 #define COMMAND_H_
 
-#define COMMAND_MAX_ARGS 32
+#include <stdio.h>
+
 #define COMMAND_MAX_PIPES 32
 
+/**
+ * Room for arguments a command starts out with; argv grows past it.
+ */
+#define COMMAND_INITIAL_ARGS 8
+
 typedef struct command_t {
-    char * argv[COMMAND_MAX_ARGS];
+    /**
+     * The arguments, followed by NULL, in room for argv_capacity pointers.
+     */
+    char ** argv;
     unsigned int argc;
+    unsigned int argv_capacity;
+    /**
+     * A file the command reads as its fd 0, or NULL.
+     */
+    char * input;
     int pipes[COMMAND_MAX_PIPES][2];
     unsigned int pipec;
     int pipes_legit[COMMAND_MAX_PIPES][2];
@@ -16,6 +30,20 @@ typedef struct command_t {
 
 command_t * command_new(void);
 void command_delete(command_t * command);
+
+/**
+ * Appends arg to the arguments of command, which does not copy it. Returns
+ * a boolean indicating success.
+ */
+int command_add_arg(command_t * command,
+                    char * arg);
 void command_debug_dump(command_t * commands);
 
+/**
+ * Writes the pipeline made of commands to stream as it would be typed, and a
+ * file a command reads as its input in parentheses after it.
+ */
+void command_print(command_t * commands,
+                   FILE * stream);
+
 #endif
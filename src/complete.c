@@ -0,0 +1,696 @@
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/eventfd.h>
+#include <sys/inotify.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <utlist.h>
+#include "complete.h"
+
+#define COMPLETE_NAME_DIR 1
+#define COMPLETE_NAME_EXEC 2
+
+#define COMPLETE_WATCH_MASK (IN_CREATE | IN_DELETE | IN_MOVED_FROM | \
+                             IN_MOVED_TO | IN_ATTRIB | IN_DELETE_SELF | \
+                             IN_MOVE_SELF | IN_ONLYDIR)
+
+typedef struct complete_name_t {
+    char * name;
+    int flags;
+} complete_name_t;
+
+/**
+ * The listing of one directory.
+ */
+typedef struct complete_dir_t {
+    /**
+     * The absolute path of the directory.
+     */
+    char * path;
+    /**
+     * The inotify watch on the directory, or -1. Without a watch there is no
+     * telling when the listing goes stale, so it is never trusted.
+     */
+    int wd;
+    int valid;
+    /**
+     * A boolean indicating whether the directory is on PATH, in which case
+     * it is never evicted and its executables are told apart.
+     */
+    int pinned;
+    complete_name_t * names;
+    size_t names_sz;
+    /**
+     * When the listing was last used, for evicting the least recently used.
+     */
+    unsigned long used;
+    struct complete_dir_t * prev;
+    struct complete_dir_t * next;
+} complete_dir_t;
+
+typedef struct complete_candidates_t {
+    char ** data;
+    size_t sz;
+    size_t capacity;
+} complete_candidates_t;
+
+struct complete_t {
+    pthread_t thread;
+    pthread_mutex_t lock;
+    pthread_cond_t wake;
+    /**
+     * An eventfd signalled whenever a result is posted.
+     */
+    int notify;
+    /**
+     * The pending request and the posted result, shared with the worker
+     * under lock.
+     */
+    int stop;
+    int requested;
+    int refresh;
+    unsigned int request_id;
+    complete_kind_t request_kind;
+    char * request_word;
+    complete_result_t * result;
+    /**
+     * Every command on PATH, published by the worker on refresh, or NULL
+     * before the first one.
+     */
+    complete_result_t * commands;
+    unsigned int generation;
+    /**
+     * State below is only ever touched by the worker.
+     */
+    int inotify;
+    complete_dir_t * dirs;
+    size_t unpinned_sz;
+    unsigned long clock;
+    /**
+     * The PATH the pinned directories were taken from, and those directories
+     * in order.
+     */
+    char * path_env;
+    complete_dir_t ** path_dirs;
+    size_t path_dirs_sz;
+    /**
+     * A boolean indicating whether PATH or a PATH listing has changed since
+     * commands was last published.
+     */
+    int commands_stale;
+};
+
+static void * complete_worker(void * arg);
+static complete_result_t * complete_lookup(complete_t * complete,
+                                           complete_kind_t kind,
+                                           const char * word);
+static void complete_commands(complete_t * complete,
+                              const char * word,
+                              complete_candidates_t * candidates);
+static void complete_publish(complete_t * complete);
+static void complete_paths(complete_t * complete,
+                           const char * word,
+                           complete_candidates_t * candidates);
+static void complete_drain(complete_t * complete);
+static void complete_sync_path(complete_t * complete);
+static complete_dir_t * complete_dir(complete_t * complete,
+                                     const char * path);
+static void complete_dir_load(complete_t * complete,
+                              complete_dir_t * dir);
+static void complete_dir_delete(complete_t * complete,
+                                complete_dir_t * dir);
+static size_t complete_lower_bound(complete_dir_t * dir,
+                                   const char * prefix);
+static void complete_candidates_add(complete_candidates_t * candidates,
+                                    const char * head,
+                                    size_t head_sz,
+                                    const char * name,
+                                    int flags);
+static int complete_name_compare(const void * a,
+                                 const void * b);
+static int complete_string_compare(const void * a,
+                                   const void * b);
+
+complete_t * complete_new(void)
+{
+    complete_t * complete = malloc(sizeof(complete_t));
+    memset(complete, 0, sizeof(complete_t));
+    complete->notify = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+    if (complete->notify < 0) {
+        free(complete);
+        return NULL;
+    }
+    // Without inotify nothing can be cached, but completion still works.
+    complete->inotify = inotify_init1(IN_CLOEXEC | IN_NONBLOCK);
+    pthread_mutex_init(&complete->lock, NULL);
+    pthread_cond_init(&complete->wake, NULL);
+    if (0 != pthread_create(&complete->thread, NULL, complete_worker, complete)) {
+        pthread_cond_destroy(&complete->wake);
+        pthread_mutex_destroy(&complete->lock);
+        if (complete->inotify >= 0) {
+            close(complete->inotify);
+        }
+        close(complete->notify);
+        free(complete);
+        return NULL;
+    }
+    return complete;
+}
+
+void complete_delete(complete_t * complete)
+{
+    pthread_mutex_lock(&complete->lock);
+    complete->stop = 1;
+    pthread_cond_signal(&complete->wake);
+    pthread_mutex_unlock(&complete->lock);
+    pthread_join(complete->thread, NULL);
+    pthread_cond_destroy(&complete->wake);
+    pthread_mutex_destroy(&complete->lock);
+    complete_dir_t * dir, * temp;
+    DL_FOREACH_SAFE(complete->dirs, dir, temp) {
+        complete_dir_delete(complete, dir);
+    }
+    if (NULL != complete->result) {
+        complete_result_delete(complete->result);
+    }
+    if (NULL != complete->commands) {
+        complete_result_delete(complete->commands);
+    }
+    free(complete->request_word);
+    free(complete->path_env);
+    free(complete->path_dirs);
+    if (complete->inotify >= 0) {
+        close(complete->inotify);
+    }
+    close(complete->notify);
+    free(complete);
+}
+
+int complete_fd(complete_t * complete)
+{
+    return complete->notify;
+}
+
+void complete_request(complete_t * complete,
+                      unsigned int id,
+                      complete_kind_t kind,
+                      const char * word,
+                      size_t word_sz)
+{
+    char * copy = malloc(word_sz + 1);
+    memcpy(copy, word, word_sz);
+    copy[word_sz] = '\0';
+    pthread_mutex_lock(&complete->lock);
+    free(complete->request_word);
+    complete->request_word = copy;
+    complete->request_id = id;
+    complete->request_kind = kind;
+    complete->requested = 1;
+    pthread_cond_signal(&complete->wake);
+    pthread_mutex_unlock(&complete->lock);
+}
+
+void complete_refresh(complete_t * complete)
+{
+    pthread_mutex_lock(&complete->lock);
+    complete->refresh = 1;
+    pthread_cond_signal(&complete->wake);
+    pthread_mutex_unlock(&complete->lock);
+}
+
+int complete_command_known(complete_t * complete,
+                           const char * name)
+{
+    int known = -1;
+    pthread_mutex_lock(&complete->lock);
+    if (NULL != complete->commands) {
+        known = (NULL != bsearch(&name, complete->commands->candidates,
+                                 complete->commands->candidates_sz,
+                                 sizeof(char *), complete_string_compare));
+    }
+    pthread_mutex_unlock(&complete->lock);
+    return known;
+}
+
+unsigned int complete_generation(complete_t * complete)
+{
+    pthread_mutex_lock(&complete->lock);
+    unsigned int generation = complete->generation;
+    pthread_mutex_unlock(&complete->lock);
+    return generation;
+}
+
+complete_result_t * complete_take(complete_t * complete)
+{
+    uint64_t count;
+    while (read(complete->notify, &count, sizeof(count)) < 0 && EINTR == errno);
+    pthread_mutex_lock(&complete->lock);
+    complete_result_t * result = complete->result;
+    complete->result = NULL;
+    pthread_mutex_unlock(&complete->lock);
+    return result;
+}
+
+void complete_result_delete(complete_result_t * result)
+{
+    for (size_t i = 0; i < result->candidates_sz; ++i) {
+        free(result->candidates[i]);
+    }
+    free(result->candidates);
+    free(result);
+}
+
+static void * complete_worker(void * arg)
+{
+    complete_t * complete = arg;
+    pthread_mutex_lock(&complete->lock);
+    while (1) {
+        while (!complete->stop && !complete->requested && !complete->refresh) {
+            pthread_cond_wait(&complete->wake, &complete->lock);
+        }
+        if (complete->stop) {
+            break;
+        }
+        if (complete->refresh) {
+            complete->refresh = 0;
+            pthread_mutex_unlock(&complete->lock);
+            complete_publish(complete);
+            pthread_mutex_lock(&complete->lock);
+            continue;
+        }
+        unsigned int id = complete->request_id;
+        complete_kind_t kind = complete->request_kind;
+        char * word = complete->request_word;
+        complete->request_word = NULL;
+        complete->requested = 0;
+        pthread_mutex_unlock(&complete->lock);
+
+        complete_result_t * result = complete_lookup(complete, kind, word);
+        result->id = id;
+        free(word);
+
+        pthread_mutex_lock(&complete->lock);
+        if (complete->requested) {
+            // Already superseded.
+            complete_result_delete(result);
+            continue;
+        }
+        if (NULL != complete->result) {
+            complete_result_delete(complete->result);
+        }
+        complete->result = result;
+        uint64_t one = 1;
+        write(complete->notify, &one, sizeof(one));
+    }
+    pthread_mutex_unlock(&complete->lock);
+    return NULL;
+}
+
+static complete_result_t * complete_lookup(complete_t * complete,
+                                           complete_kind_t kind,
+                                           const char * word)
+{
+    complete_drain(complete);
+    complete_candidates_t candidates = { NULL, 0, 0 };
+    if (COMPLETE_COMMAND == kind) {
+        complete_commands(complete, word, &candidates);
+    } else {
+        complete_paths(complete, word, &candidates);
+    }
+    // The same command may be found in several directories.
+    qsort(candidates.data, candidates.sz, sizeof(char *), complete_string_compare);
+    size_t unique_sz = 0;
+    for (size_t i = 0; i < candidates.sz; ++i) {
+        if (unique_sz > 0 &&
+                0 == strcmp(candidates.data[unique_sz - 1], candidates.data[i])) {
+            free(candidates.data[i]);
+        } else {
+            candidates.data[unique_sz++] = candidates.data[i];
+        }
+    }
+    complete_result_t * result = malloc(sizeof(complete_result_t));
+    result->candidates = candidates.data;
+    result->candidates_sz = unique_sz;
+    return result;
+}
+
+static void complete_commands(complete_t * complete,
+                              const char * word,
+                              complete_candidates_t * candidates)
+{
+    complete_sync_path(complete);
+    size_t word_sz = strlen(word);
+    for (size_t i = 0; i < complete->path_dirs_sz; ++i) {
+        complete_dir_t * dir = complete->path_dirs[i];
+        if (!dir->valid) {
+            complete_dir_load(complete, dir);
+        }
+        for (size_t j = complete_lower_bound(dir, word);
+             j < dir->names_sz && 0 == strncmp(dir->names[j].name, word, word_sz); ++j) {
+            if (COMPLETE_NAME_EXEC == dir->names[j].flags) {
+                complete_candidates_add(candidates, NULL, 0, dir->names[j].name, 0);
+            }
+        }
+    }
+}
+
+/**
+ * Rebuilds the set of known commands if anything it came from may have
+ * changed, and publishes it if it differs from the last one.
+ */
+static void complete_publish(complete_t * complete)
+{
+    complete_drain(complete);
+    complete_sync_path(complete);
+    for (size_t i = 0; i < complete->path_dirs_sz; ++i) {
+        if (!complete->path_dirs[i]->valid) {
+            complete->commands_stale = 1;
+        }
+    }
+    // Only the worker replaces commands, so it may read it without the lock.
+    complete_result_t * old = complete->commands;
+    if (!complete->commands_stale && NULL != old) {
+        return;
+    }
+    complete->commands_stale = 0;
+    complete_result_t * commands = complete_lookup(complete, COMPLETE_COMMAND, "");
+    if (NULL != old && old->candidates_sz == commands->candidates_sz) {
+        size_t i = 0;
+        while (i < old->candidates_sz &&
+               0 == strcmp(old->candidates[i], commands->candidates[i])) {
+            ++i;
+        }
+        if (i == old->candidates_sz) {
+            complete_result_delete(commands);
+            return;
+        }
+    }
+    pthread_mutex_lock(&complete->lock);
+    complete->commands = commands;
+    complete->generation++;
+    uint64_t one = 1;
+    write(complete->notify, &one, sizeof(one));
+    pthread_mutex_unlock(&complete->lock);
+    if (NULL != old) {
+        complete_result_delete(old);
+    }
+}
+
+static void complete_paths(complete_t * complete,
+                           const char * word,
+                           complete_candidates_t * candidates)
+{
+    // The directory part of the word is kept as typed in the candidates, and
+    // resolved to an absolute path for the lookup.
+    const char * slash = strrchr(word, '/');
+    size_t head_sz = (NULL != slash) ? (size_t) (slash - word) + 1 : 0;
+    const char * base = word + head_sz;
+    char path[4096];
+    const char * home = getenv("HOME");
+    if (0 == head_sz) {
+        if (NULL == getcwd(path, sizeof(path))) {
+            return;
+        }
+    } else if ('/' == word[0]) {
+        snprintf(path, sizeof(path), "%.*s", (int) head_sz, word);
+    } else if (0 == strncmp(word, "~/", 2) && NULL != home) {
+        snprintf(path, sizeof(path), "%s/%.*s", home, (int) head_sz - 2, word + 2);
+    } else {
+        char cwd[4096];
+        if (NULL == getcwd(cwd, sizeof(cwd))) {
+            return;
+        }
+        if (snprintf(path, sizeof(path), "%s/%.*s", cwd, (int) head_sz, word) >=
+                (int) sizeof(path)) {
+            return;
+        }
+    }
+    complete_dir_t * dir = complete_dir(complete, path);
+    if (!dir->valid) {
+        complete_dir_load(complete, dir);
+    }
+    size_t base_sz = strlen(base);
+    for (size_t j = complete_lower_bound(dir, base);
+         j < dir->names_sz && 0 == strncmp(dir->names[j].name, base, base_sz); ++j) {
+        // Hidden files only when asked for.
+        if ('.' == dir->names[j].name[0] && '.' != base[0]) {
+            continue;
+        }
+        complete_candidates_add(candidates, word, head_sz, dir->names[j].name,
+                                dir->names[j].flags);
+    }
+}
+
+/**
+ * Throws away the listings of directories that inotify reports changes to.
+ */
+static void complete_drain(complete_t * complete)
+{
+    if (complete->inotify < 0) {
+        return;
+    }
+    char events[4096] __attribute__((aligned(__alignof__(struct inotify_event))));
+    ssize_t events_sz;
+    while ((events_sz = read(complete->inotify, events, sizeof(events))) > 0) {
+        const struct inotify_event * event;
+        for (char * p = events; p < events + events_sz;
+             p += sizeof(struct inotify_event) + event->len) {
+            event = (const struct inotify_event *) p;
+            complete_dir_t * dir;
+            DL_FOREACH(complete->dirs, dir) {
+                if (event->mask & IN_Q_OVERFLOW) {
+                    dir->valid = 0;
+                } else if (dir->wd == event->wd) {
+                    dir->valid = 0;
+                    if (event->mask & IN_IGNORED) {
+                        dir->wd = -1;
+                    }
+                }
+            }
+        }
+    }
+}
+
+/**
+ * Brings the pinned directories in line with PATH.
+ */
+static void complete_sync_path(complete_t * complete)
+{
+    const char * path_env = getenv("PATH");
+    if (NULL == path_env) {
+        path_env = "";
+    }
+    if (NULL != complete->path_env && 0 == strcmp(complete->path_env, path_env)) {
+        return;
+    }
+    // A directory listed more than once in PATH is unpinned only once.
+    for (size_t i = 0; i < complete->path_dirs_sz; ++i) {
+        if (complete->path_dirs[i]->pinned) {
+            complete->path_dirs[i]->pinned = 0;
+            complete->unpinned_sz++;
+        }
+    }
+    free(complete->path_env);
+    complete->path_env = strdup(path_env);
+    complete->commands_stale = 1;
+    complete->path_dirs_sz = 0;
+    char * copy = strdup(path_env);
+    char * save;
+    for (char * entry = strtok_r(copy, ":", &save); NULL != entry;
+         entry = strtok_r(NULL, ":", &save)) {
+        char path[4096];
+        if ('/' == entry[0]) {
+            snprintf(path, sizeof(path), "%s", entry);
+        } else {
+            char cwd[4096];
+            if (NULL == getcwd(cwd, sizeof(cwd))) {
+                continue;
+            }
+            if (snprintf(path, sizeof(path), "%s/%s", cwd, entry) >= (int) sizeof(path)) {
+                continue;
+            }
+        }
+        complete_dir_t * dir = complete_dir(complete, path);
+        if (!dir->pinned) {
+            // Executables are only told apart in pinned listings.
+            dir->pinned = 1;
+            dir->valid = 0;
+            complete->unpinned_sz--;
+        }
+        complete->path_dirs = realloc(complete->path_dirs,
+                                      (complete->path_dirs_sz + 1) *
+                                      sizeof(complete_dir_t *));
+        complete->path_dirs[complete->path_dirs_sz++] = dir;
+    }
+    free(copy);
+}
+
+/**
+ * Returns the entry for the directory at path, adding an empty one (and
+ * evicting the least recently used unpinned one, if there are too many) if
+ * it is not there yet.
+ */
+static complete_dir_t * complete_dir(complete_t * complete,
+                                     const char * path)
+{
+    complete_dir_t * dir;
+    DL_FOREACH(complete->dirs, dir) {
+        if (0 == strcmp(dir->path, path)) {
+            dir->used = ++complete->clock;
+            return dir;
+        }
+    }
+    if (complete->unpinned_sz >= COMPLETE_DIRS_MAX) {
+        complete_dir_t * oldest = NULL;
+        DL_FOREACH(complete->dirs, dir) {
+            if (!dir->pinned && (NULL == oldest || dir->used < oldest->used)) {
+                oldest = dir;
+            }
+        }
+        if (NULL != oldest) {
+            complete_dir_delete(complete, oldest);
+        }
+    }
+    dir = malloc(sizeof(complete_dir_t));
+    memset(dir, 0, sizeof(complete_dir_t));
+    dir->path = strdup(path);
+    dir->wd = -1;
+    dir->used = ++complete->clock;
+    DL_APPEND(complete->dirs, dir);
+    complete->unpinned_sz++;
+    return dir;
+}
+
+/**
+ * Lists a directory into its entry.
+ */
+static void complete_dir_load(complete_t * complete,
+                              complete_dir_t * dir)
+{
+    for (size_t i = 0; i < dir->names_sz; ++i) {
+        free(dir->names[i].name);
+    }
+    free(dir->names);
+    dir->names = NULL;
+    dir->names_sz = 0;
+    // Watch before reading, so that no change can slip in between.
+    if (dir->pinned) {
+        complete->commands_stale = 1;
+    }
+    if (dir->wd < 0 && complete->inotify >= 0) {
+        dir->wd = inotify_add_watch(complete->inotify, dir->path, COMPLETE_WATCH_MASK);
+    }
+    dir->valid = (dir->wd >= 0);
+    DIR * stream = opendir(dir->path);
+    if (NULL == stream) {
+        return;
+    }
+    size_t names_capacity = 0;
+    struct dirent * entry;
+    while (NULL != (entry = readdir(stream))) {
+        if (0 == strcmp(entry->d_name, ".") || 0 == strcmp(entry->d_name, "..")) {
+            continue;
+        }
+        int flags = 0;
+        struct stat st;
+        if (DT_DIR == entry->d_type) {
+            flags = COMPLETE_NAME_DIR;
+        } else if ((DT_LNK == entry->d_type || DT_UNKNOWN == entry->d_type) &&
+                   0 == fstatat(dirfd(stream), entry->d_name, &st, 0) &&
+                   S_ISDIR(st.st_mode)) {
+            flags = COMPLETE_NAME_DIR;
+        }
+        if (dir->pinned && 0 == flags &&
+                0 == faccessat(dirfd(stream), entry->d_name, X_OK, 0)) {
+            flags = COMPLETE_NAME_EXEC;
+        }
+        if (dir->names_sz == names_capacity) {
+            names_capacity = (0 == names_capacity) ? 64 : 2 * names_capacity;
+            dir->names = realloc(dir->names, names_capacity * sizeof(complete_name_t));
+        }
+        dir->names[dir->names_sz].name = strdup(entry->d_name);
+        dir->names[dir->names_sz].flags = flags;
+        dir->names_sz++;
+    }
+    closedir(stream);
+    qsort(dir->names, dir->names_sz, sizeof(complete_name_t), complete_name_compare);
+}
+
+static void complete_dir_delete(complete_t * complete,
+                                complete_dir_t * dir)
+{
+    if (dir->wd >= 0) {
+        inotify_rm_watch(complete->inotify, dir->wd);
+    }
+    if (!dir->pinned) {
+        complete->unpinned_sz--;
+    }
+    DL_DELETE(complete->dirs, dir);
+    for (size_t i = 0; i < dir->names_sz; ++i) {
+        free(dir->names[i].name);
+    }
+    free(dir->names);
+    free(dir->path);
+    free(dir);
+}
+
+/**
+ * Returns the index of the first name of dir not less than prefix.
+ */
+static size_t complete_lower_bound(complete_dir_t * dir,
+                                   const char * prefix)
+{
+    size_t low = 0;
+    size_t high = dir->names_sz;
+    while (low < high) {
+        size_t middle = low + (high - low) / 2;
+        if (strcmp(dir->names[middle].name, prefix) < 0) {
+            low = middle + 1;
+        } else {
+            high = middle;
+        }
+    }
+    return low;
+}
+
+static void complete_candidates_add(complete_candidates_t * candidates,
+                                    const char * head,
+                                    size_t head_sz,
+                                    const char * name,
+                                    int flags)
+{
+    if (candidates->sz == candidates->capacity) {
+        candidates->capacity = (0 == candidates->capacity) ? 16 : 2 * candidates->capacity;
+        candidates->data = realloc(candidates->data, candidates->capacity * sizeof(char *));
+    }
+    size_t name_sz = strlen(name);
+    char * candidate = malloc(head_sz + name_sz + 2);
+    if (head_sz > 0) {
+        memcpy(candidate, head, head_sz);
+    }
+    memcpy(candidate + head_sz, name, name_sz);
+    if (COMPLETE_NAME_DIR == flags) {
+        candidate[head_sz + name_sz++] = '/';
+    }
+    candidate[head_sz + name_sz] = '\0';
+    candidates->data[candidates->sz++] = candidate;
+}
+
+static int complete_name_compare(const void * a,
+                                 const void * b)
+{
+    return strcmp(((const complete_name_t *) a)->name,
+                  ((const complete_name_t *) b)->name);
+}
+
+static int complete_string_compare(const void * a,
+                                   const void * b)
+{
+    return strcmp(*(const char * const *) a, *(const char * const *) b);
+}
@@ -0,0 +1,91 @@
+#ifndef COMPLETE_H_
+#define COMPLETE_H_
+
+#include <stddef.h>
+
+/**
+ * Directory listings kept in memory besides those of the PATH directories.
+ */
+#define COMPLETE_DIRS_MAX 64
+
+typedef enum complete_kind_t {
+    /**
+     * Executables found on PATH.
+     */
+    COMPLETE_COMMAND,
+    /**
+     * Files and directories, relative to the working directory unless the
+     * word says otherwise.
+     */
+    COMPLETE_PATH
+} complete_kind_t;
+
+typedef struct complete_result_t {
+    /**
+     * The identifier the request was made with.
+     */
+    unsigned int id;
+    /**
+     * The candidates in increasing order, without duplicates. Directories
+     * end with '/'.
+     */
+    char ** candidates;
+    size_t candidates_sz;
+} complete_result_t;
+
+/**
+ * A completion engine. Candidates are looked up by a worker thread, so that
+ * slow file systems never hold up the caller, in listings of the PATH
+ * directories and of recently completed directories that are kept in memory
+ * and thrown away when inotify reports a change to them.
+ */
+typedef struct complete_t complete_t;
+
+/**
+ * Starts the worker. Returns NULL on failure.
+ */
+complete_t * complete_new(void);
+void complete_delete(complete_t * complete);
+
+/**
+ * Returns a file descriptor that becomes readable when a result is ready.
+ */
+int complete_fd(complete_t * complete);
+
+/**
+ * Asks for the completions of word_sz bytes of word. A request that the
+ * worker has not started on yet is replaced.
+ */
+void complete_request(complete_t * complete,
+                      unsigned int id,
+                      complete_kind_t kind,
+                      const char * word,
+                      size_t word_sz);
+
+/**
+ * Asks the worker to pick up changes to PATH and to the PATH directories and
+ * to bring the set of known commands up to date, signalling the descriptor
+ * if it changes.
+ */
+void complete_refresh(complete_t * complete);
+
+/**
+ * Returns 1 if name is an executable on PATH, 0 if it is not, or -1 if the
+ * worker has not looked at PATH yet. Never waits for the file system.
+ */
+int complete_command_known(complete_t * complete,
+                           const char * name);
+
+/**
+ * Returns a number that changes whenever the set of known commands does.
+ */
+unsigned int complete_generation(complete_t * complete);
+
+/**
+ * Takes the result of the latest request if it is ready, or returns NULL.
+ * The result belongs to the caller.
+ */
+complete_result_t * complete_take(complete_t * complete);
+void complete_result_delete(complete_result_t * result);
+
+#endif
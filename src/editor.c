@@ -1,3 +1,5 @@
+#include <errno.h>
+#include <poll.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -7,14 +9,108 @@
 #include <curses.h>
 #include <term.h>
 #include "utf8.h"
+#include "gapbuf.h"
+#include "keymap.h"
+#include "history.h"
+#include "complete.h"
+#include "exec.h"
+#include "highlight.h"
+#include "prompt.h"
+#include "stats.h"
+#include "io.h"
 
 static void _ed_reset(ed_t * ed);
 static void _ed_draw(ed_t * ed);
-static void _ed_insert(ed_t * ed);
+static void _ed_mark_dirty(ed_t * ed,
+                           size_t byte,
+                           unsigned int col);
+static unsigned int _ed_width(ed_t * ed);
+static unsigned int _ed_cols(ed_t * ed,
+                             size_t from,
+                             size_t to);
+static void _ed_move(ed_t * ed,
+                     unsigned int pos);
+static void _ed_emit(ed_t * ed,
+                     const char * str);
+static void _ed_emit_b(ed_t * ed,
+                       const char * data,
+                       size_t data_sz);
+static void _ed_flush(ed_t * ed);
+static void _ed_insert(ed_t * ed,
+                       const char * str,
+                       size_t str_sz);
+static void _ed_delete(ed_t * ed);
+static int _ed_step(ed_t * ed,
+                    int direction);
+static const char * _ed_char_at(ed_t * ed,
+                                size_t pos);
+static size_t _ed_prev(ed_t * ed,
+                       size_t pos);
+static size_t _ed_fill(ed_t * ed);
+static size_t _ed_getc(ed_t * ed,
+                       char * u8_char);
+static int _ed_wait(ed_t * ed,
+                    int timeout);
+static void _ed_dispatch(ed_t * ed);
+static void _ed_abandon(ed_t * ed);
+static size_t _ed_parse_report(const char * data,
+                               size_t data_sz,
+                               unsigned int * col);
+static void _ed_correct(ed_t * ed,
+                        unsigned int col);
+static void _ed_insert_text(ed_t * ed,
+                            const char * str,
+                            size_t str_sz);
+static void _ed_type(ed_t * ed,
+                     const char * str,
+                     size_t str_sz);
+static void _ed_run(ed_t * ed,
+                    kb_callback action);
+static void _ed_set_line(ed_t * ed,
+                         const char * str,
+                         size_t str_sz);
+static void _ed_show_entry(ed_t * ed,
+                           size_t i);
+static void _ed_search(ed_t * ed,
+                       size_t before);
+static void _ed_search_prompt(ed_t * ed);
+static void _ed_end_search(ed_t * ed,
+                           int restore);
+static void _ed_idle(ed_t * ed);
+static void _ed_prompt(ed_t * ed);
+static int _ed_suggest(ed_t * ed);
+static void _ed_set_hint(ed_t * ed,
+                         const char * hint,
+                         size_t hint_sz);
+static void _ed_complete(ed_t * ed,
+                         complete_result_t * result);
+static void _ed_complete_list(ed_t * ed,
+                              complete_result_t * result);
+static int _ed_complete_fits(const char * candidate);
+static size_t _ed_complete_fds(const char * line,
+                               size_t line_sz,
+                               size_t skip_from,
+                               size_t skip_to,
+                               char names[][16],
+                               char * fds[]);
+static void _ed_damage(ed_t * ed,
+                       size_t pos,
+                       size_t removed);
+static void _ed_highlight(ed_t * ed);
+static int _ed_command_known(void * arg,
+                             const char * name);
+static void _ed_emit_line(ed_t * ed,
+                          size_t from);
+static void _ed_emit_range(ed_t * ed,
+                           size_t from,
+                           size_t to);
+static const char * _ed_style(highlight_style_t style);
 static kb_t * _kb_load_bindings(void);
-static unsigned int _kb_reduce(ed_t * ed,
-                               kb_t ** potential_bindings);
-static kb_t * _kb_copy(const kb_t * first);
+static void _kb_load_config(ed_t * ed);
+static int _kb_parse_sequence(const char * text,
+                              char * sequence,
+                              size_t sequence_sz);
+static kb_callback _kb_find_action(const char * name);
 
 /**
  * Key binding actions.
@@ -25,8 +121,37 @@ static void _kb_action_cursor_left(ed_t * ed);
 static void _kb_action_cursor_bol(ed_t * ed);
 static void _kb_action_cursor_eol(ed_t * ed);
 static void _kb_action_backspace(ed_t * ed);
+static void _kb_action_paste(ed_t * ed);
+static void _kb_action_history_previous(ed_t * ed);
+static void _kb_action_history_next(ed_t * ed);
+static void _kb_action_history_search(ed_t * ed);
+static void _kb_action_abort(ed_t * ed);
+static void _kb_action_complete(ed_t * ed);
+static void _kb_action_accept_suggestion(ed_t * ed);
 static void _kb_nop(ed_t * ed);
 
+/**
+ * Actions that can be bound by name in the configuration file.
+ */
+static const struct {
+    const char * name;
+    kb_callback action;
+} _kb_actions[] = {
+    { "accept-line", _kb_action_end_editing },
+    { "forward-char", _kb_action_cursor_right },
+    { "backward-char", _kb_action_cursor_left },
+    { "beginning-of-line", _kb_action_cursor_bol },
+    { "end-of-line", _kb_action_cursor_eol },
+    { "backward-delete-char", _kb_action_backspace },
+    { "previous-history", _kb_action_history_previous },
+    { "next-history", _kb_action_history_next },
+    { "reverse-search-history", _kb_action_history_search },
+    { "abort", _kb_action_abort },
+    { "complete", _kb_action_complete },
+    { "accept-suggestion", _kb_action_accept_suggestion },
+    { "nop", _kb_nop }
+};
+
 struct ed_t {
     /**
      * Vetting area for strings before they are considered a part of the line.
@@ -34,19 +159,28 @@ struct ed_t {
      * sequences.
      */
     char * buffer;
-    /**
-     * A boolean indicating whether or not the buffer is being populated.
-     */
-    int buffering;
     /**
      * The size of the buffer.
      */
     size_t buffer_sz;
     /**
-     * The editable line that is visible to the user. Should always be null
-     * terminated.
+     * Raw bytes read from the input but not yet consumed. Input is read in as
+     * large chunks as are available, so that pasted or typed-ahead text costs
+     * one system call rather than one per byte.
+     */
+    char * input_buffer;
+    size_t input_start;
+    size_t input_end;
+    /**
+     * A boolean indicating whether the input has reached end of file.
      */
-    char * line;
+    int input_eof;
+    /**
+     * The editable line that is visible to the user. It is kept in a gap
+     * buffer whose gap follows the most recent edit, and is only made
+     * contiguous when it is handed back to the caller.
+     */
+    gapbuf_t * line;
     /**
      * The logical cursor position within the line. Multi-byte characters are
      * treated as one cursor position. This must ultimately be translated into
@@ -55,14 +189,128 @@ struct ed_t {
      */
     unsigned int cursor_pos;
     /**
-     * The terminal coordinates where we should begin editing.
+     * The cursor position expressed as a byte offset into the line and as a
+     * number of display columns from the start of the line. These are moved
+     * along with cursor_pos, one character at a time, so that no cursor
+     * operation needs to rescan the line from its start.
+     */
+    size_t cursor_byte;
+    unsigned int cursor_col;
+    /**
+     * The length of the line in code points and display columns, kept up to
+     * date by edits.
+     */
+    unsigned int line_len;
+    unsigned int line_cols;
+    /**
+     * Output staged for the terminal by the current redraw.
+     */
+    char * render;
+    size_t render_sz;
+    size_t render_capacity;
+    /**
+     * A model of what the terminal currently shows: whether the prompt and
+     * line have been drawn at all, how many display columns of the line (and
+     * the suggestion after it) are on screen, and where the terminal cursor
+     * is, in display columns from the start of the prompt's row.
+     */
+    int screen_valid;
+    unsigned int screen_cols;
+    unsigned int screen_cursor;
+    /**
+     * A boolean indicating whether the line has changed since it was last
+     * drawn and, if so, the byte offset and display column of the earliest
+     * change.
+     */
+    int dirty;
+    size_t dirty_byte;
+    unsigned int dirty_col;
+    /**
+     * A boolean indicating whether the cursor position is asked for at all,
+     * which `cursor-report on` in the configuration turns on.
+     */
+    int report_enabled;
+    /**
+     * Booleans indicating whether a cursor position report has been asked
+     * for during this line and whether it is still to be received, possibly
+     * for an earlier line, and, if asked for during this one, the display
+     * column (from the start of the prompt's row) the cursor was expected to
+     * be at when the request was written.
+     */
+    int report_requested;
+    int report_pending;
+    unsigned int report_cursor;
+    /**
+     * The command history, or NULL if there is none, and the entry being
+     * shown; history_pos equals the number of entries while the user's own
+     * line is being edited, and that line is kept in history_saved while
+     * older entries are shown instead.
+     */
+    history_t * history;
+    size_t history_pos;
+    char * history_saved;
+    /**
+     * The state of an incremental history search: whether one is under way,
+     * its query, the entry it last matched (or HISTORY_NONE), whether the
+     * query matches nothing, the line as it was before the search, and the
+     * prompt shown in place of the usual one.
+     */
+    int searching;
+    char * search_query;
+    size_t search_query_sz;
+    size_t search_query_capacity;
+    size_t search_match;
+    int search_failed;
+    char * search_saved;
+    char * search_prompt;
+    unsigned int search_prompt_cols;
+    /**
+     * The rest of the most recent history entry that starts with the line,
+     * shown dimmed after it as a suggestion, and its width in display
+     * columns.
+     */
+    char * hint;
+    size_t hint_sz;
+    size_t hint_capacity;
+    unsigned int hint_cols;
+    /**
+     * The completion engine, or NULL if there is none. A request is pending
+     * from the time it is made until its result arrives; complete_id tells
+     * its result apart from those of earlier requests, and the result is
+     * only used if the line and cursor are still as they were when it was
+     * made: the word being completed started at complete_start, after an
+     * opening quote if complete_quoted, the cursor was at complete_cursor
+     * and edits had been made to the line.
+     */
+    complete_t * complete;
+    int complete_pending;
+    unsigned int complete_id;
+    int complete_quoted;
+    size_t complete_start;
+    size_t complete_cursor;
+    unsigned int complete_edits;
+    unsigned int edits;
+    /**
+     * The highlighting of the line, or NULL if the terminal has no colours.
+     * The edits made since it was last brought up to date all lie after the
+     * first hl_start bytes and before the last hl_tail bytes of the line, if
+     * hl_dirty says there were any; hl_generation tells which set of known
+     * commands it was made with.
      */
-    unsigned int offset_x;
-    unsigned int offset_y;
+    highlight_t * highlight;
+    int hl_dirty;
+    size_t hl_start;
+    size_t hl_tail;
+    unsigned int hl_generation;
     /**
-     * A linked list of valid key bindings.
+     * The key bindings, compiled into a trie.
      */
-    kb_t * key_bindings;
+    keymap_t * keymap;
+    /**
+     * How long to wait, in milliseconds, for the rest of a key sequence once
+     * its first bytes match a binding only partially or ambiguously.
+     */
+    int kb_timeout;
     /**
      * A boolean indicating whether or not the line is being edited.
      */
@@ -75,10 +323,20 @@ struct ed_t {
      * The file descriptor to display the user's line on.
      */
     int output;
+    /**
+     * The segments the prompt is made of, or NULL if they could not be set
+     * up, and the format they were made from, if one was configured.
+     */
+    prompt_t * segments;
+    char * prompt_format;
     /**
      * The user's prompt, to be displayed before their editable line.
      */
-    char * prompt;
+    const char * prompt;
+    /**
+     * The number of display columns occupied by the prompt.
+     */
+    unsigned int prompt_cols;
 };
 
 ed_t * ed_new(int input,
@@ -88,143 +346,1281 @@ ed_t * ed_new(int input,
     memset(ed, 0, sizeof(ed_t));
     ed->buffer = malloc(ED_BUFFER_MAX_SIZE);
     ed->buffer[0] = '\0';
-    ed->line = malloc(ED_LINE_MAX_SIZE);
-    ed->line[0] = '\0';
+    ed->input_buffer = malloc(ED_INPUT_BUFFER_SIZE);
+    ed->line = gapbuf_new(ED_LINE_INITIAL_SIZE);
     ed->input = input;
     ed->output = output;
-    ed->key_bindings = _kb_load_bindings();
-    ed->prompt = "nephesh/\xd7\xa9\xd7\xa4\xd7\xa0> ";
+    ed->keymap = keymap_new();
+    kb_t * bindings = _kb_load_bindings();
+    kb_t * binding, * temp;
+    LL_FOREACH_SAFE(bindings, binding, temp) {
+        keymap_add(ed->keymap, binding->sequence, binding->action);
+        LL_DELETE(bindings, binding);
+        free(binding);
+    }
+    ed->kb_timeout = ED_KB_TIMEOUT;
+    _kb_load_config(ed);
+    ed->history = history_open(NULL);
+    ed->complete = complete_new();
+    if (max_colors >= 8 && NULL != set_a_foreground) {
+        ed->highlight = highlight_new(_ed_command_known, ed);
+    }
+    ed->segments = prompt_new((NULL != ed->prompt_format) ? ed->prompt_format :
+                              PROMPT_DEFAULT);
+    ed->prompt = PROMPT_DEFAULT;
+    ed->prompt_cols = u8_strwidth_b(ed->prompt, strlen(ed->prompt));
     return ed;
 }
 
 void ed_delete(ed_t * ed)
 {
     free(ed->buffer);
-    free(ed->line);
+    free(ed->input_buffer);
+    gapbuf_delete(ed->line);
+    free(ed->render);
+    keymap_delete(ed->keymap);
+    if (NULL != ed->history) {
+        history_close(ed->history);
+    }
+    if (NULL != ed->complete) {
+        complete_delete(ed->complete);
+    }
+    if (NULL != ed->highlight) {
+        highlight_delete(ed->highlight);
+    }
+    if (NULL != ed->segments) {
+        prompt_delete(ed->segments);
+    }
+    free(ed->prompt_format);
+    free(ed->history_saved);
+    free(ed->hint);
+    free(ed->search_query);
+    free(ed->search_saved);
+    free(ed->search_prompt);
     free(ed);
 }
 
+void ed_set_status(ed_t * ed,
+                   int status,
+                   uint64_t duration_ns)
+{
+    if (NULL != ed->segments) {
+        prompt_set_status(ed->segments, status, duration_ns);
+    }
+}
+
 const char * ed_readline(ed_t * ed)
 {
     _ed_reset(ed);
     while (ed->editing) {
-        ed->buffering = 1;
-        ed->buffer_sz = 0;
-        kb_t * potential_bindings = _kb_copy(ed->key_bindings);
-        _ed_draw(ed);
-        while (ed->buffering) {
-            char u8_char[U8_MAX_BYTES];
-            size_t u8_char_sz = u8_getc(ed->input, u8_char);
-            if (0 == u8_char_sz) {
-                continue;
-            }
-            if (ed->buffer_sz + u8_char_sz >= ED_BUFFER_MAX_SIZE - 1) {
-                // Don't know what to do in this case. Just throw away the
-                // buffer and restart.
-                break;
-            }
-            // Copy character to buffer.
-            memcpy(ed->buffer + ed->buffer_sz, u8_char, u8_char_sz);
-            ed->buffer_sz += u8_char_sz;
-            // Try to match a key binding.
-            unsigned int potentials_sz = _kb_reduce(ed, &potential_bindings);
-            if (0 == potentials_sz) {
-                unsigned int target = (unsigned int) u8_char[0];
-                if (target <= 0x1FU || 0x7FU == target) {
-                    // Ignore these control characters (don't print).
-                } else {
-                    _ed_insert(ed);
-                }
-                ed->buffering = 0;
-            } else if (1 == potentials_sz &&
-                       strlen(potential_bindings->sequence) == ed->buffer_sz) {
-                potential_bindings->action(ed);
-                ed->buffering = 0;
+        // Only redraw once all pending input has been consumed, so that a
+        // burst of input is displayed in one go.
+        if (ed->input_start == ed->input_end) {
+            _ed_draw(ed);
+            // Only look for a suggestion once what was typed is on screen.
+            if (_ed_suggest(ed)) {
+                _ed_draw(ed);
             }
+            _ed_idle(ed);
         }
+        _ed_dispatch(ed);
+        if (ed->input_eof) {
+            ed->editing = 0;
+        }
+    }
+    // Leave the cursor after the end of the line, so that output of the
+    // command follows it, and take the suggestion off the screen.
+    _ed_set_hint(ed, NULL, 0);
+    _kb_action_cursor_eol(ed);
+    _ed_draw(ed);
+    _ed_emit(ed, keypad_local);
+    _ed_emit(ed, "\x1b[?2004l\n");
+    _ed_flush(ed);
+    if (ed->input_eof) {
+        return NULL;
     }
-    write(ed->output, "\n", 1);
-    return ed->line;
+    if (NULL != ed->history) {
+        history_add(ed->history, gapbuf_str(ed->line));
+    }
+    return gapbuf_str(ed->line);
 }
 
 static void _ed_reset(ed_t * ed)
 {
     ed->buffer_sz = 0;
-    ed->buffering = 1;
-    ed->line[0] = '\0';
+    _ed_damage(ed, 0, gapbuf_length(ed->line));
+    gapbuf_clear(ed->line);
     ed->cursor_pos = 0;
+    ed->cursor_byte = 0;
+    ed->cursor_col = 0;
+    ed->line_len = 0;
+    ed->line_cols = 0;
+    ed->screen_valid = 0;
+    ed->dirty = 0;
     ed->editing = 1;
-    const char * get_cursor = "\x1b[6n";
-    write(ed->output, get_cursor, strlen(get_cursor));
-    char cursor_position[32];
-    if (0 != read(ed->input, cursor_position, 32)) {
-        if (EOF == sscanf(cursor_position, "\x1b[%u;%u", &ed->offset_y, &ed->offset_x)) {
-            ed->offset_x = 0;
-            ed->offset_y = 0;
+    ed->searching = 0;
+    ed->hint_sz = 0;
+    ed->hint_cols = 0;
+    ed->complete_pending = 0;
+    if (NULL != ed->history) {
+        // Pick up lines entered in other sessions since the last prompt.
+        history_sync(ed->history);
+        ed->history_pos = history_count(ed->history);
+    }
+    if (NULL != ed->complete) {
+        // Pick up commands installed since the last prompt.
+        complete_refresh(ed->complete);
+    }
+    if (NULL != ed->segments) {
+        // Slow segments show what they last did until the workers catch up.
+        prompt_begin(ed->segments);
+        _ed_prompt(ed);
+    }
+    // Ask the terminal to bracket pasted text, so that it can be inserted in
+    // bulk rather than interpreted key by key.
+    const char * paste_on = "\x1b[?2004h";
+    write(ed->output, paste_on, strlen(paste_on));
+    // Have the keypad send the sequences that terminfo describes.
+    if (NULL != keypad_xmit) {
+        write(ed->output, keypad_xmit, strlen(keypad_xmit));
+    }
+    // A report still pending was asked for on an earlier line; if the command
+    // did not read it, it is swallowed like any unknown sequence once it
+    // arrives, and no other is asked for until then.
+    ed->report_requested = 0;
+    // Start the prompt in the first column without asking the terminal where
+    // the cursor is. A full row of spaces leaves the cursor at the end of the
+    // current row if it was at its start, and wraps onto a fresh row if some
+    // earlier output did not end with a newline; either way, the carriage
+    // return lands in the first column of a row that is safe to draw on.
+    if (auto_right_margin && eat_newline_glitch) {
+        unsigned int width = _ed_width(ed);
+        for (unsigned int i = 0; i < width; ++i) {
+            _ed_emit(ed, " ");
+        }
+    }
+    _ed_emit(ed, "\r");
+    ed->screen_cursor = 0;
+}
+
+/**
+ * Inserts str_sz bytes of valid UTF-8 at the cursor.
+ */
+static void _ed_insert(ed_t * ed,
+                       const char * str,
+                       size_t str_sz)
+{
+    _ed_mark_dirty(ed, ed->cursor_byte, ed->cursor_col);
+    ed->edits++;
+    unsigned int inserted_len = u8_strlen_b(str, str_sz);
+    unsigned int inserted_cols = u8_strwidth_b(str, str_sz);
+    if (ed->hint_sz > 0 && ed->cursor_byte == gapbuf_length(ed->line) &&
+            str_sz <= ed->hint_sz &&
+            0 == memcmp(str, ed->hint, str_sz)) {
+        // Typing what is suggested keeps the rest of the suggestion, which
+        // is then still the most recent entry to start with the line.
+        memmove(ed->hint, ed->hint + str_sz, ed->hint_sz - str_sz);
+        ed->hint_sz -= str_sz;
+        ed->hint_cols -= inserted_cols;
+    } else {
+        ed->hint_sz = 0;
+        ed->hint_cols = 0;
+    }
+    _ed_damage(ed, ed->cursor_byte, 0);
+    gapbuf_insert(ed->line, ed->cursor_byte, str, str_sz);
+    ed->cursor_pos += inserted_len;
+    ed->cursor_byte += str_sz;
+    ed->cursor_col += inserted_cols;
+    ed->line_len += inserted_len;
+    ed->line_cols += inserted_cols;
+}
+
+/**
+ * Reads one key from the input and acts on it: either runs the action bound
+ * to the key's sequence or inserts the key as text. Bytes are matched
+ * against the key map one at a time. When what has been read so far is a
+ * prefix of a longer binding, the rest is awaited for at most kb_timeout
+ * milliseconds, after which whatever did match is settled for.
+ */
+static void _ed_dispatch(ed_t * ed)
+{
+    unsigned int state = KEYMAP_ROOT;
+    ed->buffer_sz = 0;
+    while (1) {
+        if (KEYMAP_ROOT != state && !_ed_wait(ed, ed->kb_timeout)) {
+            kb_callback action = keymap_action(ed->keymap, state);
+            if (NULL != action) {
+                _ed_run(ed, action);
+            } else {
+                _ed_abandon(ed);
+            }
+            return;
+        }
+        if (0 == _ed_fill(ed)) {
+            return;
+        }
+        unsigned char byte = ed->input_buffer[ed->input_start];
+        unsigned int next = keymap_next(ed->keymap, state, byte);
+        if (KEYMAP_ROOT == next) {
+            if (KEYMAP_ROOT == state) {
+                // Not the start of any binding: plain text.
+                char u8_char[U8_MAX_BYTES];
+                size_t u8_char_sz = _ed_getc(ed, u8_char);
+                uint64_t start = stats_now();
+                _ed_type(ed, u8_char, u8_char_sz);
+                stats_record(STATS_DISPATCH_NS, stats_now() - start);
+            } else if (NULL != keymap_action(ed->keymap, state)) {
+                // A complete binding followed by something else, which is
+                // left for the next key.
+                _ed_run(ed, keymap_action(ed->keymap, state));
+            } else {
+                _ed_abandon(ed);
+            }
+            return;
+        }
+        ed->input_start++;
+        if (ed->buffer_sz < ED_BUFFER_MAX_SIZE) {
+            ed->buffer[ed->buffer_sz++] = byte;
+        }
+        state = next;
+        if (keymap_is_final(ed->keymap, state)) {
+            _ed_run(ed, keymap_action(ed->keymap, state));
+            return;
+        }
+    }
+}
+
+/**
+ * Deals with buffered bytes that turned out not to form a bound sequence.
+ * The rest of an unknown terminal escape sequence is swallowed, so that it
+ * does not end up in the line as text; anything else is inserted as text.
+ */
+static void _ed_abandon(ed_t * ed)
+{
+    if (ed->buffer_sz >= 2 && '\x1b' == ed->buffer[0] &&
+            ('[' == ed->buffer[1] || 'O' == ed->buffer[1])) {
+        unsigned char last = ed->buffer[ed->buffer_sz - 1];
+        int done = (ed->buffer_sz > 2 && last >= 0x40 && last <= 0x7E);
+        while (!done && _ed_wait(ed, ed->kb_timeout) && _ed_fill(ed) > 0) {
+            unsigned char byte = ed->input_buffer[ed->input_start++];
+            if (ed->buffer_sz < ED_BUFFER_MAX_SIZE) {
+                ed->buffer[ed->buffer_sz++] = byte;
+            }
+            // SS3 sequences are one byte long; CSI sequences end with a byte
+            // in the range 0x40 to 0x7E.
+            done = ('O' == ed->buffer[1]) || (byte >= 0x40 && byte <= 0x7E);
+        }
+        unsigned int col;
+        if (ed->report_pending &&
+                ed->buffer_sz == _ed_parse_report(ed->buffer, ed->buffer_sz, &col)) {
+            ed->report_pending = 0;
+            if (ed->report_requested) {
+                _ed_correct(ed, col);
+            }
+        }
+        return;
+    }
+    _ed_type(ed, ed->buffer, ed->buffer_sz);
+}
+
+/**
+ * Recognises a cursor position report, ESC [ row ; col R, at the start of
+ * data_sz bytes of data. Returns its length and stores its 0-based column in
+ * col, or returns 0 if data does not start with a complete report.
+ */
+static size_t _ed_parse_report(const char * data,
+                               size_t data_sz,
+                               unsigned int * col)
+{
+    if (data_sz < 2 || '\x1b' != data[0] || '[' != data[1]) {
+        return 0;
+    }
+    unsigned int fields[2] = { 0, 0 };
+    unsigned int field = 0;
+    for (size_t i = 2; i < data_sz; ++i) {
+        if (data[i] >= '0' && data[i] <= '9') {
+            fields[field] = 10 * fields[field] + (data[i] - '0');
+        } else if (';' == data[i] && 0 == field) {
+            field = 1;
+        } else if ('R' == data[i] && 1 == field && fields[1] > 0) {
+            *col = fields[1] - 1;
+            return i + 1;
         } else {
-            // The offsets are 1-based, so we need to make them 0-based.
-            ed->offset_x--;
-            ed->offset_y--;
+            break;
+        }
+    }
+    return 0;
+}
+
+/**
+ * Compares the column a cursor position report found the cursor in with the
+ * column it was expected to be in when the report was asked for. They only
+ * differ when the terminal disagrees with us about the width of something
+ * drawn, or the prompt did not start in the first column; the screen is then
+ * redrawn from where the cursor really was.
+ */
+static void _ed_correct(ed_t * ed,
+                        unsigned int col)
+{
+    unsigned int width = _ed_width(ed);
+    unsigned int expected = ed->report_cursor % width;
+    if (col == expected || col >= width) {
+        return;
+    }
+    if (ed->screen_cursor == ed->report_cursor) {
+        ed->screen_cursor = ed->screen_cursor - expected + col;
+    }
+    ed->screen_valid = 0;
+}
+
+/**
+ * Returns non-zero if input is available within timeout milliseconds.
+ */
+static int _ed_wait(ed_t * ed,
+                    int timeout)
+{
+    if (ed->input_start < ed->input_end) {
+        return 1;
+    }
+    struct pollfd input = { ed->input, POLLIN, 0 };
+    int ready;
+    do {
+        ready = poll(&input, 1, timeout);
+    } while (ready < 0 && EINTR == errno);
+    return ready > 0;
+}
+
+/**
+ * Inserts the printable part of str_sz bytes of text at the cursor, leaving
+ * out control characters and invalid UTF-8.
+ */
+static void _ed_insert_text(ed_t * ed,
+                            const char * str,
+                            size_t str_sz)
+{
+    size_t run = 0;
+    size_t i = 0;
+    while (i < str_sz) {
+        size_t sequence_sz = u8_sequence_sz(str[i]);
+        int valid = (0 != sequence_sz && i + sequence_sz <= str_sz &&
+                     sequence_sz == u8_validate(str + i, sequence_sz));
+        unsigned int codepoint = valid ? u8_decode(str + i) : 0;
+        if (valid && codepoint > 0x1Fu &&
+                (codepoint < 0x7Fu || codepoint >= 0xA0u)) {
+            i += sequence_sz;
+            continue;
+        }
+        // Insert the run of printable text before this character.
+        if (i > run) {
+            _ed_insert(ed, str + run, i - run);
         }
+        i += valid ? sequence_sz : 1;
+        run = i;
+    }
+    if (i > run) {
+        _ed_insert(ed, str + run, i - run);
     }
 }
 
-static void _ed_insert(ed_t * ed)
+/**
+ * Handles text typed or pasted by the user: it goes into the line, or into
+ * the query while a history search is under way.
+ */
+static void _ed_type(ed_t * ed,
+                     const char * str,
+                     size_t str_sz)
 {
-    unsigned int len = strlen(ed->line);
-    if (len + ed->buffer_sz > ED_LINE_MAX_SIZE - 1) {
+    if (!ed->searching) {
+        _ed_insert_text(ed, str, str_sz);
         return;
     }
-    unsigned int index = u8_byte_offset(ed->line, ed->cursor_pos);
-    ed->line[len + ed->buffer_sz] = '\0';
-    for (unsigned int i = len + ed->buffer_sz; i > index; --i) {
-        ed->line[i - 1] = ed->line[i - 1 - ed->buffer_sz];
+    if (ed->search_query_sz + str_sz > ed->search_query_capacity) {
+        ed->search_query_capacity = 2 * (ed->search_query_sz + str_sz);
+        ed->search_query = realloc(ed->search_query, ed->search_query_capacity);
+    }
+    for (size_t i = 0; i < str_sz; ++i) {
+        if ((unsigned char) str[i] >= 0x20 && 0x7F != str[i]) {
+            ed->search_query[ed->search_query_sz++] = str[i];
+        }
+    }
+    // A longer query may still match the current entry.
+    _ed_search(ed, (HISTORY_NONE == ed->search_match)
+                   ? history_count(ed->history) : ed->search_match + 1);
+}
+
+/**
+ * Runs the action bound to a key. Actions other than those that refine a
+ * history search end it first, keeping the entry it found.
+ */
+static void _ed_run(ed_t * ed,
+                    kb_callback action)
+{
+    uint64_t start = stats_now();
+    if (ed->searching && _kb_action_history_search != action &&
+            _kb_action_backspace != action && _kb_action_abort != action &&
+            _kb_action_paste != action) {
+        _ed_end_search(ed, 0);
+    }
+    action(ed);
+    stats_record(STATS_DISPATCH_NS, stats_now() - start);
+}
+
+/**
+ * Replaces the whole line, leaving the cursor at its end.
+ */
+static void _ed_set_line(ed_t * ed,
+                         const char * str,
+                         size_t str_sz)
+{
+    _ed_damage(ed, 0, gapbuf_length(ed->line));
+    gapbuf_clear(ed->line);
+    ed->cursor_pos = 0;
+    ed->cursor_byte = 0;
+    ed->cursor_col = 0;
+    ed->line_len = 0;
+    ed->line_cols = 0;
+    ed->edits++;
+    ed->hint_sz = 0;
+    ed->hint_cols = 0;
+    _ed_mark_dirty(ed, 0, 0);
+    _ed_insert_text(ed, str, str_sz);
+}
+
+static void _ed_show_entry(ed_t * ed,
+                           size_t i)
+{
+    size_t entry_sz;
+    const char * entry = history_entry(ed->history, i, &entry_sz);
+    _ed_set_line(ed, entry, entry_sz);
+}
+
+/**
+ * Looks for the query in the entries before the before-th one, showing the
+ * most recent match.
+ */
+static void _ed_search(ed_t * ed,
+                       size_t before)
+{
+    size_t match = history_search(ed->history, ed->search_query,
+                                  ed->search_query_sz, before);
+    ed->search_failed = (HISTORY_NONE == match);
+    if (!ed->search_failed) {
+        ed->search_match = match;
+        _ed_show_entry(ed, match);
+    }
+    _ed_search_prompt(ed);
+}
+
+static void _ed_search_prompt(ed_t * ed)
+{
+    size_t prompt_sz = ed->search_query_sz + 32;
+    ed->search_prompt = realloc(ed->search_prompt, prompt_sz);
+    snprintf(ed->search_prompt, prompt_sz, "(%sreverse-i-search)`%.*s': ",
+             ed->search_failed ? "failed " : "",
+             (int) ed->search_query_sz, ed->search_query);
+    ed->search_prompt_cols = u8_strwidth_b(ed->search_prompt,
+                                           strlen(ed->search_prompt));
+    ed->screen_valid = 0;
+}
+
+/**
+ * Leaves the history search, either going back to the line as it was
+ * before it or keeping the entry found, from which the history can then be
+ * browsed further.
+ */
+static void _ed_end_search(ed_t * ed,
+                           int restore)
+{
+    if (restore) {
+        _ed_set_line(ed, ed->search_saved, strlen(ed->search_saved));
+    } else if (HISTORY_NONE != ed->search_match) {
+        if (ed->history_pos == history_count(ed->history)) {
+            free(ed->history_saved);
+            ed->history_saved = ed->search_saved;
+            ed->search_saved = NULL;
+        }
+        ed->history_pos = ed->search_match;
+    }
+    free(ed->search_saved);
+    ed->search_saved = NULL;
+    ed->searching = 0;
+    ed->screen_valid = 0;
+}
+
+/**
+ * Looks up the suggestion for the line. Returns non-zero if it changed.
+ */
+static int _ed_suggest(ed_t * ed)
+{
+    const char * hint = NULL;
+    size_t hint_sz = 0;
+    size_t line_sz = gapbuf_length(ed->line);
+    const char * line;
+    // Only a line that the gap does not split is looked up, as joining it
+    // would cost as much as it is long on every key. Typing at the end of
+    // the line, where a suggestion is shown, leaves the gap after it.
+    if (NULL != ed->history && !ed->searching && line_sz > 0 &&
+            gapbuf_read(ed->line, 0, &line) == line_sz) {
+        size_t match = history_suggest(ed->history, line, line_sz);
+        if (HISTORY_NONE != match) {
+            size_t entry_sz;
+            const char * entry = history_entry(ed->history, match, &entry_sz);
+            hint = entry + line_sz;
+            hint_sz = entry_sz - line_sz;
+        }
+    }
+    // Entries written by other programs might hold anything.
+    for (size_t i = 0; i < hint_sz; ++i) {
+        if ((unsigned char) hint[i] < 0x20 || 0x7F == hint[i]) {
+            hint_sz = 0;
+        }
+    }
+    if (hint_sz > 0 && hint_sz != u8_validate(hint, hint_sz)) {
+        hint_sz = 0;
+    }
+    if (hint_sz == ed->hint_sz && (0 == hint_sz || 0 == memcmp(hint, ed->hint, hint_sz))) {
+        return 0;
+    }
+    _ed_set_hint(ed, hint, hint_sz);
+    return 1;
+}
+
+static void _ed_set_hint(ed_t * ed,
+                         const char * hint,
+                         size_t hint_sz)
+{
+    if (hint_sz > ed->hint_capacity) {
+        ed->hint_capacity = 2 * hint_sz;
+        ed->hint = realloc(ed->hint, ed->hint_capacity);
+    }
+    if (hint_sz > 0) {
+        memcpy(ed->hint, hint, hint_sz);
+    }
+    ed->hint_sz = hint_sz;
+    ed->hint_cols = u8_strwidth_b(hint, hint_sz);
+    _ed_mark_dirty(ed, gapbuf_length(ed->line), ed->line_cols);
+}
+
+/**
+ * Waits for input. Completion results that arrive in the meantime are merged
+ * into the line and shown straight away, as are a change to the set of known
+ * commands and new values of prompt segments.
+ */
+static void _ed_idle(ed_t * ed)
+{
+    while (ed->input_start == ed->input_end) {
+        struct pollfd fds[3] = {
+            { ed->input, POLLIN, 0 },
+            { (NULL != ed->complete) ? complete_fd(ed->complete) : -1, POLLIN, 0 },
+            { (NULL != ed->segments) ? prompt_fd(ed->segments) : -1, POLLIN, 0 }
+        };
+        if (poll(fds, 3, -1) < 0) {
+            if (EINTR == errno) {
+                continue;
+            }
+            return;
+        }
+        if (fds[1].revents & POLLIN) {
+            complete_result_t * result = complete_take(ed->complete);
+            if (NULL != result && result->id == ed->complete_id) {
+                ed->complete_pending = 0;
+                _ed_complete(ed, result);
+                _ed_draw(ed);
+            }
+            if (NULL != result) {
+                complete_result_delete(result);
+            }
+            unsigned int generation = complete_generation(ed->complete);
+            if (NULL != ed->highlight && generation != ed->hl_generation) {
+                ed->hl_generation = generation;
+                highlight_forget(ed->highlight);
+                _ed_damage(ed, 0, gapbuf_length(ed->line));
+                _ed_draw(ed);
+            }
+        }
+        if ((fds[2].revents & POLLIN) && prompt_update(ed->segments)) {
+            _ed_prompt(ed);
+            _ed_draw(ed);
+        }
+        if (fds[0].revents) {
+            return;
+        }
+    }
+}
+
+/**
+ * Takes up the prompt as its segments last made it, to be drawn anew unless
+ * the search prompt is shown in its place.
+ */
+static void _ed_prompt(ed_t * ed)
+{
+    ed->prompt = prompt_text(ed->segments);
+    ed->prompt_cols = u8_strwidth_b(ed->prompt, strlen(ed->prompt));
+    if (!ed->searching) {
+        ed->screen_valid = 0;
+    }
+}
+
+/**
+ * Merges a completion result into the line: the word is extended as far as
+ * all candidates agree and, if there is only one, finished off with a space
+ * (unless it is a directory). When the word cannot be extended, the
+ * candidates are listed instead. What is inserted is single-quoted, the
+ * whole word at once, when it holds a character the scanner would split the
+ * word at; a quote is left open after a directory, for the next completion
+ * to carry on inside it.
+ */
+static void _ed_complete(ed_t * ed,
+                         complete_result_t * result)
+{
+    if (ed->edits != ed->complete_edits || ed->cursor_byte != ed->complete_cursor) {
+        return;
+    }
+    size_t word_sz = ed->complete_cursor - ed->complete_start;
+    const char * first = NULL;
+    size_t common_sz = 0;
+    size_t fits_sz = 0;
+    for (size_t i = 0; i < result->candidates_sz; ++i) {
+        const char * candidate = result->candidates[i];
+        if (!_ed_complete_fits(candidate)) {
+            continue;
+        }
+        fits_sz++;
+        if (NULL == first) {
+            first = candidate;
+            common_sz = strlen(first);
+            continue;
+        }
+        size_t j = 0;
+        while (j < common_sz && first[j] == candidate[j]) {
+            j++;
+        }
+        common_sz = j;
+    }
+    if (0 == fits_sz) {
+        return;
+    }
+    // Never split a character.
+    while (common_sz > word_sz && 0 == u8_sequence_sz(first[common_sz])
+                               && '\0' != first[common_sz]) {
+        common_sz--;
+    }
+    int quoted = ed->complete_quoted;
+    if (common_sz > word_sz) {
+        if (!quoted && common_sz != strcspn(first, " \t<>|@")) {
+            // What was typed holds none of those characters, and is typed
+            // again inside the quote.
+            while (ed->cursor_byte > ed->complete_start) {
+                _ed_delete(ed);
+            }
+            _ed_insert_text(ed, "'", 1);
+            _ed_insert_text(ed, first, common_sz);
+            quoted = 1;
+        } else {
+            _ed_insert_text(ed, first + word_sz, common_sz - word_sz);
+        }
+    }
+    if (1 == fits_sz) {
+        if (0 == common_sz || '/' != first[common_sz - 1]) {
+            if (quoted) {
+                _ed_insert_text(ed, "'", 1);
+            }
+            _ed_insert_text(ed, " ", 1);
+        }
+    } else if (common_sz == word_sz) {
+        _ed_complete_list(ed, result);
+    }
+}
+
+/**
+ * Returns a boolean indicating whether candidate can be written on the line
+ * at all: a quote cannot be, even quoted, nor can control characters.
+ */
+static int _ed_complete_fits(const char * candidate)
+{
+    for (const char * c = candidate; '\0' != *c; ++c) {
+        if ('\'' == *c || (unsigned char) *c < 0x20 || 0x7F == *c) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+/**
+ * Collects the file descriptors that edges in line name, leaving out the
+ * word from skip_from to skip_to that is being completed, along with 0, 1
+ * and 2, in increasing order and once each. Each is written into names and
+ * pointed to from fds. Returns how many there are.
+ */
+static size_t _ed_complete_fds(const char * line,
+                               size_t line_sz,
+                               size_t skip_from,
+                               size_t skip_to,
+                               char names[][16],
+                               char * fds[])
+{
+    unsigned long numbers[ED_COMPLETE_FDS_MAX] = { 0, 1, 2 };
+    size_t numbers_sz = 3;
+    int edge = 0;
+    int quoted = 0;
+    for (size_t i = 0; i < line_sz; ++i) {
+        char c = line[i];
+        if (quoted || '\'' == c) {
+            quoted = (quoted != ('\'' == c));
+            continue;
+        } else if ('<' == c || '>' == c) {
+            edge = ('<' == c);
+            continue;
+        }
+        // Only the first digit of a number outside the word is looked at.
+        int digit = (c >= '0' && c <= '9');
+        int follows = (i > 0 && line[i - 1] >= '0' && line[i - 1] <= '9');
+        if (!edge || !digit || follows || (i >= skip_from && i <= skip_to)) {
+            continue;
+        }
+        unsigned long number = strtoul(line + i, NULL, 10);
+        size_t at = 0;
+        while (at < numbers_sz && numbers[at] < number) {
+            at++;
+        }
+        if ((at < numbers_sz && numbers[at] == number) || ED_COMPLETE_FDS_MAX == numbers_sz) {
+            continue;
+        }
+        memmove(&numbers[at + 1], &numbers[at], (numbers_sz - at) * sizeof(numbers[0]));
+        numbers[at] = number;
+        numbers_sz++;
+    }
+    for (size_t i = 0; i < numbers_sz; ++i) {
+        snprintf(names[i], sizeof(names[i]), "%lu", numbers[i]);
+        fds[i] = names[i];
+    }
+    return numbers_sz;
+}
+
+/**
+ * Prints the candidates in columns below the line, and starts a fresh prompt
+ * after them. Only the last component of paths is shown.
+ */
+static void _ed_complete_list(ed_t * ed,
+                              complete_result_t * result)
+{
+    size_t shown_sz = result->candidates_sz;
+    if (shown_sz > ED_COMPLETE_LIST_MAX) {
+        shown_sz = ED_COMPLETE_LIST_MAX;
+    }
+    const char ** names = malloc(shown_sz * sizeof(char *));
+    unsigned int name_cols = 0;
+    for (size_t i = 0; i < shown_sz; ++i) {
+        const char * candidate = result->candidates[i];
+        size_t candidate_sz = strlen(candidate);
+        names[i] = candidate;
+        for (size_t j = 0; j + 1 < candidate_sz; ++j) {
+            if ('/' == candidate[j]) {
+                names[i] = candidate + j + 1;
+            }
+        }
+        unsigned int cols = u8_strwidth_b(names[i], strlen(names[i]));
+        if (cols > name_cols) {
+            name_cols = cols;
+        }
+    }
+    unsigned int width = _ed_width(ed);
+    unsigned int column_cols = name_cols + 2;
+    unsigned int per_row = (column_cols < width) ? width / column_cols : 1;
+    size_t rows = (shown_sz + per_row - 1) / per_row;
+    _ed_move(ed, ed->prompt_cols + ed->line_cols);
+    for (size_t row = 0; row < rows; ++row) {
+        _ed_emit(ed, "\r\n");
+        for (size_t i = row; i < shown_sz; i += rows) {
+            _ed_emit(ed, names[i]);
+            if (i + rows < shown_sz) {
+                unsigned int cols = u8_strwidth_b(names[i], strlen(names[i]));
+                for (unsigned int pad = cols; pad < column_cols; ++pad) {
+                    _ed_emit(ed, " ");
+                }
+            }
+        }
+    }
+    if (shown_sz < result->candidates_sz) {
+        char more[64];
+        snprintf(more, sizeof(more), "\r\n(%zu more)",
+                 result->candidates_sz - shown_sz);
+        _ed_emit(ed, more);
+    }
+    _ed_emit(ed, "\r\n");
+    free(names);
+    // The prompt goes on the row the cursor is now on.
+    ed->screen_cursor = 0;
+    ed->screen_valid = 0;
+}
+
+/**
+ * Makes sure there is unconsumed input, blocking until some arrives. Reads as
+ * much as is available in a single call. Returns the number of bytes
+ * available, or 0 at end of file.
+ */
+static size_t _ed_fill(ed_t * ed)
+{
+    if (ed->input_start < ed->input_end) {
+        return ed->input_end - ed->input_start;
+    }
+    ed->input_start = 0;
+    ed->input_end = 0;
+    ssize_t n;
+    do {
+        n = read(ed->input, ed->input_buffer, ED_INPUT_BUFFER_SIZE);
+    } while (n < 0 && EINTR == errno);
+    if (n <= 0) {
+        ed->input_eof = 1;
+        return 0;
+    }
+    ed->input_end = n;
+    return n;
+}
+
+/**
+ * Decodes the next UTF-8 character from the input into u8_char, which must
+ * hold at least U8_MAX_BYTES. Returns the number of bytes written, or 0 if an
+ * invalid sequence was skipped or the input reached end of file.
+ */
+static size_t _ed_getc(ed_t * ed,
+                       char * u8_char)
+{
+    if (0 == _ed_fill(ed)) {
+        return 0;
+    }
+    size_t u8_char_sz = u8_sequence_sz(ed->input_buffer[ed->input_start]);
+    if (0 == u8_char_sz) {
+        ed->input_start++;
+        return 0;
+    }
+    // A character split across reads: move the partial bytes to the front
+    // and wait for the rest.
+    while (ed->input_end - ed->input_start < u8_char_sz) {
+        size_t partial_sz = ed->input_end - ed->input_start;
+        memmove(ed->input_buffer, ed->input_buffer + ed->input_start, partial_sz);
+        ed->input_start = 0;
+        ed->input_end = partial_sz;
+        ssize_t n = read(ed->input, ed->input_buffer + partial_sz,
+                         ED_INPUT_BUFFER_SIZE - partial_sz);
+        if (n < 0 && EINTR == errno) {
+            continue;
+        } else if (n <= 0) {
+            ed->input_eof = 1;
+            return 0;
+        }
+        ed->input_end += n;
     }
-    memcpy(ed->line + index, ed->buffer, ed->buffer_sz);
-    ed->cursor_pos += u8_strlen_b(ed->buffer, ed->buffer_sz);
+    const char * start = ed->input_buffer + ed->input_start;
+    if (u8_char_sz != u8_validate(start, u8_char_sz)) {
+        ed->input_start++;
+        return 0;
+    }
+    memcpy(u8_char, start, u8_char_sz);
+    ed->input_start += u8_char_sz;
+    return u8_char_sz;
 }
 
+/**
+ * Deletes the character before the cursor.
+ */
 static void _ed_delete(ed_t * ed)
 {
-    unsigned int index = u8_byte_offset(ed->line, ed->cursor_pos);
+    size_t index = ed->cursor_byte;
     if (index < 1) {
         return;
     }
-    unsigned int preindex = u8_byte_offset(ed->line, ed->cursor_pos - 1);
-    for (unsigned int i = index; i > preindex; --i) {
-        for (unsigned int j = i - 1; j < strlen(ed->line); ++j) {
-            ed->line[j] = ed->line[j + 1];
+    size_t preindex = _ed_prev(ed, index);
+    unsigned int deleted_cols = u8_width(u8_decode(_ed_char_at(ed, preindex)));
+    _ed_mark_dirty(ed, preindex, ed->cursor_col - deleted_cols);
+    ed->edits++;
+    ed->hint_sz = 0;
+    ed->hint_cols = 0;
+    _ed_damage(ed, preindex, index - preindex);
+    gapbuf_erase(ed->line, preindex, index - preindex);
+    ed->cursor_pos--;
+    ed->cursor_byte = preindex;
+    ed->cursor_col -= deleted_cols;
+    ed->line_len--;
+    ed->line_cols -= deleted_cols;
+}
+
+/**
+ * Moves the cursor one character to the right, or to the left if direction
+ * is negative. Combining characters are skipped over along with the
+ * character they modify. Returns 0 if the cursor is already at that end.
+ */
+static int _ed_step(ed_t * ed,
+                    int direction)
+{
+    size_t line_sz = gapbuf_length(ed->line);
+    if (direction > 0) {
+        if (ed->cursor_byte >= line_sz) {
+            return 0;
+        }
+        do {
+            const char * next = _ed_char_at(ed, ed->cursor_byte);
+            ed->cursor_col += u8_width(u8_decode(next));
+            ed->cursor_byte += u8_sequence_sz(next[0]);
+            ed->cursor_pos++;
+        } while (ed->cursor_byte < line_sz &&
+                 0 == u8_width(u8_decode(_ed_char_at(ed, ed->cursor_byte))));
+    } else {
+        if (0 == ed->cursor_byte) {
+            return 0;
         }
+        unsigned int width;
+        do {
+            ed->cursor_byte = _ed_prev(ed, ed->cursor_byte);
+            width = u8_width(u8_decode(_ed_char_at(ed, ed->cursor_byte)));
+            ed->cursor_col -= width;
+            ed->cursor_pos--;
+        } while (0 == width && ed->cursor_byte > 0);
     }
-    ed->cursor_pos--;
+    return 1;
+}
+
+/**
+ * Returns a pointer to the character starting at byte offset pos of the line.
+ * Edits only ever happen at character boundaries, so a character never
+ * straddles the gap.
+ */
+static const char * _ed_char_at(ed_t * ed,
+                                size_t pos)
+{
+    const char * data;
+    gapbuf_read(ed->line, pos, &data);
+    return data;
 }
 
+/**
+ * Returns the byte offset of the character preceding byte offset pos of the
+ * line.
+ */
+static size_t _ed_prev(ed_t * ed,
+                       size_t pos)
+{
+    while (pos > 0 && 0 == u8_sequence_sz(gapbuf_at(ed->line, --pos)));
+    return pos;
+}
+
+/**
+ * Brings the screen up to date with the line. Only the part of the line from
+ * the first change since the previous redraw onwards is rewritten, and the
+ * whole update is sent to the terminal in a single write. Appending at the
+ * end of the line, the common case, costs exactly the appended bytes.
+ */
 static void _ed_draw(ed_t * ed)
 {
-    const char * move_beginning = tparm(cursor_address, ed->offset_y, ed->offset_x);
-    write(ed->output, move_beginning, strlen(move_beginning));
-    write(ed->output, clr_eol, strlen(clr_eol));
-    write(ed->output, ed->prompt, strlen(ed->prompt));
-    write(ed->output, ed->line, strlen(ed->line));
-    const char * move_final = tparm(cursor_address, ed->offset_y, ed->offset_x +
-                                    u8_strlen(ed->prompt) + ed->cursor_pos);
-    write(ed->output, move_final, strlen(move_final));
+    _ed_highlight(ed);
+    const char * prompt = ed->searching ? ed->search_prompt : ed->prompt;
+    unsigned int start = ed->searching ? ed->search_prompt_cols : ed->prompt_cols;
+    if (!ed->screen_valid) {
+        if (0 != ed->screen_cursor) {
+            _ed_move(ed, 0);
+        }
+        _ed_emit(ed, clr_eos ? clr_eos : clr_eol);
+        _ed_emit_b(ed, prompt, strlen(prompt));
+        ed->screen_cursor = start;
+        ed->screen_cols = 0;
+        ed->screen_valid = 1;
+        _ed_mark_dirty(ed, 0, 0);
+    }
+    if (ed->dirty) {
+        unsigned int from = start + ed->dirty_col;
+        if (ed->screen_cursor != from) {
+            _ed_move(ed, from);
+        }
+        size_t written = gapbuf_length(ed->line) - ed->dirty_byte;
+        _ed_emit_line(ed, ed->dirty_byte);
+        if (ed->hint_sz > 0) {
+            _ed_emit(ed, enter_dim_mode);
+            _ed_emit_b(ed, ed->hint, ed->hint_sz);
+            _ed_emit(ed, exit_attribute_mode);
+            written += ed->hint_sz;
+        }
+        unsigned int end = start + ed->line_cols + ed->hint_cols;
+        unsigned int width = _ed_width(ed);
+        ed->screen_cursor = end;
+        if (written > 0 && 0 == end % width) {
+            // The terminal holds the cursor in the last column until the
+            // next character; move it onto the next row as our model expects.
+            _ed_emit(ed, "\r\n");
+        }
+        if (ed->line_cols + ed->hint_cols < ed->screen_cols) {
+            _ed_emit(ed, clr_eos ? clr_eos : clr_eol);
+        }
+        ed->screen_cols = ed->line_cols + ed->hint_cols;
+        ed->dirty = 0;
+    }
+    unsigned int target = start + ed->cursor_col;
+    if (ed->screen_cursor != target) {
+        _ed_move(ed, target);
+    }
+    if (ed->report_enabled && !ed->report_requested && !ed->report_pending &&
+            ed->input_start == ed->input_end && NULL != user7) {
+        // Ask where the cursor really is, but do not wait for the answer: it
+        // is picked out of the input whenever it arrives and only used to
+        // repair the screen should our model of it have gone wrong. Should
+        // the line be accepted first, the answer may reach the command
+        // instead, which is why this is left off unless configured.
+        _ed_emit(ed, user7);
+        ed->report_requested = 1;
+        ed->report_pending = 1;
+        ed->report_cursor = ed->screen_cursor;
+    }
+    _ed_flush(ed);
+}
+
+/**
+ * Records that the line has changed from byte offset byte, which is at
+ * display column col, onwards.
+ */
+static void _ed_mark_dirty(ed_t * ed,
+                           size_t byte,
+                           unsigned int col)
+{
+    if (!ed->dirty || byte < ed->dirty_byte) {
+        ed->dirty_byte = byte;
+        ed->dirty_col = col;
+    }
+    ed->dirty = 1;
+}
+
+/**
+ * Records an edit that is about to replace removed bytes of the line at byte
+ * offset pos, so that the highlighting can be brought up to date for all
+ * edits since the last redraw at once.
+ */
+static void _ed_damage(ed_t * ed,
+                       size_t pos,
+                       size_t removed)
+{
+    size_t tail = gapbuf_length(ed->line) - pos - removed;
+    if (!ed->hl_dirty || pos < ed->hl_start) {
+        ed->hl_start = pos;
+    }
+    if (!ed->hl_dirty || tail < ed->hl_tail) {
+        ed->hl_tail = tail;
+    }
+    ed->hl_dirty = 1;
+}
+
+/**
+ * Brings the highlighting up to date with the line, marking the line dirty
+ * from the first byte that is now styled differently.
+ */
+static void _ed_highlight(ed_t * ed)
+{
+    if (NULL == ed->highlight || !ed->hl_dirty) {
+        return;
+    }
+    ed->hl_dirty = 0;
+    // The line is read in place, on both sides of the gap, which moving
+    // would cost as much as the line is long.
+    const char * line;
+    const char * line_tail;
+    size_t line_sz = gapbuf_read(ed->line, 0, &line);
+    size_t line_tail_sz = gapbuf_read(ed->line, line_sz, &line_tail);
+    size_t changed = highlight_update(ed->highlight, line, line_sz, line_tail,
+                                      line_tail_sz, ed->hl_start, ed->hl_tail);
+    if (ed->dirty && changed >= ed->dirty_byte) {
+        return;
+    }
+    // The change is near the edit, and so near the cursor, whose column is
+    // known; only the distance between the two needs measuring.
+    unsigned int col;
+    if (changed <= ed->cursor_byte) {
+        col = ed->cursor_col - _ed_cols(ed, changed, ed->cursor_byte);
+    } else {
+        col = ed->cursor_col + _ed_cols(ed, ed->cursor_byte, changed);
+    }
+    _ed_mark_dirty(ed, changed, col);
+}
+
+static int _ed_command_known(void * arg,
+                             const char * name)
+{
+    ed_t * ed = arg;
+    if (0 == strcmp(name, "exit") || exec_is_builtin(name)) {
+        return 1;
+    }
+    if (NULL != strchr(name, '/')) {
+        return 0 == access(name, X_OK);
+    }
+    if (NULL == ed->complete) {
+        return -1;
+    }
+    return complete_command_known(ed->complete, name);
+}
+
+/**
+ * Writes the line from byte offset from onwards, in the style of each of its
+ * spans.
+ */
+static void _ed_emit_line(ed_t * ed,
+                          size_t from)
+{
+    size_t pos = from;
+    if (NULL != ed->highlight) {
+        size_t spans_sz;
+        const highlight_span_t * spans = highlight_spans(ed->highlight, &spans_sz);
+        for (size_t i = highlight_find(ed->highlight, from); i < spans_sz; ++i) {
+            const char * style = _ed_style(spans[i].style);
+            if (NULL == style) {
+                continue;
+            }
+            size_t start = (spans[i].start > pos) ? spans[i].start : pos;
+            _ed_emit_range(ed, pos, start);
+            _ed_emit(ed, style);
+            _ed_emit_range(ed, start, spans[i].end);
+            _ed_emit(ed, exit_attribute_mode);
+            pos = spans[i].end;
+        }
+    }
+    _ed_emit_range(ed, pos, gapbuf_length(ed->line));
+}
+
+static void _ed_emit_range(ed_t * ed,
+                           size_t from,
+                           size_t to)
+{
+    const char * data;
+    size_t data_sz;
+    for (size_t pos = from; pos < to &&
+         (data_sz = gapbuf_read(ed->line, pos, &data)) > 0; pos += data_sz) {
+        if (data_sz > to - pos) {
+            data_sz = to - pos;
+        }
+        _ed_emit_b(ed, data, data_sz);
+    }
+}
+
+/**
+ * Returns the sequence that starts showing text in style, or NULL for plain
+ * text. The sequence is only good until the next call.
+ */
+static const char * _ed_style(highlight_style_t style)
+{
+    switch (style) {
+        case HIGHLIGHT_COMMAND:
+            return tparm(set_a_foreground, COLOR_GREEN);
+        case HIGHLIGHT_UNKNOWN:
+            return tparm(set_a_foreground, COLOR_RED);
+        case HIGHLIGHT_QUOTED:
+            return tparm(set_a_foreground, COLOR_YELLOW);
+        case HIGHLIGHT_EDGE:
+        case HIGHLIGHT_PIPE:
+            return tparm(set_a_foreground, COLOR_MAGENTA);
+        case HIGHLIGHT_FD:
+            return tparm(set_a_foreground, COLOR_BLUE);
+        case HIGHLIGHT_AT:
+            return tparm(set_a_foreground, COLOR_CYAN);
+        case HIGHLIGHT_FILE:
+            return enter_underline_mode;
+        default:
+            return NULL;
+    }
+}
+
+static unsigned int _ed_width(ed_t * ed)
+{
+    return (columns > 0) ? columns : 80;
+}
+
+/**
+ * Returns the display width of the bytes of the line from offset from up to
+ * offset to, both at character boundaries.
+ */
+static unsigned int _ed_cols(ed_t * ed,
+                             size_t from,
+                             size_t to)
+{
+    unsigned int cols = 0;
+    const char * data;
+    size_t data_sz;
+    for (size_t pos = from; pos < to &&
+         (data_sz = gapbuf_read(ed->line, pos, &data)) > 0; pos += data_sz) {
+        if (data_sz > to - pos) {
+            data_sz = to - pos;
+        }
+        cols += u8_strwidth_b(data, data_sz);
+    }
+    return cols;
 }
 
-static unsigned int _kb_reduce(ed_t * ed,
-                               kb_t ** potential_bindings)
+/**
+ * Moves the terminal cursor to a position counted in display columns from
+ * the start of the terminal row the prompt is on, wrapping at the terminal
+ * width. Only relative movements are used, so the absolute position of the
+ * prompt never needs to be known.
+ */
+static void _ed_move(ed_t * ed,
+                     unsigned int pos)
 {
-    kb_t * potential_binding, * temp;
-    LL_FOREACH_SAFE(*potential_bindings, potential_binding, temp) {
-        if (strlen(potential_binding->sequence) < ed->buffer_sz ||
-                   0 != strncmp(potential_binding->sequence, ed->buffer, ed->buffer_sz)) {
-            LL_DELETE(*potential_bindings, potential_binding);
-            free(potential_binding);
+    unsigned int width = _ed_width(ed);
+    unsigned int from_row = ed->screen_cursor / width;
+    unsigned int to_row = pos / width;
+    if (to_row < from_row) {
+        if (NULL != parm_up_cursor) {
+            _ed_emit(ed, tparm(parm_up_cursor, from_row - to_row));
+        } else {
+            for (unsigned int i = from_row; i > to_row; --i) {
+                _ed_emit(ed, cursor_up);
+            }
+        }
+    } else if (to_row > from_row) {
+        if (NULL != parm_down_cursor) {
+            _ed_emit(ed, tparm(parm_down_cursor, to_row - from_row));
+        } else {
+            for (unsigned int i = from_row; i < to_row; ++i) {
+                _ed_emit(ed, cursor_down);
+            }
+        }
+    }
+    _ed_emit(ed, "\r");
+    if (pos % width > 0) {
+        if (NULL != parm_right_cursor) {
+            _ed_emit(ed, tparm(parm_right_cursor, pos % width));
+        } else {
+            for (unsigned int i = 0; i < pos % width; ++i) {
+                _ed_emit(ed, cursor_right);
+            }
         }
     }
-    unsigned int potentials_sz = 0;
-    LL_COUNT(*potential_bindings, temp, potentials_sz);
-    return potentials_sz;
+    ed->screen_cursor = pos;
+}
+
+static void _ed_emit(ed_t * ed,
+                     const char * str)
+{
+    if (NULL != str) {
+        _ed_emit_b(ed, str, strlen(str));
+    }
+}
+
+/**
+ * Stages output for the terminal. Nothing is written until _ed_flush.
+ */
+static void _ed_emit_b(ed_t * ed,
+                       const char * data,
+                       size_t data_sz)
+{
+    if (ed->render_sz + data_sz > ed->render_capacity) {
+        ed->render_capacity = 2 * (ed->render_sz + data_sz);
+        ed->render = realloc(ed->render, ed->render_capacity);
+    }
+    memcpy(ed->render + ed->render_sz, data, data_sz);
+    ed->render_sz += data_sz;
+}
+
+static void _ed_flush(ed_t * ed)
+{
+    if (ed->render_sz > 0) {
+        stats_record(STATS_REDRAW_BYTES, ed->render_sz);
+    }
+    io_write_all(ed->output, ed->render, ed->render_sz);
+    ed->render_sz = 0;
 }
 
 static kb_t * _kb_load_bindings(void)
@@ -247,6 +1643,17 @@ static kb_t * _kb_load_bindings(void)
     temp->action = _kb_action_cursor_left;
     LL_PREPEND(bindings, temp);
 
+    // Terminals that ignore keypad_xmit keep sending the cursor-mode arrows.
+    temp = malloc(sizeof(kb_t));
+    temp->sequence = "\x1b[C";
+    temp->action = _kb_action_cursor_right;
+    LL_PREPEND(bindings, temp);
+
+    temp = malloc(sizeof(kb_t));
+    temp->sequence = "\x1b[D";
+    temp->action = _kb_action_cursor_left;
+    LL_PREPEND(bindings, temp);
+
     temp = malloc(sizeof(kb_t));
     temp->sequence = "\x01";
     temp->action = _kb_action_cursor_bol;
@@ -262,30 +1669,218 @@ static kb_t * _kb_load_bindings(void)
     temp->action = _kb_action_backspace;
     LL_PREPEND(bindings, temp);
 
-    // TEMP
     temp = malloc(sizeof(kb_t));
-    temp->sequence = "\xd7\xa2x";
-    temp->action = _kb_nop;
+    temp->sequence = key_up;
+    temp->action = _kb_action_history_previous;
+    LL_PREPEND(bindings, temp);
+
+    temp = malloc(sizeof(kb_t));
+    temp->sequence = key_down;
+    temp->action = _kb_action_history_next;
+    LL_PREPEND(bindings, temp);
+
+    temp = malloc(sizeof(kb_t));
+    temp->sequence = "\x1b[A";
+    temp->action = _kb_action_history_previous;
+    LL_PREPEND(bindings, temp);
+
+    temp = malloc(sizeof(kb_t));
+    temp->sequence = "\x1b[B";
+    temp->action = _kb_action_history_next;
+    LL_PREPEND(bindings, temp);
+
+    temp = malloc(sizeof(kb_t));
+    temp->sequence = "\x10";
+    temp->action = _kb_action_history_previous;
+    LL_PREPEND(bindings, temp);
+
+    temp = malloc(sizeof(kb_t));
+    temp->sequence = "\x0e";
+    temp->action = _kb_action_history_next;
+    LL_PREPEND(bindings, temp);
+
+    temp = malloc(sizeof(kb_t));
+    temp->sequence = "\x12";
+    temp->action = _kb_action_history_search;
+    LL_PREPEND(bindings, temp);
+
+    temp = malloc(sizeof(kb_t));
+    temp->sequence = "\x07";
+    temp->action = _kb_action_abort;
+    LL_PREPEND(bindings, temp);
+
+    temp = malloc(sizeof(kb_t));
+    temp->sequence = "\x06";
+    temp->action = _kb_action_cursor_right;
+    LL_PREPEND(bindings, temp);
+
+    temp = malloc(sizeof(kb_t));
+    temp->sequence = "\t";
+    temp->action = _kb_action_complete;
     LL_PREPEND(bindings, temp);
 
     temp = malloc(sizeof(kb_t));
-    temp->sequence = "\xd7\xa2\xd7\x91x";
-    temp->action = _kb_nop;
+    temp->sequence = "\x1b[200~";
+    temp->action = _kb_action_paste;
     LL_PREPEND(bindings, temp);
 
     return bindings;
 }
 
-static kb_t * _kb_copy(const kb_t * first)
+/**
+ * Reads user key bindings and the prompt from $NEPHESH_RC, or ~/.nepheshrc.
+ * Lines of the form
+ *
+ *     bind <sequence> <action>
+ *     bind-timeout <milliseconds>
+ *     cursor-report on|off
+ *     prompt <format>
+ *
+ * are understood here; other lines are left to the rest of the shell.
+ */
+static void _kb_load_config(ed_t * ed)
+{
+    char path[4096];
+    const char * rc = getenv("NEPHESH_RC");
+    const char * home = getenv("HOME");
+    if (NULL != rc) {
+        snprintf(path, sizeof(path), "%s", rc);
+    } else if (NULL != home) {
+        snprintf(path, sizeof(path), "%s/.nepheshrc", home);
+    } else {
+        return;
+    }
+    FILE * config = fopen(path, "re");
+    if (NULL == config) {
+        return;
+    }
+    char line[1024];
+    unsigned int line_number = 0;
+    while (NULL != fgets(line, sizeof(line), config)) {
+        line_number++;
+        char * saveptr = NULL;
+        const char * directive = strtok_r(line, " \t\n", &saveptr);
+        if (NULL == directive) {
+            continue;
+        } else if (0 == strcmp(directive, "bind")) {
+            const char * text = strtok_r(NULL, " \t\n", &saveptr);
+            const char * name = strtok_r(NULL, " \t\n", &saveptr);
+            char sequence[ED_BUFFER_MAX_SIZE];
+            kb_callback action = (NULL != name) ? _kb_find_action(name) : NULL;
+            if (NULL == text || NULL == action ||
+                    !_kb_parse_sequence(text, sequence, sizeof(sequence)) ||
+                    !keymap_add(ed->keymap, sequence, action)) {
+                fprintf(stderr, "%s:%u: Invalid key binding.\n", path, line_number);
+            }
+        } else if (0 == strcmp(directive, "bind-timeout")) {
+            const char * timeout = strtok_r(NULL, " \t\n", &saveptr);
+            char * end = NULL;
+            long ms = (NULL != timeout) ? strtol(timeout, &end, 10) : -1;
+            if (NULL == end || end == timeout || '\0' != *end || ms < 0 ||
+                    ms > ED_KB_TIMEOUT_MAX) {
+                fprintf(stderr, "%s:%u: bind-timeout takes 0 to %d milliseconds.\n",
+                        path, line_number, ED_KB_TIMEOUT_MAX);
+            } else {
+                ed->kb_timeout = ms;
+            }
+        } else if (0 == strcmp(directive, "cursor-report")) {
+            const char * value = strtok_r(NULL, " \t\n", &saveptr);
+            if (NULL != value && 0 == strcmp(value, "on")) {
+                ed->report_enabled = 1;
+            } else if (NULL != value && 0 == strcmp(value, "off")) {
+                ed->report_enabled = 0;
+            } else {
+                fprintf(stderr, "%s:%u: cursor-report takes on or off.\n", path, line_number);
+            }
+        } else if (0 == strcmp(directive, "prompt")) {
+            // The rest of the line, spaces and all.
+            saveptr[strcspn(saveptr, "\n")] = '\0';
+            free(ed->prompt_format);
+            ed->prompt_format = strdup(saveptr);
+        }
+    }
+    fclose(config);
+}
+
+/**
+ * Translates the textual form of a key sequence. Besides literal characters
+ * it understands ^X for control characters; \e, \n, \r, \t, \\ and \xHH
+ * escapes; and <left>, <right>, <up>, <down>, <home>, <end>, <backspace>
+ * and <delete> for the sequences that terminfo gives for those keys.
+ */
+static int _kb_parse_sequence(const char * text,
+                              char * sequence,
+                              size_t sequence_sz)
 {
-    kb_t * new = NULL;
-    const kb_t * element = NULL;
-    LL_FOREACH(first, element) {
-        kb_t * temp = malloc(sizeof(kb_t));
-        memcpy(temp, element, sizeof(kb_t));
-        LL_PREPEND(new, temp);
+    size_t sz = 0;
+    while ('\0' != *text) {
+        char byte = *text;
+        const char * key = NULL;
+        if ('^' == text[0] && '\0' != text[1]) {
+            byte = text[1] & 0x1F;
+            text += 2;
+        } else if ('\\' == text[0] && 'x' == text[1]) {
+            char * end;
+            byte = (char) strtoul(text + 2, &end, 16);
+            if (end == text + 2 || end > text + 4) {
+                return 0;
+            }
+            text = end;
+        } else if ('\\' == text[0] && '\0' != text[1]) {
+            switch (text[1]) {
+                case 'e': byte = '\x1b'; break;
+                case 'n': byte = '\n'; break;
+                case 'r': byte = '\r'; break;
+                case 't': byte = '\t'; break;
+                default: byte = text[1]; break;
+            }
+            text += 2;
+        } else if ('<' == text[0] && NULL != strchr(text, '>')) {
+            const char * end = strchr(text, '>') + 1;
+            size_t name_sz = end - text;
+            if (0 == strncmp(text, "<left>", name_sz)) {
+                key = key_left;
+            } else if (0 == strncmp(text, "<right>", name_sz)) {
+                key = key_right;
+            } else if (0 == strncmp(text, "<up>", name_sz)) {
+                key = key_up;
+            } else if (0 == strncmp(text, "<down>", name_sz)) {
+                key = key_down;
+            } else if (0 == strncmp(text, "<home>", name_sz)) {
+                key = key_home;
+            } else if (0 == strncmp(text, "<end>", name_sz)) {
+                key = key_end;
+            } else if (0 == strncmp(text, "<backspace>", name_sz)) {
+                key = key_backspace;
+            } else if (0 == strncmp(text, "<delete>", name_sz)) {
+                key = key_dc;
+            }
+            if (NULL == key) {
+                return 0;
+            }
+            text = end;
+        } else {
+            text++;
+        }
+        size_t key_sz = (NULL != key) ? strlen(key) : 1;
+        if (sz + key_sz >= sequence_sz) {
+            return 0;
+        }
+        memcpy(sequence + sz, (NULL != key) ? key : &byte, key_sz);
+        sz += key_sz;
+    }
+    sequence[sz] = '\0';
+    return sz > 0;
+}
+
+static kb_callback _kb_find_action(const char * name)
+{
+    for (size_t i = 0; i < sizeof(_kb_actions) / sizeof(_kb_actions[0]); ++i) {
+        if (0 == strcmp(_kb_actions[i].name, name)) {
+            return _kb_actions[i].action;
+        }
     }
-    return new;
+    return NULL;
 }
 
 static void _kb_action_end_editing(ed_t * ed)
@@ -293,33 +1888,232 @@ static void _kb_action_end_editing(ed_t * ed)
     ed->editing = 0;
 }
 
+/**
+ * Moves the cursor right or, at the end of the line, takes the suggestion.
+ */
 static void _kb_action_cursor_right(ed_t * ed)
 {
-    if (ed->cursor_pos + 1 <= u8_strlen(ed->line)) {
-        ed->cursor_pos++;
+    if (!_ed_step(ed, 1)) {
+        _kb_action_accept_suggestion(ed);
     }
 }
 
 static void _kb_action_cursor_left(ed_t * ed)
 {
-    if (ed->cursor_pos > 0) {
-        ed->cursor_pos--;
-    }
+    _ed_step(ed, -1);
 }
 
 static void _kb_action_cursor_bol(ed_t * ed)
 {
     ed->cursor_pos = 0;
+    ed->cursor_byte = 0;
+    ed->cursor_col = 0;
 }
 
 static void _kb_action_cursor_eol(ed_t * ed)
 {
-    ed->cursor_pos = u8_strlen(ed->line);
+    ed->cursor_pos = ed->line_len;
+    ed->cursor_byte = gapbuf_length(ed->line);
+    ed->cursor_col = ed->line_cols;
 }
 
 static void _kb_action_backspace(ed_t * ed)
 {
-    _ed_delete(ed);
+    if (!ed->searching) {
+        _ed_delete(ed);
+        return;
+    }
+    // Shorten the query by a character and search again from the most
+    // recent entry.
+    while (ed->search_query_sz > 0 &&
+           0 == u8_sequence_sz(ed->search_query[--ed->search_query_sz]));
+    if (ed->search_query_sz > 0) {
+        _ed_search(ed, history_count(ed->history));
+    } else {
+        ed->search_failed = 0;
+        _ed_search_prompt(ed);
+    }
+}
+
+/**
+ * Consumes a bracketed paste up to its closing sequence and inserts it as a
+ * single edit. Line breaks and tabs become spaces; other control characters
+ * and invalid UTF-8 are dropped.
+ */
+static void _kb_action_paste(ed_t * ed)
+{
+    const char * paste_end = "\x1b[201~";
+    size_t paste_end_sz = strlen(paste_end);
+    size_t matched = 0;
+    size_t paste_sz = 0;
+    size_t paste_capacity = ED_INPUT_BUFFER_SIZE;
+    char * paste = malloc(paste_capacity);
+    while (matched < paste_end_sz && _ed_fill(ed) > 0) {
+        char byte = ed->input_buffer[ed->input_start++];
+        if (byte == paste_end[matched]) {
+            matched++;
+            continue;
+        }
+        if (paste_sz + matched + 1 > paste_capacity) {
+            paste_capacity *= 2;
+            paste = realloc(paste, paste_capacity);
+        }
+        // A false start of the closing sequence is ordinary text.
+        memcpy(paste + paste_sz, paste_end, matched);
+        paste_sz += matched;
+        matched = (byte == paste_end[0]) ? 1 : 0;
+        if (matched) {
+            continue;
+        }
+        if ('\n' == byte || '\r' == byte || '\t' == byte) {
+            paste[paste_sz++] = ' ';
+        } else {
+            paste[paste_sz++] = byte;
+        }
+    }
+    _ed_type(ed, paste, paste_sz);
+    free(paste);
+}
+
+/**
+ * Replaces the line with the previous history entry, keeping the line being
+ * edited to come back to.
+ */
+static void _kb_action_history_previous(ed_t * ed)
+{
+    if (NULL == ed->history || 0 == ed->history_pos) {
+        return;
+    }
+    if (ed->history_pos == history_count(ed->history)) {
+        free(ed->history_saved);
+        ed->history_saved = strdup(gapbuf_str(ed->line));
+    }
+    _ed_show_entry(ed, --ed->history_pos);
+}
+
+static void _kb_action_history_next(ed_t * ed)
+{
+    if (NULL == ed->history || ed->history_pos >= history_count(ed->history)) {
+        return;
+    }
+    if (++ed->history_pos < history_count(ed->history)) {
+        _ed_show_entry(ed, ed->history_pos);
+    } else {
+        _ed_set_line(ed, ed->history_saved, strlen(ed->history_saved));
+    }
+}
+
+/**
+ * Starts an incremental search back through the history or, during one,
+ * moves on to the next older match.
+ */
+static void _kb_action_history_search(ed_t * ed)
+{
+    if (NULL == ed->history) {
+        return;
+    }
+    if (!ed->searching) {
+        // Take in what other sessions have added since the prompt appeared.
+        size_t count = history_count(ed->history);
+        history_sync(ed->history);
+        if (ed->history_pos == count) {
+            ed->history_pos = history_count(ed->history);
+        }
+        ed->searching = 1;
+        ed->search_query_sz = 0;
+        ed->search_match = HISTORY_NONE;
+        ed->search_failed = 0;
+        ed->search_saved = strdup(gapbuf_str(ed->line));
+        _ed_search_prompt(ed);
+    } else if (ed->search_query_sz > 0) {
+        _ed_search(ed, (HISTORY_NONE == ed->search_match)
+                       ? history_count(ed->history) : ed->search_match);
+    }
+}
+
+/**
+ * Abandons a history search, restoring the line it started from.
+ */
+static void _kb_action_abort(ed_t * ed)
+{
+    if (ed->searching) {
+        _ed_end_search(ed, 1);
+    }
+}
+
+/**
+ * Asks for the completions of the word before the cursor: a command name at
+ * the start of a command, a file descriptor inside an edge, and a path
+ * anywhere else. The result is merged in when it arrives, unless the line
+ * has changed by then.
+ */
+static void _kb_action_complete(ed_t * ed)
+{
+    if (NULL == ed->complete || ed->searching) {
+        return;
+    }
+    const char * line = gapbuf_str(ed->line);
+    // The word starts after the last character that splits words, or after
+    // the quote that opens it, which the cursor may still be inside of.
+    size_t start = 0;
+    int quoted = 0;
+    for (size_t i = 0; i < ed->cursor_byte; ++i) {
+        if ('\'' == line[i]) {
+            quoted = !quoted;
+            start = i + 1;
+        } else if (!quoted && NULL != strchr(" \t<>|@", line[i])) {
+            start = i + 1;
+        }
+    }
+    size_t before = quoted ? start - 1 : start;
+    while (before > 0 && ' ' == line[before - 1]) {
+        before--;
+    }
+    size_t edge = before;
+    while (edge > 0 && '<' != line[edge - 1] && '>' != line[edge - 1]) {
+        edge--;
+    }
+    ed->complete_id++;
+    ed->complete_quoted = quoted;
+    ed->complete_start = start;
+    ed->complete_cursor = ed->cursor_byte;
+    ed->complete_edits = ed->edits;
+    if (edge > 0 && '<' == line[edge - 1]) {
+        // Inside an edge there are only file descriptors, those the other
+        // edges of the pipeline name and the standard ones, and no need to
+        // bother the worker.
+        char names[ED_COMPLETE_FDS_MAX][16];
+        char * fds[ED_COMPLETE_FDS_MAX];
+        size_t fds_sz = _ed_complete_fds(line, gapbuf_length(ed->line), start,
+                                         ed->cursor_byte, names, fds);
+        complete_result_t result = { ed->complete_id, fds, fds_sz };
+        _ed_complete(ed, &result);
+        return;
+    }
+    complete_kind_t kind = COMPLETE_PATH;
+    if ((0 == before || '>' == line[before - 1]) &&
+            NULL == memchr(line + start, '/', ed->cursor_byte - start)) {
+        kind = COMPLETE_COMMAND;
+    }
+    ed->complete_pending = 1;
+    complete_request(ed->complete, ed->complete_id, kind, line + start,
+                     ed->cursor_byte - start);
+}
+
+/**
+ * Appends the suggested rest of a history entry to the line.
+ */
+static void _kb_action_accept_suggestion(ed_t * ed)
+{
+    if (0 == ed->hint_sz) {
+        return;
+    }
+    _kb_action_cursor_eol(ed);
+    char * hint = malloc(ed->hint_sz);
+    size_t hint_sz = ed->hint_sz;
+    memcpy(hint, ed->hint, hint_sz);
+    _ed_insert_text(ed, hint, hint_sz);
+    free(hint);
 }
 
 static void _kb_nop(ed_t * ed)
@@ -1,8 +1,15 @@
 #ifndef EDITOR_H_
 #define EDITOR_H_
 
-#define ED_LINE_MAX_SIZE 4096
+#include <stdint.h>
+
+#define ED_LINE_INITIAL_SIZE 256
 #define ED_BUFFER_MAX_SIZE 32
+#define ED_INPUT_BUFFER_SIZE 4096
+#define ED_KB_TIMEOUT 100
+#define ED_KB_TIMEOUT_MAX 10000
+#define ED_COMPLETE_LIST_MAX 200
+#define ED_COMPLETE_FDS_MAX 64
 
 typedef struct ed_t ed_t;
 
@@ -18,6 +25,17 @@ typedef struct kb_t {
 ed_t * ed_new(int input,
               int output);
 void ed_delete(ed_t * ed);
+/**
+ * Tells the editor how the last pipeline went, for the prompt: its exit
+ * status and how long it ran.
+ */
+void ed_set_status(ed_t * ed,
+                   int status,
+                   uint64_t duration_ns);
+/**
+ * Lets the user edit a line and returns it once they press enter. Returns
+ * NULL if the input reaches end of file.
+ */
 const char * ed_readline(ed_t * ed);
 
 #endif
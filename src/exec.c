@@ -0,0 +1,811 @@
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <poll.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/resource.h>
+#include <unistd.h>
+#include <wait.h>
+#include <utlist.h>
+#include "exec.h"
+#include "batch.h"
+#include "filter.h"
+#include "io.h"
+#include "memo.h"
+#include "shard.h"
+#include "stats.h"
+
+/**
+ * The longest $NEPHESH_TIMEOUT, in seconds, whose deadline in nanoseconds
+ * cannot overflow: a little over 31 years.
+ */
+#define EXEC_TIMEOUT_MAX 1e9
+
+extern char **environ;
+
+/**
+ * A pipe through which signal handlers and filters wake the shell while it
+ * waits for a pipeline: each writes a byte, the signal number or 0 for a
+ * filter that has finished.
+ */
+static int exec_wake[2] = { -1, -1 };
+static int exec_interactive;
+static volatile sig_atomic_t exec_interrupts;
+
+/**
+ * A stage of a pipeline. A forked stage has its process, or -1 if it could
+ * not be forked, the read end of a close-on-exec pipe that reaches end of
+ * file once the stage has executed its command, and through which it
+ * reports errno otherwise, and when it was forked. A filter stage has its
+ * filter instead. Either ends up with an exit status.
+ */
+typedef struct exec_stage_t {
+    pid_t pid;
+    int ready;
+    uint64_t forked;
+    const char * name;
+    filter_t * filter;
+    int status;
+} exec_stage_t;
+
+/**
+ * What a forked stage would need stdio or the heap for, which a fork of the
+ * threaded shell must not touch, done by the shell before forking: the file
+ * the stage reads on fd 0 and the one its edges into '@' write to, or -1,
+ * and, for a builtin that runs in the shell, its output and exit status, or
+ * a status of -1.
+ */
+typedef struct exec_child_t {
+    int input;
+    int output;
+    char * out;
+    size_t out_sz;
+    char * err;
+    size_t err_sz;
+    int status;
+} exec_child_t;
+
+static void exec_close_pipes(command_t * command);
+static void exec_close_others(void);
+static void exec_signal(int sig);
+static int exec_is_helper(const char * name);
+static int exec_prepare(command_t * command,
+                        exec_child_t * child);
+static void exec_release(exec_child_t * child);
+static void exec_child(command_t * command,
+                       command_t * command_prev,
+                       const exec_child_t * child,
+                       pid_t pgid,
+                       int ready);
+static filter_t * exec_filter(command_t * command,
+                              command_t * command_prev,
+                              int * input,
+                              int * output);
+static void exec_wait(exec_stage_t * stages,
+                      unsigned int stages_sz);
+static void exec_reap(exec_stage_t * stages,
+                      unsigned int stages_sz,
+                      pid_t pgid,
+                      unsigned int children);
+static void exec_exited(exec_stage_t * stages,
+                        unsigned int stages_sz,
+                        pid_t pid,
+                        int status);
+static void exec_cancel(exec_stage_t * stages,
+                        unsigned int stages_sz);
+static double exec_timeout(void);
+static int exec_builtin(command_t * command,
+                        FILE * out,
+                        FILE * err);
+
+void exec_init(int interactive)
+{
+    exec_interactive = interactive && isatty(STDIN_FILENO) &&
+        tcgetpgrp(STDIN_FILENO) == getpgrp();
+    if (0 != pipe2(exec_wake, O_CLOEXEC | O_NONBLOCK)) {
+        exec_wake[0] = exec_wake[1] = -1;
+    }
+    struct sigaction action;
+    memset(&action, 0, sizeof(action));
+    action.sa_handler = exec_signal;
+    sigemptyset(&action.sa_mask);
+    action.sa_flags = SA_RESTART;
+    sigaction(SIGINT, &action, NULL);
+    sigaction(SIGCHLD, &action, NULL);
+    // Filter stages run on threads of the shell, which must outlive the
+    // stages they write to; forked stages restore the default.
+    signal(SIGPIPE, SIG_IGN);
+    // The shell takes the terminal back from pipelines in the background.
+    if (exec_interactive) {
+        signal(SIGTTOU, SIG_IGN);
+    }
+}
+
+int exec_is_builtin(const char * name)
+{
+    return 0 == strcmp(name, "shellstat") || 0 == strcmp(name, "shard") ||
+        0 == strcmp(name, "batch") || 0 == strcmp(name, "cached");
+}
+
+int exec_helper(char * const argv[])
+{
+    // The first word is how the stage's standard input reaches it, as a
+    // digit, for cached.
+    int input = argv[0][0] - '0';
+    if ('\0' == argv[0][0] || '\0' != argv[0][1] || input < 0 ||
+            input > MEMO_INPUT_UNKEYED || NULL == argv[1] || !exec_is_helper(argv[1])) {
+        fputs("nephesh: --builtin is for the shell's own use\n", stderr);
+        return 2;
+    }
+    if (0 == strcmp(argv[1], "shard")) {
+        return shard_run(&argv[1]);
+    } else if (0 == strcmp(argv[1], "batch")) {
+        return batch_run(&argv[1]);
+    }
+    return memo_run(&argv[1], input);
+}
+
+int exec_interrupted(void)
+{
+    int interrupted = exec_interrupts;
+    exec_interrupts = 0;
+    return interrupted;
+}
+
+int exec_pipeline(command_t * commands)
+{
+    command_t * command = NULL;
+    command_t * command_prev = NULL;
+    int end_of_pipeline = 0;
+    pid_t pgid = 0;
+    unsigned int children = 0;
+    // A builtin always runs in the shell, so that it can change it; in a
+    // pipeline a stage of its own writes out what it printed.
+    if (NULL == commands->next && 0 == commands->pipec) {
+        int status = exec_builtin(commands, stdout, stderr);
+        if (status >= 0) {
+            return status;
+        }
+    }
+    unsigned int stages_sz = 0;
+    DL_COUNT(commands, command, stages_sz);
+    stats_allocated();
+    exec_stage_t * stages = malloc(stages_sz * sizeof(exec_stage_t));
+    if (NULL == stages) {
+        return -1;
+    }
+    stages_sz = 0;
+    DL_FOREACH(commands, command) {
+        // The head's prev is the tail.
+        command_prev = (commands == command) ? NULL : command->prev;
+        // Create legitimate pipes. TODO: algorithm sucks
+        for (unsigned int i = 0; i < command->pipec; ++i) {
+            unsigned int found = 0;
+            for (unsigned int j = 0; j < command->pipec; ++j) {
+                if (command->pipes[j][1] == command->pipes[i][1]) {
+                    found = j;
+                    break;
+                }
+            }
+            if (found < i) {
+                command->pipes_legit[i][0] = command->pipes_legit[found][0];
+                command->pipes_legit[i][1] = command->pipes_legit[found][1];
+            } else {
+                pipe2(command->pipes_legit[i], O_CLOEXEC);
+            }
+        }
+        // An edge into '@' writes to the file named by the next command,
+        // which is therefore not run.
+        for (unsigned int i = 0; i < command->pipec; ++i) {
+            if (-1 == command->pipes[i][1]) {
+                end_of_pipeline = 1;
+            }
+        }
+        exec_stage_t * stage = &stages[stages_sz++];
+        stage->pid = -1;
+        stage->ready = -1;
+        stage->status = 0;
+        stage->forked = stats_now();
+        stage->name = command->argv[0];
+        int input;
+        int output;
+        stage->filter = exec_filter(command, command_prev, &input, &output);
+        if (NULL != stage->filter &&
+                !filter_start(stage->filter, input, output, exec_wake[1])) {
+            if (input >= 0) {
+                close(input);
+            }
+            close(output);
+            filter_delete(stage->filter);
+            stage->filter = NULL;
+        }
+        if (NULL != stage->filter) {
+            stats_add(STATS_FILTER_STAGES, 1);
+        } else {
+            exec_child_t child;
+            int prepared = exec_prepare(command, &child);
+            int ready[2] = { -1, -1 };
+            if (prepared && 0 != pipe2(ready, O_CLOEXEC)) {
+                ready[0] = ready[1] = -1;
+            }
+            pid_t pid = prepared ? fork() : -1;
+            if (0 == pid) {
+                exec_child(command, command_prev, &child, pgid, ready[1]);
+            } else if (!prepared) {
+                // exec_prepare has reported why.
+                stage->status = 1;
+            } else if (pid < 0) {
+                fprintf(stderr, "%s: %s\n", command->argv[0], strerror(errno));
+                stage->status = 1;
+            } else {
+                // The first stage leads the pipeline's process group, which
+                // gets the terminal so that ^C reaches every stage at once.
+                // The child does the same, whichever of them runs first.
+                if (0 == pgid) {
+                    pgid = pid;
+                    setpgid(pid, pgid);
+                    if (exec_interactive) {
+                        tcsetpgrp(STDIN_FILENO, pgid);
+                    }
+                } else {
+                    setpgid(pid, pgid);
+                }
+                stage->pid = pid;
+                children++;
+            }
+            exec_release(&child);
+            stats_record(STATS_FORK_NS, stats_now() - stage->forked);
+            if (ready[1] >= 0) {
+                close(ready[1]);
+            }
+            stage->ready = ready[0];
+        }
+        stats_add(STATS_STAGES, 1);
+        // Cleanup previous pipes.
+        if (NULL != command_prev) {
+            exec_close_pipes(command_prev);
+        }
+        command_prev = command;
+        // Reached the end; the pipes of this stage are cleaned up below.
+        if (end_of_pipeline) {
+            break;
+        }
+    }
+    // Cleanup the pipes of the last stage, which has some only when it
+    // writes to '@'.
+    if (NULL != command_prev) {
+        exec_close_pipes(command_prev);
+    }
+    exec_wait(stages, stages_sz);
+    exec_reap(stages, stages_sz, pgid, children);
+    if (exec_interactive && 0 != pgid) {
+        tcsetpgrp(STDIN_FILENO, getpgrp());
+    }
+    for (unsigned int i = 0; i < stages_sz; ++i) {
+        if (NULL != stages[i].filter) {
+            stages[i].status = filter_join(stages[i].filter);
+        }
+    }
+    int status = stages[stages_sz - 1].status;
+    free(stages);
+    return status;
+}
+
+/**
+ * Closes both ends of every pipe out of command, once each: edges into the
+ * same descriptor share a pipe, and closing a descriptor twice could close
+ * one that a filter thread has opened in the meantime.
+ */
+static void exec_close_pipes(command_t * command)
+{
+    for (unsigned int i = 0; i < command->pipec; ++i) {
+        unsigned int j = 0;
+        while (j < i && command->pipes_legit[j][0] != command->pipes_legit[i][0]) {
+            j++;
+        }
+        if (j == i) {
+            close(command->pipes_legit[i][0]);
+            close(command->pipes_legit[i][1]);
+        }
+    }
+}
+
+/**
+ * Closes every descriptor but the standard ones, such as the shell's ends of
+ * filter edges, without allocating. Kernels without close_range have each
+ * descriptor up to the limit closed in turn.
+ */
+static void exec_close_others(void)
+{
+    if (0 == close_range(STDERR_FILENO + 1, ~0U, 0)) {
+        return;
+    }
+    struct rlimit limit;
+    int fd_max = 1024;
+    if (0 == getrlimit(RLIMIT_NOFILE, &limit) && RLIM_INFINITY != limit.rlim_cur) {
+        fd_max = (limit.rlim_cur < INT_MAX) ? (int) limit.rlim_cur : INT_MAX;
+    }
+    for (int fd = STDERR_FILENO + 1; fd < fd_max; ++fd) {
+        close(fd);
+    }
+}
+
+static void exec_signal(int sig)
+{
+    int saved = errno;
+    if (SIGINT == sig) {
+        exec_interrupts = 1;
+    }
+    if (exec_wake[1] >= 0) {
+        char byte = sig;
+        write(exec_wake[1], &byte, sizeof(byte));
+    }
+    errno = saved;
+}
+
+/**
+ * Returns a boolean indicating whether name is a builtin that forks, and so
+ * runs in the shell executed afresh as `nephesh --builtin`.
+ */
+static int exec_is_helper(const char * name)
+{
+    return 0 == strcmp(name, "shard") || 0 == strcmp(name, "batch") ||
+        0 == strcmp(name, "cached");
+}
+
+/**
+ * Opens the files the edges of command read and write, and runs it if it is
+ * a builtin that does not fork, keeping its output, for the stage to be
+ * forked with child. Returns 0, having reported why, if a file cannot be
+ * opened.
+ */
+static int exec_prepare(command_t * command,
+                        exec_child_t * child)
+{
+    memset(child, 0, sizeof(exec_child_t));
+    child->input = -1;
+    child->output = -1;
+    child->status = -1;
+    if (NULL != command->input) {
+        child->input = open(command->input, O_RDONLY | O_CLOEXEC);
+        if (child->input < 0) {
+            fprintf(stderr, "%s: %s\n", command->input, strerror(errno));
+            return 0;
+        }
+    }
+    for (unsigned int i = 0; i < command->pipec && child->output < 0; ++i) {
+        if (-1 == command->pipes[i][1]) {
+            const char * path = command->next->argv[0];
+            child->output = open(path, O_CREAT | O_WRONLY | O_CLOEXEC, 0644);
+            if (child->output < 0) {
+                fprintf(stderr, "%s: %s\n", path, strerror(errno));
+                exec_release(child);
+                return 0;
+            }
+        }
+    }
+    if (exec_is_builtin(command->argv[0]) && !exec_is_helper(command->argv[0])) {
+        FILE * out = open_memstream(&child->out, &child->out_sz);
+        FILE * err = open_memstream(&child->err, &child->err_sz);
+        if (NULL == out || NULL == err) {
+            fprintf(stderr, "%s: %s\n", command->argv[0], strerror(errno));
+            if (NULL != out) {
+                fclose(out);
+            }
+            exec_release(child);
+            return 0;
+        }
+        child->status = exec_builtin(command, out, err);
+        fclose(out);
+        fclose(err);
+    }
+    return 1;
+}
+
+/**
+ * Closes and frees what exec_prepare left in child, once the stage has been
+ * forked.
+ */
+static void exec_release(exec_child_t * child)
+{
+    if (child->input >= 0) {
+        close(child->input);
+    }
+    if (child->output >= 0) {
+        close(child->output);
+    }
+    free(child->out);
+    free(child->err);
+    child->input = child->output = -1;
+    child->out = child->err = NULL;
+}
+
+/**
+ * Sets up a forked stage and executes its command, reporting errno through
+ * ready if that fails. The shell has threads, any of which may have held a
+ * lock in malloc or stdio at the fork, so nothing here allocates or uses
+ * stdio: exec_prepare has done that beforehand.
+ */
+static void exec_child(command_t * command,
+                       command_t * command_prev,
+                       const exec_child_t * child,
+                       pid_t pgid,
+                       int ready)
+{
+    setpgid(0, pgid);
+    if (exec_interactive && 0 == pgid) {
+        tcsetpgrp(STDIN_FILENO, getpgrp());
+    }
+    signal(SIGINT, SIG_DFL);
+    signal(SIGCHLD, SIG_DFL);
+    signal(SIGPIPE, SIG_DFL);
+    signal(SIGTTOU, SIG_DFL);
+    // Every edge of the stage, as the descriptor it has in the shell and
+    // the one the command expects it on.
+    int sources[2 * COMMAND_MAX_PIPES];
+    int targets[2 * COMMAND_MAX_PIPES];
+    unsigned int edges_sz = 0;
+    int base = STDERR_FILENO + 1;
+    memo_input_t memo_input = MEMO_INPUT_INHERITED;
+    if (NULL != command_prev) {
+        for (unsigned int i = 0; i < command_prev->pipec; ++i) {
+            sources[edges_sz] = command_prev->pipes_legit[i][0];
+            targets[edges_sz++] = command_prev->pipes[i][1];
+            if (STDIN_FILENO != command_prev->pipes[i][1]) {
+                memo_input = MEMO_INPUT_UNKEYED;
+            } else if (MEMO_INPUT_UNKEYED != memo_input) {
+                memo_input = MEMO_INPUT_PIPED;
+            }
+        }
+    }
+    if (NULL != command->input) {
+        sources[edges_sz] = child->input;
+        targets[edges_sz++] = STDIN_FILENO;
+        if (MEMO_INPUT_UNKEYED != memo_input) {
+            memo_input = MEMO_INPUT_PIPED;
+        }
+    }
+    for (unsigned int i = 0; i < command->pipec; ++i) {
+        if (-1 == command->pipes[i][1]) {
+            sources[edges_sz] = child->output;
+        } else {
+            sources[edges_sz] = command->pipes_legit[i][1];
+        }
+        targets[edges_sz++] = command->pipes[i][0];
+    }
+    for (unsigned int i = 0; i < edges_sz; ++i) {
+        if (targets[i] >= base) {
+            base = targets[i] + 1;
+        }
+    }
+    // Every source is first moved above every target, so that putting one
+    // edge in place cannot clobber the source of another, and then nothing
+    // but the targets is left open: a pipe end held by a stage that does not
+    // use it would keep its writer from ever seeing a broken pipe.
+    for (unsigned int i = 0; i < edges_sz; ++i) {
+        sources[i] = fcntl(sources[i], F_DUPFD, base);
+    }
+    if (NULL != command_prev) {
+        exec_close_pipes(command_prev);
+    }
+    exec_close_pipes(command);
+    for (unsigned int i = 0; i < edges_sz; ++i) {
+        dup2(sources[i], targets[i]);
+    }
+    for (unsigned int i = 0; i < edges_sz; ++i) {
+        close(sources[i]);
+    }
+    // A builtin that has already run only has its output left to write,
+    // and must not keep what executing a command would have closed.
+    if (child->status >= 0) {
+        exec_close_others();
+        io_write_all(STDOUT_FILENO, child->out, child->out_sz);
+        io_write_all(STDERR_FILENO, child->err, child->err_sz);
+        _exit(child->status);
+    }
+    if (exec_is_helper(command->argv[0])) {
+        char input[] = { '0' + memo_input, '\0' };
+        char * argv[command->argc + 4];
+        argv[0] = "nephesh";
+        argv[1] = "--builtin";
+        argv[2] = input;
+        memcpy(&argv[3], command->argv, (command->argc + 1) * sizeof(char *));
+        execv("/proc/self/exe", argv);
+    } else {
+        execvpe(command->argv[0], command->argv, environ);
+    }
+    int error = errno;
+    write(ready, &error, sizeof(error));
+    _exit((ENOENT == error) ? 127 : 126);
+}
+
+/**
+ * Returns a filter to run command with, and the descriptors it should read
+ * and write, if there is a built-in filter for it and its edges are ones a
+ * filter can serve: everything it reads arrives on its fd 0, and everything
+ * it writes leaves from its fd 1, to one place. A filter that reads its
+ * input must have a stage before it or a file to read, as the terminal is
+ * left to commands.
+ * The descriptors are duplicates, closed on exec, which the filter owns.
+ */
+static filter_t * exec_filter(command_t * command,
+                              command_t * command_prev,
+                              int * input,
+                              int * output)
+{
+    filter_t * filter = filter_new(command->argv);
+    if (NULL == filter) {
+        return NULL;
+    }
+    *input = -1;
+    *output = -1;
+    if (NULL != command_prev) {
+        for (unsigned int i = 0; i < command_prev->pipec; ++i) {
+            if (0 != command_prev->pipes[i][1]) {
+                goto error;
+            }
+        }
+    }
+    if (command->pipec > 1 || (1 == command->pipec && 1 != command->pipes[0][0])) {
+        goto error;
+    }
+    // A file that cannot be opened is left for the forked stage to report.
+    if (NULL != command->input) {
+        *input = open(command->input, O_RDONLY | O_CLOEXEC);
+        if (*input < 0) {
+            goto error;
+        }
+    } else if (NULL != command_prev) {
+        // Edges into fd 0 share one pipe.
+        for (unsigned int i = 0; i < command_prev->pipec; ++i) {
+            if (0 == command_prev->pipes[i][1]) {
+                *input = fcntl(command_prev->pipes_legit[i][0], F_DUPFD_CLOEXEC, 0);
+                if (*input < 0) {
+                    goto error;
+                }
+                break;
+            }
+        }
+    }
+    if (*input < 0 && filter_uses_input(filter)) {
+        goto error;
+    }
+    if (0 == command->pipec) {
+        *output = fcntl(STDOUT_FILENO, F_DUPFD_CLOEXEC, 0);
+    } else if (-1 == command->pipes[0][1]) {
+        *output = open(command->next->argv[0], O_CREAT | O_WRONLY | O_CLOEXEC, 0644);
+    } else {
+        *output = fcntl(command->pipes_legit[0][1], F_DUPFD_CLOEXEC, 0);
+    }
+    if (*output < 0) {
+        goto error;
+    }
+    return filter;
+error:
+    if (*input >= 0) {
+        close(*input);
+    }
+    filter_delete(filter);
+    return NULL;
+}
+
+/**
+ * Waits until every forked stage has either executed its command, recording
+ * how long that took, or failed to, which is reported.
+ */
+static void exec_wait(exec_stage_t * stages,
+                      unsigned int stages_sz)
+{
+    stats_allocated();
+    struct pollfd * fds = malloc(stages_sz * sizeof(struct pollfd));
+    if (NULL == fds) {
+        return;
+    }
+    unsigned int left = 0;
+    for (unsigned int i = 0; i < stages_sz; ++i) {
+        fds[i].fd = stages[i].ready;
+        fds[i].events = POLLIN;
+        if (fds[i].fd >= 0) {
+            left++;
+        }
+    }
+    while (left > 0) {
+        if (poll(fds, stages_sz, -1) < 0) {
+            if (EINTR == errno) {
+                continue;
+            }
+            break;
+        }
+        uint64_t now = stats_now();
+        for (unsigned int i = 0; i < stages_sz; ++i) {
+            if (fds[i].fd < 0 || 0 == fds[i].revents) {
+                continue;
+            }
+            int error;
+            if (sizeof(error) == read(fds[i].fd, &error, sizeof(error))) {
+                stats_add(STATS_EXEC_FAILURES, 1);
+                fprintf(stderr, "%s: %s%s\n", stages[i].name, strerror(error),
+                        (E2BIG == error) ? " (batch splits arguments that do not fit)" : "");
+            } else {
+                stats_record(STATS_EXEC_NS, now - stages[i].forked);
+            }
+            close(fds[i].fd);
+            fds[i].fd = -1;
+            left--;
+        }
+    }
+    for (unsigned int i = 0; i < stages_sz; ++i) {
+        if (fds[i].fd >= 0) {
+            close(fds[i].fd);
+        }
+    }
+    free(fds);
+}
+
+/**
+ * Waits for the forked stages to exit, recording their statuses, and the
+ * filters to finish. Only the pipeline's process group is waited for, as
+ * the shell may have other children. ^C, when it
+ * reaches the shell rather than the stages, and a child killed by it cancel
+ * the rest. Once $NEPHESH_TIMEOUT seconds have passed, the process group is
+ * sent SIGTERM, and SIGKILL every second after that, and filters are
+ * cancelled. A stopped stage is continued, as there is no job control to
+ * resume it later.
+ */
+static void exec_reap(exec_stage_t * stages,
+                      unsigned int stages_sz,
+                      pid_t pgid,
+                      unsigned int children)
+{
+    unsigned int filters = 0;
+    for (unsigned int i = 0; i < stages_sz; ++i) {
+        if (NULL != stages[i].filter) {
+            filters++;
+        }
+    }
+    int status;
+    pid_t pid;
+    if (exec_wake[0] < 0) {
+        while (children > 0 && (pid = waitpid(-pgid, &status, 0)) > 0) {
+            exec_exited(stages, stages_sz, pid, status);
+            children--;
+        }
+        return;
+    }
+    double timeout = exec_timeout();
+    uint64_t deadline = (timeout > 0) ? stats_now() + (uint64_t) (timeout * 1e9) : 0;
+    unsigned int expired = 0;
+    while (1) {
+        while (children > 0 && (pid = waitpid(-pgid, &status, WNOHANG | WUNTRACED)) > 0) {
+            if (WIFSTOPPED(status)) {
+                kill(pid, SIGCONT);
+                continue;
+            }
+            exec_exited(stages, stages_sz, pid, status);
+            children--;
+            if (WIFSIGNALED(status) && SIGINT == WTERMSIG(status)) {
+                exec_cancel(stages, stages_sz);
+            }
+        }
+        if (0 == children && 0 == filters) {
+            break;
+        }
+        int wait_ms = -1;
+        if (0 != deadline) {
+            uint64_t now = stats_now();
+            if (now >= deadline) {
+                if (0 == expired) {
+                    fprintf(stderr, "Pipeline timed out after %g s.\n", timeout);
+                }
+                if (0 != pgid) {
+                    kill(-pgid, (0 == expired) ? SIGTERM : SIGKILL);
+                }
+                exec_cancel(stages, stages_sz);
+                expired++;
+                deadline = now + 1000000000;
+            }
+            wait_ms = (deadline - now) / 1000000 + 1;
+        }
+        struct pollfd wake = { .fd = exec_wake[0], .events = POLLIN };
+        if (poll(&wake, 1, wait_ms) < 0 && EINTR != errno) {
+            break;
+        }
+        char bytes[64];
+        ssize_t n;
+        while ((n = read(exec_wake[0], bytes, sizeof(bytes))) > 0) {
+            for (ssize_t i = 0; i < n; ++i) {
+                if (0 == bytes[i] && filters > 0) {
+                    filters--;
+                } else if (SIGINT == bytes[i]) {
+                    // Stages that have the terminal got ^C themselves.
+                    if (!exec_interactive && 0 != pgid) {
+                        kill(-pgid, SIGINT);
+                    }
+                    exec_cancel(stages, stages_sz);
+                }
+            }
+        }
+    }
+}
+
+/**
+ * Records the exit status of the stage that ran as pid, as a shell reports
+ * it: 128 plus the signal for one that was killed.
+ */
+static void exec_exited(exec_stage_t * stages,
+                        unsigned int stages_sz,
+                        pid_t pid,
+                        int status)
+{
+    for (unsigned int i = 0; i < stages_sz; ++i) {
+        if (stages[i].pid == pid) {
+            stages[i].status = WIFSIGNALED(status) ?
+                128 + WTERMSIG(status) : WEXITSTATUS(status);
+        }
+    }
+}
+
+static void exec_cancel(exec_stage_t * stages,
+                        unsigned int stages_sz)
+{
+    for (unsigned int i = 0; i < stages_sz; ++i) {
+        if (NULL != stages[i].filter) {
+            filter_cancel(stages[i].filter);
+        }
+    }
+}
+
+/**
+ * Returns how many seconds a pipeline may run, from $NEPHESH_TIMEOUT, or 0
+ * for no limit. A value that is not a number of seconds up to
+ * EXEC_TIMEOUT_MAX is reported, the first time, and means no limit.
+ */
+static double exec_timeout(void)
+{
+    static int warned = 0;
+    const char * env = getenv("NEPHESH_TIMEOUT");
+    if (NULL == env || '\0' == env[0]) {
+        return 0;
+    }
+    char * end;
+    double timeout = strtod(env, &end);
+    if ('\0' != *end || !(timeout >= 0 && timeout <= EXEC_TIMEOUT_MAX)) {
+        if (!warned) {
+            fprintf(stderr, "NEPHESH_TIMEOUT: Invalid number of seconds: %s\n", env);
+            warned = 1;
+        }
+        return 0;
+    }
+    return timeout;
+}
+
+/**
+ * Runs command if it is a builtin, writing what it prints to out and err,
+ * and returns its exit status, or returns -1 if it is not one.
+ */
+static int exec_builtin(command_t * command,
+                        FILE * out,
+                        FILE * err)
+{
+    if (0 != strcmp(command->argv[0], "shellstat")) {
+        return -1;
+    }
+    const char * usage = "Usage: shellstat [--json | --reset | --verbose LEVEL]\n";
+    if (1 == command->argc) {
+        stats_print(out);
+    } else if (2 == command->argc && 0 == strcmp(command->argv[1], "--json")) {
+        stats_print_json(out);
+    } else if (2 == command->argc && 0 == strcmp(command->argv[1], "--reset")) {
+        stats_reset();
+    } else if (3 == command->argc && 0 == strcmp(command->argv[1], "--verbose")) {
+        stats_set_verbosity(atoi(command->argv[2]));
+    } else {
+        fputs(usage, err);
+        return 2;
+    }
+    fflush(out);
+    return 0;
+}
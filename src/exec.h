@@ -0,0 +1,40 @@
+#ifndef EXEC_H_
+#define EXEC_H_
+
+#include "command.h"
+
+/**
+ * Sets up the signal handling pipelines need. An interactive shell that has
+ * the terminal hands it to each pipeline while it runs.
+ */
+void exec_init(int interactive);
+
+/**
+ * Runs the pipeline made of commands, every stage at once, and waits for
+ * all of them to finish. Stages that a built-in filter can stand in for run
+ * on threads of the shell; the others are forked and executed. Returns the
+ * exit status of the pipeline, which is that of its last stage, or -1 if
+ * the pipeline could not be run.
+ */
+int exec_pipeline(command_t * commands);
+
+/**
+ * Returns a boolean indicating whether name is a command of the shell's own.
+ */
+int exec_is_builtin(const char * name);
+
+/**
+ * Runs a shard, batch or cached stage in the shell executed afresh for it
+ * by a forked stage, as `nephesh --builtin INPUT COMMAND [ARG]...`, where
+ * argv starts at INPUT, the memo_input_t of the stage as a digit. Returns
+ * its exit status.
+ */
+int exec_helper(char * const argv[]);
+
+/**
+ * Returns a boolean indicating whether the shell has been sent SIGINT since
+ * this was last called.
+ */
+int exec_interrupted(void);
+
+#endif
@@ -0,0 +1,702 @@
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/eventfd.h>
+#include <unistd.h>
+#include "filter.h"
+#include "io.h"
+
+typedef struct filter_kind_t filter_kind_t;
+
+struct filter_t {
+    const filter_kind_t * kind;
+    /**
+     * The files named by the arguments, in order; NULL stands for the input.
+     */
+    const char ** files;
+    size_t files_sz;
+    /**
+     * What head and tail count, and how many of them.
+     */
+    int bytes;
+    unsigned long long count;
+    /**
+     * What wc counts, and whether tee appends.
+     */
+    int wc_lines;
+    int wc_bytes;
+    int append;
+    int input;
+    int output;
+    int notify;
+    /**
+     * An eventfd that becomes readable once the filter is cancelled, and
+     * that every blocking call waits on alongside its own descriptor.
+     */
+    int cancel;
+    char * buffer;
+    int status;
+    pthread_t thread;
+};
+
+struct filter_kind_t {
+    const char * name;
+    /**
+     * Takes in the option at argv[*i], moving *i past any argument it takes,
+     * and returns a boolean indicating whether it is supported. NULL if the
+     * filter has no options.
+     */
+    int (*option)(filter_t * filter,
+                  char * const argv[],
+                  unsigned int * i);
+    /**
+     * The most files the filter supports, or -1 for any number.
+     */
+    int files_max;
+    int (*run)(filter_t * filter);
+};
+
+static int filter_option_count(filter_t * filter,
+                               char * const argv[],
+                               unsigned int * i);
+static int filter_option_wc(filter_t * filter,
+                            char * const argv[],
+                            unsigned int * i);
+static int filter_option_tee(filter_t * filter,
+                             char * const argv[],
+                             unsigned int * i);
+static int filter_run_cat(filter_t * filter);
+static int filter_run_head(filter_t * filter);
+static int filter_run_tail(filter_t * filter);
+static int filter_run_wc(filter_t * filter);
+static int filter_run_tee(filter_t * filter);
+static void * filter_thread(void * arg);
+static int filter_parse_count(const char * text,
+                              unsigned long long * count);
+static int filter_open(filter_t * filter,
+                       const char * path);
+static void filter_close(filter_t * filter,
+                         int fd);
+static int filter_wait(filter_t * filter,
+                       int fd,
+                       short events);
+static ssize_t filter_read(filter_t * filter,
+                           int fd,
+                           const char * path,
+                           char * buffer,
+                           size_t size);
+static int filter_write(filter_t * filter,
+                        int fd,
+                        const char * buffer,
+                        size_t size);
+static int filter_copy(filter_t * filter,
+                       int fd,
+                       const char * path,
+                       unsigned long long limit);
+static size_t filter_tail_start(filter_t * filter,
+                                const char * data,
+                                size_t data_sz);
+
+static const filter_kind_t filter_kinds[] = {
+    { "cat", NULL, -1, filter_run_cat },
+    { "head", filter_option_count, 1, filter_run_head },
+    { "tail", filter_option_count, 1, filter_run_tail },
+    { "wc", filter_option_wc, 0, filter_run_wc },
+    { "tee", filter_option_tee, -1, filter_run_tee }
+};
+
+filter_t * filter_new(char * const argv[])
+{
+    const filter_kind_t * kind = NULL;
+    for (size_t i = 0; i < sizeof(filter_kinds) / sizeof(filter_kinds[0]); ++i) {
+        if (0 == strcmp(argv[0], filter_kinds[i].name)) {
+            kind = &filter_kinds[i];
+            break;
+        }
+    }
+    if (NULL == kind) {
+        return NULL;
+    }
+    filter_t * filter = calloc(1, sizeof(filter_t));
+    if (NULL == filter) {
+        return NULL;
+    }
+    filter->kind = kind;
+    filter->count = 10;
+    filter->input = -1;
+    filter->output = -1;
+    filter->cancel = -1;
+    unsigned int argc = 0;
+    while (NULL != argv[argc]) {
+        argc++;
+    }
+    filter->files = malloc(argc * sizeof(const char *));
+    if (NULL == filter->files) {
+        goto error;
+    }
+    int options = 1;
+    for (unsigned int i = 1; i < argc; ++i) {
+        const char * arg = argv[i];
+        if (options && 0 == strcmp(arg, "--")) {
+            options = 0;
+        } else if (options && '-' == arg[0] && '\0' != arg[1]) {
+            if (NULL == kind->option || !kind->option(filter, argv, &i)) {
+                goto error;
+            }
+        } else if (0 == strcmp(arg, "-")) {
+            // tee takes "-" to be a file, which is better left to tee.
+            if (filter_run_tee == kind->run) {
+                goto error;
+            }
+            filter->files[filter->files_sz++] = NULL;
+        } else {
+            filter->files[filter->files_sz++] = arg;
+        }
+    }
+    if (kind->files_max >= 0 && filter->files_sz > (size_t) kind->files_max) {
+        goto error;
+    }
+    // Without files, cat, head and tail read their input.
+    if (0 == filter->files_sz && filter_run_tee != kind->run) {
+        filter->files[filter->files_sz++] = NULL;
+    }
+    if (filter_run_wc == kind->run && !filter->wc_lines && !filter->wc_bytes) {
+        goto error;
+    }
+    return filter;
+error:
+    filter_delete(filter);
+    return NULL;
+}
+
+void filter_delete(filter_t * filter)
+{
+    if (NULL == filter) {
+        return;
+    }
+    if (filter->cancel >= 0) {
+        close(filter->cancel);
+    }
+    free(filter->files);
+    free(filter->buffer);
+    free(filter);
+}
+
+int filter_uses_input(filter_t * filter)
+{
+    if (filter_run_wc == filter->kind->run || filter_run_tee == filter->kind->run) {
+        return 1;
+    }
+    for (size_t i = 0; i < filter->files_sz; ++i) {
+        if (NULL == filter->files[i]) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+int filter_start(filter_t * filter,
+                 int input,
+                 int output,
+                 int notify)
+{
+    if (NULL == filter->buffer) {
+        filter->buffer = malloc(FILTER_BUFFER_SIZE);
+        if (NULL == filter->buffer) {
+            return 0;
+        }
+    }
+    if (filter->cancel < 0) {
+        filter->cancel = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+        if (filter->cancel < 0) {
+            return 0;
+        }
+    }
+    filter->input = input;
+    filter->output = output;
+    filter->notify = notify;
+    if (0 != pthread_create(&filter->thread, NULL, filter_thread, filter)) {
+        filter->input = -1;
+        filter->output = -1;
+        return 0;
+    }
+    return 1;
+}
+
+void filter_cancel(filter_t * filter)
+{
+    uint64_t one = 1;
+    write(filter->cancel, &one, sizeof(one));
+}
+
+int filter_join(filter_t * filter)
+{
+    pthread_join(filter->thread, NULL);
+    int status = filter->status;
+    filter_delete(filter);
+    return status;
+}
+
+static void * filter_thread(void * arg)
+{
+    filter_t * filter = arg;
+    filter->status = filter->kind->run(filter);
+    filter_close(filter, filter->input);
+    close(filter->output);
+    filter->output = -1;
+    if (filter->notify >= 0) {
+        char done = 0;
+        write(filter->notify, &done, sizeof(done));
+    }
+    return NULL;
+}
+
+/**
+ * Takes in the options of head and tail: -n N, -c N, either with the number
+ * attached, and -N.
+ */
+static int filter_option_count(filter_t * filter,
+                               char * const argv[],
+                               unsigned int * i)
+{
+    const char * arg = argv[*i];
+    if (arg[1] >= '0' && arg[1] <= '9') {
+        filter->bytes = 0;
+        return filter_parse_count(&arg[1], &filter->count);
+    }
+    if ('n' != arg[1] && 'c' != arg[1]) {
+        return 0;
+    }
+    filter->bytes = ('c' == arg[1]);
+    if ('\0' != arg[2]) {
+        return filter_parse_count(&arg[2], &filter->count);
+    }
+    if (NULL == argv[*i + 1]) {
+        return 0;
+    }
+    ++*i;
+    return filter_parse_count(argv[*i], &filter->count);
+}
+
+/**
+ * Takes in -l and -c, alone or together; wc then prints lines before bytes.
+ */
+static int filter_option_wc(filter_t * filter,
+                            char * const argv[],
+                            unsigned int * i)
+{
+    for (const char * c = &argv[*i][1]; '\0' != *c; ++c) {
+        if ('l' == *c) {
+            filter->wc_lines = 1;
+        } else if ('c' == *c) {
+            filter->wc_bytes = 1;
+        } else {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+static int filter_option_tee(filter_t * filter,
+                             char * const argv[],
+                             unsigned int * i)
+{
+    if (0 != strcmp(argv[*i], "-a")) {
+        return 0;
+    }
+    filter->append = 1;
+    return 1;
+}
+
+static int filter_run_cat(filter_t * filter)
+{
+    int status = 0;
+    for (size_t i = 0; i < filter->files_sz; ++i) {
+        int fd = filter_open(filter, filter->files[i]);
+        if (fd < 0) {
+            status = 1;
+            continue;
+        }
+        int copied = filter_copy(filter, fd, filter->files[i], 0);
+        filter_close(filter, fd);
+        if (copied < 0) {
+            return 1;
+        } else if (0 == copied) {
+            status = 1;
+        }
+    }
+    return status;
+}
+
+static int filter_run_head(filter_t * filter)
+{
+    int fd = filter_open(filter, filter->files[0]);
+    if (fd < 0) {
+        return 1;
+    }
+    int status = 0;
+    if (filter->bytes) {
+        if (filter->count > 0) {
+            status = (1 == filter_copy(filter, fd, filter->files[0], filter->count)) ? 0 : 1;
+        }
+    } else {
+        unsigned long long left = filter->count;
+        while (left > 0) {
+            ssize_t n = filter_read(filter, fd, filter->files[0],
+                                    filter->buffer, FILTER_BUFFER_SIZE);
+            if (n <= 0) {
+                status = (n < 0);
+                break;
+            }
+            size_t end = 0;
+            while (left > 0 && end < (size_t) n) {
+                char * newline = memchr(&filter->buffer[end], '\n', n - end);
+                end = (NULL == newline) ? (size_t) n : (size_t) (newline - filter->buffer) + 1;
+                if (NULL != newline) {
+                    left--;
+                }
+            }
+            if (!filter_write(filter, filter->output, filter->buffer, end)) {
+                status = 1;
+                break;
+            }
+        }
+    }
+    // Whatever is left is not read, so that the writer finds out early.
+    filter_close(filter, fd);
+    return status;
+}
+
+static int filter_run_tail(filter_t * filter)
+{
+    int fd = filter_open(filter, filter->files[0]);
+    if (fd < 0) {
+        return 1;
+    }
+    char * data = NULL;
+    size_t data_sz = 0;
+    size_t data_capacity = 0;
+    int status = 0;
+    while (1) {
+        // What can no longer be part of the tail is dropped before growing,
+        // when that frees at least half.
+        if (data_capacity - data_sz < FILTER_BUFFER_SIZE) {
+            size_t start = filter_tail_start(filter, data, data_sz);
+            if (start > data_sz / 2) {
+                memmove(data, &data[start], data_sz - start);
+                data_sz -= start;
+            }
+        }
+        if (data_capacity - data_sz < FILTER_BUFFER_SIZE) {
+            data_capacity = 2 * data_capacity + FILTER_BUFFER_SIZE;
+            char * grown = realloc(data, data_capacity);
+            if (NULL == grown) {
+                fprintf(stderr, "tail: out of memory\n");
+                status = 1;
+                break;
+            }
+            data = grown;
+        }
+        ssize_t n = filter_read(filter, fd, filter->files[0],
+                                &data[data_sz], FILTER_BUFFER_SIZE);
+        if (n <= 0) {
+            status = (n < 0);
+            break;
+        }
+        data_sz += n;
+    }
+    filter_close(filter, fd);
+    if (0 == status) {
+        size_t start = filter_tail_start(filter, data, data_sz);
+        status = filter_write(filter, filter->output, &data[start], data_sz - start) ? 0 : 1;
+    }
+    free(data);
+    return status;
+}
+
+static int filter_run_wc(filter_t * filter)
+{
+    unsigned long long lines = 0;
+    unsigned long long bytes = 0;
+    while (1) {
+        ssize_t n = filter_read(filter, filter->input, NULL,
+                                filter->buffer, FILTER_BUFFER_SIZE);
+        if (n < 0) {
+            return 1;
+        } else if (0 == n) {
+            break;
+        }
+        bytes += n;
+        if (filter->wc_lines) {
+            const char * p = filter->buffer;
+            const char * end = &filter->buffer[n];
+            while (NULL != (p = memchr(p, '\n', end - p))) {
+                lines++;
+                p++;
+            }
+        }
+    }
+    char line[64];
+    int line_sz;
+    if (filter->wc_lines && filter->wc_bytes) {
+        line_sz = snprintf(line, sizeof(line), "%7llu %7llu\n", lines, bytes);
+    } else {
+        line_sz = snprintf(line, sizeof(line), "%llu\n",
+                           filter->wc_lines ? lines : bytes);
+    }
+    return filter_write(filter, filter->output, line, line_sz) ? 0 : 1;
+}
+
+static int filter_run_tee(filter_t * filter)
+{
+    int status = 0;
+    int * fds = malloc((filter->files_sz + 1) * sizeof(int));
+    if (NULL == fds) {
+        fprintf(stderr, "tee: out of memory\n");
+        return 1;
+    }
+    int flags = O_WRONLY | O_CREAT | O_CLOEXEC | (filter->append ? O_APPEND : O_TRUNC);
+    for (size_t i = 0; i < filter->files_sz; ++i) {
+        fds[i] = open(filter->files[i], flags, 0666);
+        if (fds[i] < 0) {
+            fprintf(stderr, "tee: %s: %s\n", filter->files[i], strerror(errno));
+            status = 1;
+        }
+    }
+    while (1) {
+        ssize_t n = filter_read(filter, filter->input, NULL,
+                                filter->buffer, FILTER_BUFFER_SIZE);
+        if (n <= 0) {
+            status |= (n < 0);
+            break;
+        }
+        // Like tee, stop altogether once nothing reads the output.
+        if (!filter_write(filter, filter->output, filter->buffer, n)) {
+            status = 1;
+            break;
+        }
+        for (size_t i = 0; i < filter->files_sz; ++i) {
+            if (fds[i] >= 0 && !filter_write(filter, fds[i], filter->buffer, n)) {
+                fprintf(stderr, "tee: %s: %s\n", filter->files[i], strerror(errno));
+                close(fds[i]);
+                fds[i] = -1;
+                status = 1;
+            }
+        }
+    }
+    for (size_t i = 0; i < filter->files_sz; ++i) {
+        if (fds[i] >= 0) {
+            close(fds[i]);
+        }
+    }
+    free(fds);
+    return status;
+}
+
+/**
+ * Parses a count made of digits only, returning a boolean indicating
+ * whether text was one.
+ */
+static int filter_parse_count(const char * text,
+                              unsigned long long * count)
+{
+    if ('\0' == *text) {
+        return 0;
+    }
+    unsigned long long value = 0;
+    for (const char * c = text; '\0' != *c; ++c) {
+        if (*c < '0' || *c > '9' || value > (~0ULL - 9) / 10) {
+            return 0;
+        }
+        value = value * 10 + (*c - '0');
+    }
+    *count = value;
+    return 1;
+}
+
+/**
+ * Opens path for reading, or returns the input if path is NULL. Returns -1,
+ * having reported why, if the file cannot be opened. A FIFO would block the
+ * open until it has a writer, so the file is opened without blocking and
+ * the wait is left to the reads, which can be cancelled.
+ */
+static int filter_open(filter_t * filter,
+                       const char * path)
+{
+    if (NULL == path) {
+        return filter->input;
+    }
+    int fd = open(path, O_RDONLY | O_CLOEXEC | O_NONBLOCK);
+    if (fd < 0) {
+        fprintf(stderr, "%s: %s: %s\n", filter->kind->name, path, strerror(errno));
+        return -1;
+    }
+    fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) & ~O_NONBLOCK);
+    return fd;
+}
+
+/**
+ * Closes fd, be it a file or the input, which is then not closed again.
+ */
+static void filter_close(filter_t * filter,
+                         int fd)
+{
+    if (fd < 0) {
+        return;
+    }
+    if (fd == filter->input) {
+        filter->input = -1;
+    }
+    close(fd);
+}
+
+/**
+ * Waits until fd is ready for events or the filter is cancelled, returning
+ * 0 in the latter case. A pipe, FIFO or terminal can keep a read or write
+ * waiting for ever, so nothing blocks without going through here first.
+ * Should poll itself fail, the call that follows reports the problem.
+ */
+static int filter_wait(filter_t * filter,
+                       int fd,
+                       short events)
+{
+    struct pollfd fds[2] = {
+        { .fd = fd, .events = events },
+        { .fd = filter->cancel, .events = POLLIN }
+    };
+    while (poll(fds, 2, -1) < 0) {
+        if (EINTR != errno) {
+            return 1;
+        }
+    }
+    return 0 == fds[1].revents;
+}
+
+/**
+ * Reads what is available from fd, up to size bytes, returning how many
+ * were read, 0 at end of file, or -1, having reported why, on error or once
+ * the filter has been cancelled.
+ */
+static ssize_t filter_read(filter_t * filter,
+                           int fd,
+                           const char * path,
+                           char * buffer,
+                           size_t size)
+{
+    while (1) {
+        if (!filter_wait(filter, fd, POLLIN)) {
+            return -1;
+        }
+        ssize_t n = read(fd, buffer, size);
+        if (n >= 0) {
+            return n;
+        } else if (EINTR != errno) {
+            fprintf(stderr, "%s: %s: %s\n", filter->kind->name,
+                    (NULL == path) ? "-" : path, strerror(errno));
+            return -1;
+        }
+    }
+}
+
+/**
+ * Writes all of buffer to fd, returning a boolean indicating success, which
+ * is false once the filter has been cancelled. A broken pipe is not
+ * reported, as it only means that nothing reads any more.
+ */
+static int filter_write(filter_t * filter,
+                        int fd,
+                        const char * buffer,
+                        size_t size)
+{
+    return filter_wait(filter, fd, POLLOUT) && io_write_all(fd, buffer, size);
+}
+
+/**
+ * Copies fd to the output until end of file, or up to limit bytes if it is
+ * not 0. Moves the data with splice when either end is a pipe, without
+ * blocking on the pipes so that a cancel is seen while they are idle, and
+ * falls back to reading and writing when the kernel declines. Returns 1 once
+ * done, 0 if fd could not be read and -1 if the output could not be
+ * written or the filter has been cancelled.
+ */
+static int filter_copy(filter_t * filter,
+                       int fd,
+                       const char * path,
+                       unsigned long long limit)
+{
+    int can_splice = 1;
+    while (1) {
+        size_t want = FILTER_BUFFER_SIZE;
+        if (0 != limit && limit < want) {
+            want = limit;
+        }
+        ssize_t n;
+        if (can_splice) {
+            if (!filter_wait(filter, fd, POLLIN) ||
+                    !filter_wait(filter, filter->output, POLLOUT)) {
+                return -1;
+            }
+            n = splice(fd, NULL, filter->output, NULL, want,
+                       SPLICE_F_MOVE | SPLICE_F_NONBLOCK);
+            if (n < 0) {
+                if (EINTR == errno || EAGAIN == errno) {
+                    continue;
+                } else if (EPIPE == errno) {
+                    return -1;
+                }
+                // Neither end is a pipe, or one is not fit for splicing;
+                // any error that remains shows up again below.
+                can_splice = 0;
+                continue;
+            }
+        } else {
+            n = filter_read(filter, fd, path, filter->buffer, want);
+            if (n < 0) {
+                return 0;
+            } else if (!filter_write(filter, filter->output, filter->buffer, n)) {
+                return -1;
+            }
+        }
+        if (0 == n) {
+            return 1;
+        }
+        if (0 != limit) {
+            limit -= n;
+            if (0 == limit) {
+                return 1;
+            }
+        }
+    }
+}
+
+/**
+ * Returns where the tail of data starts: its last count bytes or lines. A
+ * final line without a newline counts as a line.
+ */
+static size_t filter_tail_start(filter_t * filter,
+                                const char * data,
+                                size_t data_sz)
+{
+    if (filter->bytes) {
+        return (data_sz > filter->count) ? data_sz - filter->count : 0;
+    }
+    unsigned long long lines = filter->count;
+    if (0 == lines) {
+        return data_sz;
+    }
+    size_t i = data_sz;
+    if (i > 0 && '\n' == data[i - 1]) {
+        i--;
+    }
+    for (; i > 0; --i) {
+        if ('\n' == data[i - 1] && 0 == --lines) {
+            return i;
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,57 @@
+#ifndef FILTER_H_
+#define FILTER_H_
+
+/**
+ * Bytes copied at a time when a filter cannot splice.
+ */
+#define FILTER_BUFFER_SIZE 65536
+
+/**
+ * A built-in streaming filter: one of cat, head, tail, wc and tee, with the
+ * options it supports, run on a thread of the shell instead of in a process
+ * of its own. It reads its input and files named by its arguments, and
+ * writes what the external command would have written to its standard
+ * output; errors go to the shell's stderr.
+ */
+typedef struct filter_t filter_t;
+
+/**
+ * Returns a filter that does what argv would do, or NULL if argv[0] does not
+ * name a built-in filter or asks for something it does not support, in
+ * which case the real command should be run instead.
+ */
+filter_t * filter_new(char * const argv[]);
+void filter_delete(filter_t * filter);
+
+/**
+ * Returns a boolean indicating whether the filter reads its input, as
+ * opposed to only files named by its arguments.
+ */
+int filter_uses_input(filter_t * filter);
+
+/**
+ * Starts the filter on a thread of its own, reading input and writing
+ * output. The thread takes both descriptors over and closes them as soon as
+ * it is done, so that the stages around it see end of file or a broken pipe
+ * in good time, and then writes a zero byte to notify, unless it is -1.
+ * Returns 0, and leaves the descriptors to the caller, if the thread cannot
+ * be started.
+ */
+int filter_start(filter_t * filter,
+                 int input,
+                 int output,
+                 int notify);
+
+/**
+ * Has a started filter stop as if its output had gone away, at once even if
+ * it is waiting for input that may never come or for room to write.
+ */
+void filter_cancel(filter_t * filter);
+
+/**
+ * Waits for a started filter to finish, deletes it and returns its exit
+ * status.
+ */
+int filter_join(filter_t * filter);
+
+#endif
@@ -0,0 +1,138 @@
+#include <stdlib.h>
+#include <string.h>
+#include "gapbuf.h"
+
+struct gapbuf_t {
+    char * data;
+    size_t capacity;
+    /**
+     * The gap occupies [gap_start, gap_end) of data. Content before the gap
+     * is at the same offsets as in the logical text; content after it is
+     * shifted by the size of the gap.
+     */
+    size_t gap_start;
+    size_t gap_end;
+};
+
+static void gapbuf_move(gapbuf_t * gapbuf,
+                        size_t pos);
+static void gapbuf_reserve(gapbuf_t * gapbuf,
+                           size_t sz);
+
+gapbuf_t * gapbuf_new(size_t capacity)
+{
+    gapbuf_t * gapbuf = malloc(sizeof(gapbuf_t));
+    gapbuf->capacity = (capacity > 0) ? capacity : 1;
+    gapbuf->data = malloc(gapbuf->capacity);
+    gapbuf->gap_start = 0;
+    gapbuf->gap_end = gapbuf->capacity;
+    return gapbuf;
+}
+
+void gapbuf_delete(gapbuf_t * gapbuf)
+{
+    free(gapbuf->data);
+    free(gapbuf);
+}
+
+size_t gapbuf_length(const gapbuf_t * gapbuf)
+{
+    return gapbuf->capacity - (gapbuf->gap_end - gapbuf->gap_start);
+}
+
+void gapbuf_clear(gapbuf_t * gapbuf)
+{
+    gapbuf->gap_start = 0;
+    gapbuf->gap_end = gapbuf->capacity;
+}
+
+void gapbuf_insert(gapbuf_t * gapbuf,
+                   size_t pos,
+                   const char * data,
+                   size_t data_sz)
+{
+    gapbuf_reserve(gapbuf, data_sz);
+    gapbuf_move(gapbuf, pos);
+    memcpy(gapbuf->data + gapbuf->gap_start, data, data_sz);
+    gapbuf->gap_start += data_sz;
+}
+
+void gapbuf_erase(gapbuf_t * gapbuf,
+                  size_t pos,
+                  size_t sz)
+{
+    gapbuf_move(gapbuf, pos);
+    gapbuf->gap_end += sz;
+}
+
+char gapbuf_at(const gapbuf_t * gapbuf,
+               size_t pos)
+{
+    if (pos < gapbuf->gap_start) {
+        return gapbuf->data[pos];
+    } else {
+        return gapbuf->data[pos + gapbuf->gap_end - gapbuf->gap_start];
+    }
+}
+
+size_t gapbuf_read(const gapbuf_t * gapbuf,
+                   size_t pos,
+                   const char ** data)
+{
+    if (pos < gapbuf->gap_start) {
+        *data = gapbuf->data + pos;
+        return gapbuf->gap_start - pos;
+    }
+    size_t physical = pos + gapbuf->gap_end - gapbuf->gap_start;
+    *data = gapbuf->data + physical;
+    return (physical < gapbuf->capacity) ? gapbuf->capacity - physical : 0;
+}
+
+const char * gapbuf_str(gapbuf_t * gapbuf)
+{
+    gapbuf_reserve(gapbuf, 1);
+    gapbuf_move(gapbuf, gapbuf_length(gapbuf));
+    gapbuf->data[gapbuf->gap_start] = '\0';
+    return gapbuf->data;
+}
+
+/**
+ * Moves the gap so that it starts at byte offset pos.
+ */
+static void gapbuf_move(gapbuf_t * gapbuf,
+                        size_t pos)
+{
+    size_t gap_sz = gapbuf->gap_end - gapbuf->gap_start;
+    if (pos < gapbuf->gap_start) {
+        size_t moved = gapbuf->gap_start - pos;
+        memmove(gapbuf->data + pos + gap_sz, gapbuf->data + pos, moved);
+    } else if (pos > gapbuf->gap_start) {
+        size_t moved = pos - gapbuf->gap_start;
+        memmove(gapbuf->data + gapbuf->gap_start, gapbuf->data + gapbuf->gap_end,
+                moved);
+    }
+    gapbuf->gap_start = pos;
+    gapbuf->gap_end = pos + gap_sz;
+}
+
+/**
+ * Grows the buffer, at least doubling it, until the gap holds sz bytes.
+ */
+static void gapbuf_reserve(gapbuf_t * gapbuf,
+                           size_t sz)
+{
+    size_t gap_sz = gapbuf->gap_end - gapbuf->gap_start;
+    if (gap_sz >= sz) {
+        return;
+    }
+    size_t capacity = 2 * gapbuf->capacity;
+    if (capacity < gapbuf->capacity - gap_sz + sz) {
+        capacity = gapbuf->capacity - gap_sz + sz;
+    }
+    gapbuf->data = realloc(gapbuf->data, capacity);
+    size_t tail_sz = gapbuf->capacity - gapbuf->gap_end;
+    memmove(gapbuf->data + capacity - tail_sz, gapbuf->data + gapbuf->gap_end,
+            tail_sz);
+    gapbuf->gap_end = capacity - tail_sz;
+    gapbuf->capacity = capacity;
+}
@@ -0,0 +1,59 @@
+#ifndef GAPBUF_H_
+#define GAPBUF_H_
+
+#include <stdlib.h>
+
+/**
+ * A growable byte buffer with a movable gap, suited to text that is edited
+ * at a cursor. Inserting or erasing at the gap is amortized O(1); moving the
+ * gap costs as many bytes as it moves.
+ */
+typedef struct gapbuf_t gapbuf_t;
+
+gapbuf_t * gapbuf_new(size_t capacity);
+void gapbuf_delete(gapbuf_t * gapbuf);
+
+/**
+ * Returns the number of bytes of content, not counting the gap.
+ */
+size_t gapbuf_length(const gapbuf_t * gapbuf);
+
+void gapbuf_clear(gapbuf_t * gapbuf);
+
+/**
+ * Inserts data_sz bytes of data before byte offset pos.
+ */
+void gapbuf_insert(gapbuf_t * gapbuf,
+                   size_t pos,
+                   const char * data,
+                   size_t data_sz);
+
+/**
+ * Removes sz bytes starting at byte offset pos.
+ */
+void gapbuf_erase(gapbuf_t * gapbuf,
+                  size_t pos,
+                  size_t sz);
+
+/**
+ * Returns the byte at offset pos, which must be less than the length.
+ */
+char gapbuf_at(const gapbuf_t * gapbuf,
+               size_t pos);
+
+/**
+ * Points data at the byte at offset pos and returns how many bytes of
+ * content follow it contiguously, without moving the gap. Returns 0 at the
+ * end of the content.
+ */
+size_t gapbuf_read(const gapbuf_t * gapbuf,
+                   size_t pos,
+                   const char ** data);
+
+/**
+ * Returns the content as a contiguous, null terminated string by moving the
+ * gap to the end. The string is valid until the buffer is next modified.
+ */
+const char * gapbuf_str(gapbuf_t * gapbuf);
+
+#endif
@@ -0,0 +1,137 @@
+#include "hash.h"
+#include <string.h>
+
+static const uint32_t k[64] = {
+    0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1,
+    0x923f82a4, 0xab1c5ed5, 0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3,
+    0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174, 0xe49b69c1, 0xefbe4786,
+    0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+    0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147,
+    0x06ca6351, 0x14292967, 0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13,
+    0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85, 0xa2bfe8a1, 0xa81a664b,
+    0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+    0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a,
+    0x5b9cca4f, 0x682e6ff3, 0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208,
+    0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2
+};
+
+#define ROTR(x, n) (((x) >> (n)) | ((x) << (32 - (n))))
+
+static void hash_compress(hash_t * hash,
+                          const unsigned char * block);
+
+void hash_init(hash_t * hash)
+{
+    static const uint32_t initial[8] = {
+        0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a,
+        0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19
+    };
+    memcpy(hash->state, initial, sizeof(initial));
+    hash->length = 0;
+    hash->block_sz = 0;
+}
+
+void hash_update(hash_t * hash,
+                 const void * data,
+                 size_t data_sz)
+{
+    const unsigned char * bytes = data;
+    hash->length += data_sz;
+    // Top off a partially filled block first.
+    if (hash->block_sz > 0) {
+        size_t take = 64 - hash->block_sz;
+        if (take > data_sz) {
+            take = data_sz;
+        }
+        memcpy(hash->block + hash->block_sz, bytes, take);
+        hash->block_sz += take;
+        bytes += take;
+        data_sz -= take;
+        if (64 == hash->block_sz) {
+            hash_compress(hash, hash->block);
+            hash->block_sz = 0;
+        }
+    }
+    // Whole blocks are compressed straight out of the caller's buffer.
+    while (data_sz >= 64) {
+        hash_compress(hash, bytes);
+        bytes += 64;
+        data_sz -= 64;
+    }
+    memcpy(hash->block + hash->block_sz, bytes, data_sz);
+    hash->block_sz += data_sz;
+}
+
+void hash_final(hash_t * hash,
+                unsigned char * digest)
+{
+    uint64_t bits = hash->length * 8;
+    unsigned char pad[72] = { 0x80 };
+    size_t pad_sz = (hash->block_sz < 56) ? 56 - hash->block_sz
+                                          : 120 - hash->block_sz;
+    for (unsigned int i = 0; i < 8; ++i) {
+        pad[pad_sz + i] = (unsigned char) (bits >> (56 - 8 * i));
+    }
+    hash_update(hash, pad, pad_sz + 8);
+    for (unsigned int i = 0; i < 8; ++i) {
+        digest[4 * i] = (unsigned char) (hash->state[i] >> 24);
+        digest[4 * i + 1] = (unsigned char) (hash->state[i] >> 16);
+        digest[4 * i + 2] = (unsigned char) (hash->state[i] >> 8);
+        digest[4 * i + 3] = (unsigned char) hash->state[i];
+    }
+}
+
+void hash_hex(const unsigned char * digest,
+              char * hex)
+{
+    static const char digits[] = "0123456789abcdef";
+    for (unsigned int i = 0; i < HASH_SIZE; ++i) {
+        hex[2 * i] = digits[digest[i] >> 4];
+        hex[2 * i + 1] = digits[digest[i] & 0x0F];
+    }
+    hex[HASH_HEX_SIZE] = '\0';
+}
+
+static void hash_compress(hash_t * hash,
+                          const unsigned char * block)
+{
+    uint32_t w[64];
+    for (unsigned int i = 0; i < 16; ++i) {
+        w[i] = ((uint32_t) block[4 * i] << 24) |
+               ((uint32_t) block[4 * i + 1] << 16) |
+               ((uint32_t) block[4 * i + 2] << 8) |
+               (uint32_t) block[4 * i + 3];
+    }
+    for (unsigned int i = 16; i < 64; ++i) {
+        uint32_t s0 = ROTR(w[i - 15], 7) ^ ROTR(w[i - 15], 18) ^ (w[i - 15] >> 3);
+        uint32_t s1 = ROTR(w[i - 2], 17) ^ ROTR(w[i - 2], 19) ^ (w[i - 2] >> 10);
+        w[i] = w[i - 16] + s0 + w[i - 7] + s1;
+    }
+    uint32_t a = hash->state[0], b = hash->state[1], c = hash->state[2],
+             d = hash->state[3], e = hash->state[4], f = hash->state[5],
+             g = hash->state[6], h = hash->state[7];
+    for (unsigned int i = 0; i < 64; ++i) {
+        uint32_t s1 = ROTR(e, 6) ^ ROTR(e, 11) ^ ROTR(e, 25);
+        uint32_t ch = (e & f) ^ (~e & g);
+        uint32_t t1 = h + s1 + ch + k[i] + w[i];
+        uint32_t s0 = ROTR(a, 2) ^ ROTR(a, 13) ^ ROTR(a, 22);
+        uint32_t maj = (a & b) ^ (a & c) ^ (b & c);
+        uint32_t t2 = s0 + maj;
+        h = g;
+        g = f;
+        f = e;
+        e = d + t1;
+        d = c;
+        c = b;
+        b = a;
+        a = t1 + t2;
+    }
+    hash->state[0] += a;
+    hash->state[1] += b;
+    hash->state[2] += c;
+    hash->state[3] += d;
+    hash->state[4] += e;
+    hash->state[5] += f;
+    hash->state[6] += g;
+    hash->state[7] += h;
+}
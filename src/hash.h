@@ -0,0 +1,38 @@
+#ifndef HASH_H_
+#define HASH_H_
+
+#include <stdint.h>
+#include <stdlib.h>
+
+/**
+ * Size in bytes of a digest, and of its hexadecimal representation (without
+ * the terminating null byte).
+ */
+#define HASH_SIZE 32
+#define HASH_HEX_SIZE (2 * HASH_SIZE)
+
+/**
+ * Incremental SHA-256 state. Used to key on-disk caches by content.
+ */
+typedef struct hash_t {
+    uint32_t state[8];
+    uint64_t length;
+    unsigned char block[64];
+    size_t block_sz;
+} hash_t;
+
+void hash_init(hash_t * hash);
+void hash_update(hash_t * hash,
+                 const void * data,
+                 size_t data_sz);
+void hash_final(hash_t * hash,
+                unsigned char * digest);
+
+/**
+ * Writes the hexadecimal form of digest into hex, which must hold at least
+ * HASH_HEX_SIZE + 1 bytes.
+ */
+void hash_hex(const unsigned char * digest,
+              char * hex);
+
+#endif
@@ -0,0 +1,307 @@
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include "highlight.h"
+#include "scanner.h"
+
+/**
+ * Bits of the state of the grammar. A STR is a command after the start of
+ * the line or an edge, a file descriptor inside an edge, and a file after an
+ * edge that ends in '@'.
+ */
+#define HIGHLIGHT_STATE_COMMAND 1
+#define HIGHLIGHT_STATE_EDGE 2
+#define HIGHLIGHT_STATE_DST 4
+#define HIGHLIGHT_STATE_AT 8
+#define HIGHLIGHT_STATE_FILE 16
+#define HIGHLIGHT_STATE_INITIAL HIGHLIGHT_STATE_COMMAND
+
+#define HIGHLIGHT_MEMO_CAPACITY (2 * HIGHLIGHT_MEMO_MAX)
+
+typedef struct highlight_memo_t {
+    char * name;
+    int known;
+} highlight_memo_t;
+
+typedef struct highlight_spans_t {
+    highlight_span_t * data;
+    size_t sz;
+    size_t capacity;
+} highlight_spans_t;
+
+struct highlight_t {
+    highlight_known_t known;
+    void * known_arg;
+    highlight_spans_t spans;
+    /**
+     * The length of the line the spans were made for.
+     */
+    size_t line_sz;
+    /**
+     * An open-addressing table of the names looked up so far.
+     */
+    highlight_memo_t * memo;
+    size_t memo_sz;
+};
+
+static int highlight_state_before(highlight_t * highlight,
+                                  size_t i);
+static highlight_style_t highlight_classify(highlight_t * highlight,
+                                            token_t * token,
+                                            int quoted,
+                                            int * state);
+static int highlight_known(highlight_t * highlight,
+                           const char * name);
+static void highlight_spans_add(highlight_spans_t * spans,
+                                const highlight_span_t * span);
+
+highlight_t * highlight_new(highlight_known_t known,
+                            void * arg)
+{
+    highlight_t * highlight = malloc(sizeof(highlight_t));
+    memset(highlight, 0, sizeof(highlight_t));
+    highlight->known = known;
+    highlight->known_arg = arg;
+    highlight->memo = calloc(HIGHLIGHT_MEMO_CAPACITY, sizeof(highlight_memo_t));
+    return highlight;
+}
+
+void highlight_delete(highlight_t * highlight)
+{
+    highlight_forget(highlight);
+    free(highlight->memo);
+    free(highlight->spans.data);
+    free(highlight);
+}
+
+size_t highlight_update(highlight_t * highlight,
+                        const char * line,
+                        size_t line_sz,
+                        const char * line_tail,
+                        size_t line_tail_sz,
+                        size_t start,
+                        size_t tail)
+{
+    size_t head_sz = line_sz;
+    line_sz += line_tail_sz;
+    highlight_span_t * spans = highlight->spans.data;
+    size_t spans_sz = highlight->spans.sz;
+    size_t old_sz = highlight->line_sz;
+    size_t shortest = (old_sz < line_sz) ? old_sz : line_sz;
+    if (start > shortest) {
+        start = shortest;
+    }
+    if (tail > shortest - start) {
+        tail = shortest - start;
+    }
+    size_t new_end = line_sz - tail;
+    // How far the unchanged tail has moved.
+    ptrdiff_t delta = (ptrdiff_t) line_sz - (ptrdiff_t) old_sz;
+
+    // Rescan from the token the edit touches, including one that ends right
+    // where the edit starts, since it may have grown.
+    size_t first = (0 == start) ? 0 : highlight_find(highlight, start - 1);
+    size_t resume = start;
+    if (first < spans_sz && spans[first].start < start) {
+        resume = spans[first].start;
+    }
+    int state = highlight_state_before(highlight, first);
+
+    highlight_spans_t fresh = { NULL, 0, 0 };
+    size_t rest = spans_sz;
+    size_t old = first;
+    scanner_t * scanner = scanner_view_split(line, head_sz, line_tail, line_tail_sz);
+    scanner_seek(scanner, resume);
+    token_t * token;
+    while (NULL != (token = scanner_next(scanner))) {
+        if (token->start >= new_end) {
+            // Past the edit the text is as it was, so once a token starts
+            // where an old one did, in the same state, the rest will match.
+            size_t old_start = (size_t) ((ptrdiff_t) token->start - delta);
+            while (old < spans_sz && spans[old].start < old_start) {
+                ++old;
+            }
+            if (old < spans_sz && spans[old].start == old_start &&
+                    highlight_state_before(highlight, old) == state) {
+                rest = old;
+                free(token);
+                break;
+            }
+        }
+        highlight_span_t span;
+        span.start = token->start;
+        span.end = token->end;
+        char first = (token->start < head_sz) ? line[token->start] :
+                                                line_tail[token->start - head_sz];
+        span.style = highlight_classify(highlight, token, '\'' == first, &state);
+        span.state = state;
+        highlight_spans_add(&fresh, &span);
+        free(token);
+    }
+    scanner_delete(scanner);
+
+    // The bytes before the edit are unchanged, so they only need showing
+    // again if the token they belong to is now styled differently.
+    size_t changed = start;
+    if (resume < start &&
+            (0 == fresh.sz || fresh.data[0].style != spans[first].style)) {
+        changed = resume;
+    }
+
+    size_t kept_sz = spans_sz - rest;
+    size_t total_sz = first + fresh.sz + kept_sz;
+    if (total_sz > highlight->spans.capacity) {
+        highlight->spans.capacity = total_sz;
+        highlight->spans.data = realloc(highlight->spans.data,
+                                        total_sz * sizeof(highlight_span_t));
+        spans = highlight->spans.data;
+    }
+    memmove(spans + first + fresh.sz, spans + rest, kept_sz * sizeof(highlight_span_t));
+    for (size_t i = first + fresh.sz; i < total_sz; ++i) {
+        spans[i].start += delta;
+        spans[i].end += delta;
+    }
+    if (fresh.sz > 0) {
+        memcpy(spans + first, fresh.data, fresh.sz * sizeof(highlight_span_t));
+    }
+    free(fresh.data);
+    highlight->spans.sz = total_sz;
+    highlight->line_sz = line_sz;
+    return changed;
+}
+
+void highlight_forget(highlight_t * highlight)
+{
+    for (size_t i = 0; i < HIGHLIGHT_MEMO_CAPACITY; ++i) {
+        free(highlight->memo[i].name);
+        highlight->memo[i].name = NULL;
+    }
+    highlight->memo_sz = 0;
+}
+
+size_t highlight_find(highlight_t * highlight,
+                      size_t offset)
+{
+    size_t low = 0;
+    size_t high = highlight->spans.sz;
+    while (low < high) {
+        size_t middle = low + (high - low) / 2;
+        if (highlight->spans.data[middle].end <= offset) {
+            low = middle + 1;
+        } else {
+            high = middle;
+        }
+    }
+    return low;
+}
+
+const highlight_span_t * highlight_spans(highlight_t * highlight,
+                                         size_t * spans_sz)
+{
+    *spans_sz = highlight->spans.sz;
+    return highlight->spans.data;
+}
+
+static int highlight_state_before(highlight_t * highlight,
+                                  size_t i)
+{
+    return (0 == i) ? HIGHLIGHT_STATE_INITIAL : highlight->spans.data[i - 1].state;
+}
+
+/**
+ * Returns the style of token, which is quoted if quoted is non-zero, and
+ * moves state past it.
+ */
+static highlight_style_t highlight_classify(highlight_t * highlight,
+                                            token_t * token,
+                                            int quoted,
+                                            int * state)
+{
+    switch (token->type) {
+        case TOKEN_TYPE_LT:
+            *state = HIGHLIGHT_STATE_EDGE;
+            return HIGHLIGHT_EDGE;
+
+        case TOKEN_TYPE_GT:
+            *state = HIGHLIGHT_STATE_COMMAND |
+                     ((*state & HIGHLIGHT_STATE_AT) ? HIGHLIGHT_STATE_FILE : 0);
+            return HIGHLIGHT_EDGE;
+
+        case TOKEN_TYPE_PIPE:
+            if (*state & HIGHLIGHT_STATE_EDGE) {
+                *state |= HIGHLIGHT_STATE_DST;
+            }
+            return HIGHLIGHT_PIPE;
+
+        case TOKEN_TYPE_AT:
+            if (*state & HIGHLIGHT_STATE_DST) {
+                *state = (*state & ~HIGHLIGHT_STATE_DST) | HIGHLIGHT_STATE_AT;
+            }
+            return HIGHLIGHT_AT;
+
+        case TOKEN_TYPE_STR:
+            break;
+    }
+    if (*state & HIGHLIGHT_STATE_EDGE) {
+        *state &= ~HIGHLIGHT_STATE_DST;
+        return HIGHLIGHT_FD;
+    }
+    if (*state & HIGHLIGHT_STATE_FILE) {
+        *state = 0;
+        return HIGHLIGHT_FILE;
+    }
+    if (*state & HIGHLIGHT_STATE_COMMAND) {
+        *state = 0;
+        switch (highlight_known(highlight, token->aux)) {
+            case 1:
+                return HIGHLIGHT_COMMAND;
+            case 0:
+                return HIGHLIGHT_UNKNOWN;
+            default:
+                return HIGHLIGHT_PLAIN;
+        }
+    }
+    return quoted ? HIGHLIGHT_QUOTED : HIGHLIGHT_PLAIN;
+}
+
+/**
+ * Looks name up through the memo, remembering all but unknown answers.
+ */
+static int highlight_known(highlight_t * highlight,
+                           const char * name)
+{
+    // FNV-1a.
+    uint32_t hash = 2166136261u;
+    for (const char * p = name; '\0' != *p; ++p) {
+        hash = (hash ^ (unsigned char) *p) * 16777619u;
+    }
+    size_t i = hash & (HIGHLIGHT_MEMO_CAPACITY - 1);
+    while (NULL != highlight->memo[i].name) {
+        if (0 == strcmp(highlight->memo[i].name, name)) {
+            return highlight->memo[i].known;
+        }
+        i = (i + 1) & (HIGHLIGHT_MEMO_CAPACITY - 1);
+    }
+    int known = highlight->known(highlight->known_arg, name);
+    if (known < 0) {
+        return known;
+    }
+    if (highlight->memo_sz >= HIGHLIGHT_MEMO_MAX) {
+        highlight_forget(highlight);
+        i = hash & (HIGHLIGHT_MEMO_CAPACITY - 1);
+    }
+    highlight->memo[i].name = strdup(name);
+    highlight->memo[i].known = known;
+    highlight->memo_sz++;
+    return known;
+}
+
+static void highlight_spans_add(highlight_spans_t * spans,
+                                const highlight_span_t * span)
+{
+    if (spans->sz == spans->capacity) {
+        spans->capacity = (0 == spans->capacity) ? 16 : 2 * spans->capacity;
+        spans->data = realloc(spans->data, spans->capacity * sizeof(highlight_span_t));
+    }
+    spans->data[spans->sz++] = *span;
+}
@@ -0,0 +1,100 @@
+#ifndef HIGHLIGHT_H_
+#define HIGHLIGHT_H_
+
+#include <stddef.h>
+
+/**
+ * Distinct command names whose lookups are remembered; the memory is
+ * cleared when it fills up.
+ */
+#define HIGHLIGHT_MEMO_MAX 1024
+
+typedef enum highlight_style_t {
+    HIGHLIGHT_PLAIN,
+    /**
+     * A command that was found, or one that was not.
+     */
+    HIGHLIGHT_COMMAND,
+    HIGHLIGHT_UNKNOWN,
+    HIGHLIGHT_QUOTED,
+    /**
+     * The '<' and '>' around the pipes of an edge, the pipes themselves, the
+     * file descriptors they connect and '@'.
+     */
+    HIGHLIGHT_EDGE,
+    HIGHLIGHT_PIPE,
+    HIGHLIGHT_FD,
+    HIGHLIGHT_AT,
+    /**
+     * The file an edge writes to through '@'.
+     */
+    HIGHLIGHT_FILE
+} highlight_style_t;
+
+/**
+ * The bytes of one token and how to show them.
+ */
+typedef struct highlight_span_t {
+    size_t start;
+    size_t end;
+    highlight_style_t style;
+    /**
+     * Where the grammar stands after the token.
+     */
+    int state;
+} highlight_span_t;
+
+/**
+ * Returns 1 if name is a command, 0 if it is not, or -1 if that is not known
+ * yet. Must not wait for anything.
+ */
+typedef int (* highlight_known_t)(void * arg,
+                                  const char * name);
+
+/**
+ * The highlighting of a line as it is edited. The line is split into spans
+ * by the scanner, and each edit only rescans from the token it touches up to
+ * the first token after it that starts where it used to and in the same
+ * state of the grammar; the spans from there on are kept as they were.
+ */
+typedef struct highlight_t highlight_t;
+
+highlight_t * highlight_new(highlight_known_t known,
+                            void * arg);
+void highlight_delete(highlight_t * highlight);
+
+/**
+ * Brings the spans in line with the line, which is given in two parts, as
+ * around the gap of a gap buffer: line_sz bytes at line followed by
+ * line_tail_sz bytes at line_tail. It must differ from the line last given
+ * only after its first start bytes and before its last tail bytes. Returns
+ * the offset of the first byte that may have to be shown differently.
+ */
+size_t highlight_update(highlight_t * highlight,
+                        const char * line,
+                        size_t line_sz,
+                        const char * line_tail,
+                        size_t line_tail_sz,
+                        size_t start,
+                        size_t tail);
+
+/**
+ * Forgets which names are commands, for when that may have changed. The
+ * spans are left as they are until the next update, which should cover the
+ * whole line.
+ */
+void highlight_forget(highlight_t * highlight);
+
+/**
+ * Returns the index of the first span that ends after byte offset offset.
+ */
+size_t highlight_find(highlight_t * highlight,
+                      size_t offset);
+
+/**
+ * Returns the spans, in order, and stores their number in spans_sz.
+ */
+const highlight_span_t * highlight_spans(highlight_t * highlight,
+                                         size_t * spans_sz);
+
+#endif
@@ -0,0 +1,806 @@
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "history.h"
+#include "io.h"
+
+/**
+ * The number of entries the prefix and trigram indexes may fall behind by
+ * before they are rebuilt.
+ */
+#define HISTORY_TAIL_MAX 4096
+
+typedef struct history_line_t {
+    size_t offset;
+    size_t length;
+} history_line_t;
+
+typedef struct history_lines_t {
+    history_line_t * data;
+    size_t sz;
+    size_t capacity;
+} history_lines_t;
+
+/**
+ * The entries containing one trigram, in increasing order.
+ */
+typedef struct history_postings_t {
+    uint32_t trigram;
+    uint32_t * ids;
+    uint32_t ids_sz;
+    uint32_t ids_capacity;
+} history_postings_t;
+
+/**
+ * The first entries of the history sorted by their text, along with a
+ * segment tree over that order giving the most recent entry of any range of
+ * it. The entries that start with a given prefix form one such range. An
+ * index has a mapping of its own of the part of the file it covers, which
+ * never changes underneath it since the file is only ever appended to.
+ */
+typedef struct history_prefix_t {
+    char * map;
+    size_t map_sz;
+    history_lines_t lines;
+    uint32_t * sorted;
+    uint32_t * tree;
+    /**
+     * The history_t generation the index was built for.
+     */
+    unsigned int generation;
+} history_prefix_t;
+
+/**
+ * A trigram index of the first covered entries of the history, as an open
+ * addressing hash table keyed by the trigram plus one (so that 0 marks an
+ * empty slot). Like a prefix index, it is built by a background thread from
+ * a mapping of its own, which is let go once the index is built.
+ */
+typedef struct history_trigrams_t {
+    history_postings_t * postings;
+    size_t postings_sz;
+    size_t postings_capacity;
+    size_t covered;
+    char * map;
+    size_t map_sz;
+    /**
+     * The history_t generation the index was built for.
+     */
+    unsigned int generation;
+} history_trigrams_t;
+
+struct history_t {
+    int fd;
+    /**
+     * The file, mapped up to the size it had at the last sync.
+     */
+    char * map;
+    size_t map_sz;
+    /**
+     * The offset just past the last complete line seen.
+     */
+    size_t parsed;
+    history_lines_t lines;
+    /**
+     * Bumped whenever the file is read from scratch, which makes prefix
+     * indexes built from earlier contents useless.
+     */
+    unsigned int generation;
+    /**
+     * The prefix index in use, if any, and the builder thread; a finished
+     * index is handed over in prefix_ready under lock.
+     */
+    history_prefix_t * prefix;
+    pthread_t builder;
+    int builder_started;
+    int building;
+    history_prefix_t * prefix_ready;
+    /**
+     * The same for the trigram index.
+     */
+    history_trigrams_t * trigrams;
+    pthread_t indexer;
+    int indexer_started;
+    int indexing;
+    history_trigrams_t * trigrams_ready;
+    pthread_mutex_t lock;
+};
+
+static char * history_default_path(void);
+static size_t history_parse(const char * map,
+                            size_t parsed,
+                            size_t map_sz,
+                            history_lines_t * lines);
+static int history_starts(const char * entry,
+                          size_t entry_sz,
+                          const char * prefix,
+                          size_t prefix_sz);
+static void history_prefix_build(history_t * history);
+static void * history_prefix_worker(void * arg);
+static int history_prefix_compare(const void * a,
+                                  const void * b,
+                                  void * arg);
+static size_t history_prefix_bound(history_prefix_t * prefix,
+                                   const char * text,
+                                   size_t text_sz,
+                                   int strict);
+static void history_prefix_delete(history_prefix_t * prefix);
+static void history_reset(history_t * history);
+static char * history_map_parsed(history_t * history);
+static void history_trigrams_build(history_t * history);
+static void * history_trigrams_worker(void * arg);
+static int history_index(history_trigrams_t * trigrams,
+                         const char * map,
+                         const history_lines_t * lines);
+static history_postings_t * history_postings(history_trigrams_t * trigrams,
+                                             uint32_t trigram,
+                                             int create);
+static void history_trigrams_delete(history_trigrams_t * trigrams);
+static size_t history_scan(history_t * history,
+                           const char * query,
+                           size_t query_sz,
+                           size_t from,
+                           size_t before);
+
+history_t * history_open(const char * path)
+{
+    char * default_path = NULL;
+    if (NULL == path) {
+        path = default_path = history_default_path();
+        if (NULL == path) {
+            return NULL;
+        }
+    }
+    int fd = open(path, O_RDWR | O_APPEND | O_CREAT | O_CLOEXEC, 0600);
+    free(default_path);
+    if (fd < 0) {
+        return NULL;
+    }
+    history_t * history = malloc(sizeof(history_t));
+    memset(history, 0, sizeof(history_t));
+    history->fd = fd;
+    pthread_mutex_init(&history->lock, NULL);
+    history_sync(history);
+    return history;
+}
+
+void history_close(history_t * history)
+{
+    if (history->builder_started) {
+        pthread_join(history->builder, NULL);
+    }
+    if (history->indexer_started) {
+        pthread_join(history->indexer, NULL);
+    }
+    if (NULL != history->prefix_ready) {
+        history_prefix_delete(history->prefix_ready);
+    }
+    if (NULL != history->trigrams_ready) {
+        history_trigrams_delete(history->trigrams_ready);
+    }
+    pthread_mutex_destroy(&history->lock);
+    history_reset(history);
+    free(history->lines.data);
+    close(history->fd);
+    free(history);
+}
+
+void history_sync(history_t * history)
+{
+    struct stat st;
+    if (0 != fstat(history->fd, &st)) {
+        return;
+    }
+    size_t file_sz = st.st_size;
+    if (file_sz < history->map_sz) {
+        // Somebody truncated the file: start over.
+        history_reset(history);
+    }
+    if (file_sz == history->map_sz) {
+        return;
+    }
+    if (NULL != history->map) {
+        munmap(history->map, history->map_sz);
+    }
+    history->map = mmap(NULL, file_sz, PROT_READ, MAP_SHARED, history->fd, 0);
+    if (MAP_FAILED == history->map) {
+        history->map = NULL;
+        history->map_sz = 0;
+        history_reset(history);
+        return;
+    }
+    history->map_sz = file_sz;
+    history->parsed = history_parse(history->map, history->parsed,
+                                    history->map_sz, &history->lines);
+}
+
+int history_add(history_t * history,
+                const char * line)
+{
+    size_t line_sz = strlen(line);
+    if (0 == line_sz) {
+        return 1;
+    }
+    history_sync(history);
+    if (history->lines.sz > 0) {
+        size_t last_sz;
+        const char * last = history_entry(history, history->lines.sz - 1,
+                                          &last_sz);
+        if (last_sz == line_sz && 0 == memcmp(last, line, line_sz)) {
+            return 1;
+        }
+    }
+    // The record must go out in a single write for O_APPEND to keep it in
+    // one piece.
+    char * record = malloc(line_sz + 1);
+    for (size_t i = 0; i < line_sz; ++i) {
+        record[i] = ('\n' == line[i]) ? ' ' : line[i];
+    }
+    record[line_sz] = '\n';
+    ssize_t n;
+    do {
+        n = write(history->fd, record, line_sz + 1);
+    } while (n < 0 && EINTR == errno);
+    free(record);
+    history_sync(history);
+    return n == (ssize_t) (line_sz + 1);
+}
+
+size_t history_count(history_t * history)
+{
+    return history->lines.sz;
+}
+
+const char * history_entry(history_t * history,
+                           size_t i,
+                           size_t * entry_sz)
+{
+    *entry_sz = history->lines.data[i].length;
+    return history->map + history->lines.data[i].offset;
+}
+
+size_t history_search(history_t * history,
+                      const char * query,
+                      size_t query_sz,
+                      size_t before)
+{
+    if (before > history->lines.sz) {
+        before = history->lines.sz;
+    }
+    if (query_sz < 3) {
+        return history_scan(history, query, query_sz, 0, before);
+    }
+    history_trigrams_build(history);
+    history_trigrams_t * trigrams = history->trigrams;
+    size_t covered = (NULL != trigrams) ? trigrams->covered : 0;
+    if (covered > before) {
+        covered = before;
+    }
+    // The entries the index does not cover are the most recent ones, and
+    // until the first index has been built that is all of them.
+    size_t found = history_scan(history, query, query_sz, covered, before);
+    if (HISTORY_NONE != found || 0 == covered) {
+        return found;
+    }
+    before = covered;
+    // Only entries containing every trigram of the query can match, so it is
+    // enough to check those containing its rarest one.
+    const history_postings_t * rarest = NULL;
+    for (size_t i = 0; i + 3 <= query_sz; ++i) {
+        const unsigned char * t = (const unsigned char *) query + i;
+        history_postings_t * postings =
+            history_postings(trigrams, (t[0] << 16) | (t[1] << 8) | t[2], 0);
+        if (NULL == postings) {
+            return HISTORY_NONE;
+        }
+        if (NULL == rarest || postings->ids_sz < rarest->ids_sz) {
+            rarest = postings;
+        }
+    }
+    // Find the last candidate before the before-th entry.
+    size_t low = 0;
+    size_t high = rarest->ids_sz;
+    while (low < high) {
+        size_t middle = low + (high - low) / 2;
+        if (rarest->ids[middle] < before) {
+            low = middle + 1;
+        } else {
+            high = middle;
+        }
+    }
+    while (low-- > 0) {
+        size_t entry_sz;
+        const char * entry = history_entry(history, rarest->ids[low], &entry_sz);
+        if (NULL != memmem(entry, entry_sz, query, query_sz)) {
+            return rarest->ids[low];
+        }
+    }
+    return HISTORY_NONE;
+}
+
+size_t history_suggest(history_t * history,
+                       const char * prefix,
+                       size_t prefix_sz)
+{
+    history_prefix_build(history);
+    // The entries the index does not cover are the most recent ones.
+    size_t covered = (NULL != history->prefix) ? history->prefix->lines.sz : 0;
+    for (size_t i = history->lines.sz; i-- > covered; ) {
+        size_t entry_sz;
+        const char * entry = history_entry(history, i, &entry_sz);
+        if (history_starts(entry, entry_sz, prefix, prefix_sz)) {
+            return i;
+        }
+    }
+    if (0 == covered) {
+        return HISTORY_NONE;
+    }
+    // Entries equal to the prefix sort first among those starting with it.
+    history_prefix_t * index = history->prefix;
+    size_t low = history_prefix_bound(index, prefix, prefix_sz, 1);
+    size_t high = history_prefix_bound(index, prefix, prefix_sz, 0);
+    size_t best = HISTORY_NONE;
+    size_t leaves = index->lines.sz;
+    for (low += leaves, high += leaves; low < high; low /= 2, high /= 2) {
+        if (low & 1) {
+            if (HISTORY_NONE == best || index->tree[low] > best) {
+                best = index->tree[low];
+            }
+            low++;
+        }
+        if (high & 1) {
+            high--;
+            if (HISTORY_NONE == best || index->tree[high] > best) {
+                best = index->tree[high];
+            }
+        }
+    }
+    return best;
+}
+
+/**
+ * Returns the path of the default history file, creating its directory if
+ * necessary, or NULL if there is nowhere to keep one.
+ */
+static char * history_default_path(void)
+{
+    const char * path = getenv("NEPHESH_HISTORY");
+    if (NULL != path && '\0' != path[0]) {
+        return strdup(path);
+    }
+    char base[4096];
+    if (!io_xdg_dir("XDG_DATA_HOME", ".local/share", "nephesh", base, sizeof(base))) {
+        return NULL;
+    }
+    strncat(base, "/history", sizeof(base) - strlen(base) - 1);
+    return strdup(base);
+}
+
+/**
+ * Appends the complete, non-empty lines of map from offset parsed onwards to
+ * lines. Returns the offset just past the last of them.
+ */
+static size_t history_parse(const char * map,
+                            size_t parsed,
+                            size_t map_sz,
+                            history_lines_t * lines)
+{
+    const char * end;
+    while (NULL != (end = memchr(map + parsed, '\n', map_sz - parsed))) {
+        size_t offset = parsed;
+        size_t length = end - (map + offset);
+        parsed = offset + length + 1;
+        if (0 == length) {
+            continue;
+        }
+        if (lines->sz == lines->capacity) {
+            lines->capacity = (0 == lines->capacity) ? 1024 : 2 * lines->capacity;
+            lines->data = realloc(lines->data, lines->capacity * sizeof(history_line_t));
+        }
+        lines->data[lines->sz].offset = offset;
+        lines->data[lines->sz].length = length;
+        lines->sz++;
+    }
+    return parsed;
+}
+
+static int history_starts(const char * entry,
+                          size_t entry_sz,
+                          const char * prefix,
+                          size_t prefix_sz)
+{
+    return entry_sz > prefix_sz && 0 == memcmp(entry, prefix, prefix_sz);
+}
+
+/**
+ * Takes over a freshly built prefix index, and starts building a new one if
+ * there is none yet or the one in use has fallen too far behind.
+ */
+static void history_prefix_build(history_t * history)
+{
+    pthread_mutex_lock(&history->lock);
+    history_prefix_t * ready = history->prefix_ready;
+    history->prefix_ready = NULL;
+    int building = history->building;
+    pthread_mutex_unlock(&history->lock);
+    if (NULL != ready) {
+        if (ready->generation == history->generation) {
+            if (NULL != history->prefix) {
+                history_prefix_delete(history->prefix);
+            }
+            history->prefix = ready;
+        } else {
+            history_prefix_delete(ready);
+        }
+    }
+    size_t covered = (NULL != history->prefix) ? history->prefix->lines.sz : 0;
+    size_t tail = history->lines.sz - covered;
+    if (building || 0 == tail || (0 != covered && tail <= HISTORY_TAIL_MAX)) {
+        return;
+    }
+    if (history->builder_started) {
+        pthread_join(history->builder, NULL);
+        history->builder_started = 0;
+    }
+    history_prefix_t * prefix = malloc(sizeof(history_prefix_t));
+    if (NULL == prefix) {
+        return;
+    }
+    memset(prefix, 0, sizeof(history_prefix_t));
+    prefix->map_sz = history->parsed;
+    prefix->generation = history->generation;
+    prefix->map = history_map_parsed(history);
+    if (NULL == prefix->map) {
+        free(prefix);
+        return;
+    }
+    history->building = 1;
+    void ** args = malloc(2 * sizeof(void *));
+    if (NULL != args) {
+        args[0] = history;
+        args[1] = prefix;
+    }
+    if (NULL == args ||
+            0 != pthread_create(&history->builder, NULL, history_prefix_worker, args)) {
+        history->building = 0;
+        free(args);
+        history_prefix_delete(prefix);
+        return;
+    }
+    history->builder_started = 1;
+}
+
+static void * history_prefix_worker(void * arg)
+{
+    history_t * history = ((void **) arg)[0];
+    history_prefix_t * prefix = ((void **) arg)[1];
+    free(arg);
+    history_parse(prefix->map, 0, prefix->map_sz, &prefix->lines);
+    size_t n = prefix->lines.sz;
+    prefix->sorted = malloc((n + 1) * sizeof(uint32_t));
+    prefix->tree = malloc((2 * n + 1) * sizeof(uint32_t));
+    if (NULL == prefix->sorted || NULL == prefix->tree) {
+        // Out of memory: suggestions go on checking every entry.
+        history_prefix_delete(prefix);
+        pthread_mutex_lock(&history->lock);
+        history->building = 0;
+        pthread_mutex_unlock(&history->lock);
+        return NULL;
+    }
+    for (size_t i = 0; i < n; ++i) {
+        prefix->sorted[i] = i;
+    }
+    qsort_r(prefix->sorted, n, sizeof(uint32_t), history_prefix_compare, prefix);
+    for (size_t i = 0; i < n; ++i) {
+        prefix->tree[n + i] = prefix->sorted[i];
+    }
+    for (size_t i = n; i-- > 1; ) {
+        uint32_t left = prefix->tree[2 * i];
+        uint32_t right = prefix->tree[2 * i + 1];
+        prefix->tree[i] = (left > right) ? left : right;
+    }
+    pthread_mutex_lock(&history->lock);
+    history->prefix_ready = prefix;
+    history->building = 0;
+    pthread_mutex_unlock(&history->lock);
+    return NULL;
+}
+
+/**
+ * Orders entries by their text, with the older of equal entries first.
+ */
+static int history_prefix_compare(const void * a,
+                                  const void * b,
+                                  void * arg)
+{
+    const history_prefix_t * prefix = arg;
+    uint32_t id_a = *(const uint32_t *) a;
+    uint32_t id_b = *(const uint32_t *) b;
+    const history_line_t * line_a = &prefix->lines.data[id_a];
+    const history_line_t * line_b = &prefix->lines.data[id_b];
+    size_t sz = (line_a->length < line_b->length) ? line_a->length : line_b->length;
+    int order = memcmp(prefix->map + line_a->offset, prefix->map + line_b->offset, sz);
+    if (0 != order) {
+        return order;
+    }
+    if (line_a->length != line_b->length) {
+        return (line_a->length < line_b->length) ? -1 : 1;
+    }
+    return (id_a < id_b) ? -1 : (id_a > id_b);
+}
+
+/**
+ * Returns the position in sorted order of the first entry that does not
+ * start with text and sorts after it or, if strict, the first entry that
+ * sorts after text itself.
+ */
+static size_t history_prefix_bound(history_prefix_t * prefix,
+                                   const char * text,
+                                   size_t text_sz,
+                                   int strict)
+{
+    size_t low = 0;
+    size_t high = prefix->lines.sz;
+    while (low < high) {
+        size_t middle = low + (high - low) / 2;
+        const history_line_t * line = &prefix->lines.data[prefix->sorted[middle]];
+        size_t sz = (line->length < text_sz) ? line->length : text_sz;
+        int order = memcmp(prefix->map + line->offset, text, sz);
+        if (0 == order && line->length < text_sz) {
+            order = -1;
+        } else if (0 == order && strict && line->length > text_sz) {
+            order = 1;
+        }
+        if (order <= 0) {
+            low = middle + 1;
+        } else {
+            high = middle;
+        }
+    }
+    return low;
+}
+
+static void history_prefix_delete(history_prefix_t * prefix)
+{
+    munmap(prefix->map, prefix->map_sz);
+    free(prefix->lines.data);
+    free(prefix->sorted);
+    free(prefix->tree);
+    free(prefix);
+}
+
+/**
+ * Forgets everything read from the file.
+ */
+static void history_reset(history_t * history)
+{
+    if (NULL != history->map) {
+        munmap(history->map, history->map_sz);
+    }
+    history->map = NULL;
+    history->map_sz = 0;
+    history->parsed = 0;
+    history->lines.sz = 0;
+    if (NULL != history->prefix) {
+        history_prefix_delete(history->prefix);
+        history->prefix = NULL;
+    }
+    if (NULL != history->trigrams) {
+        history_trigrams_delete(history->trigrams);
+        history->trigrams = NULL;
+    }
+    history->generation++;
+}
+
+/**
+ * Returns a mapping of the part of the file parsed so far, for an index of
+ * its own, or NULL.
+ */
+static char * history_map_parsed(history_t * history)
+{
+    char * map = mmap(NULL, history->parsed, PROT_READ, MAP_SHARED, history->fd, 0);
+    return (MAP_FAILED == map) ? NULL : map;
+}
+
+/**
+ * Takes over a freshly built trigram index, and starts building a new one if
+ * there is none yet or the one in use has fallen too far behind.
+ */
+static void history_trigrams_build(history_t * history)
+{
+    pthread_mutex_lock(&history->lock);
+    history_trigrams_t * ready = history->trigrams_ready;
+    history->trigrams_ready = NULL;
+    int indexing = history->indexing;
+    pthread_mutex_unlock(&history->lock);
+    if (NULL != ready) {
+        if (ready->generation == history->generation) {
+            if (NULL != history->trigrams) {
+                history_trigrams_delete(history->trigrams);
+            }
+            history->trigrams = ready;
+        } else {
+            history_trigrams_delete(ready);
+        }
+    }
+    size_t covered = (NULL != history->trigrams) ? history->trigrams->covered : 0;
+    size_t tail = history->lines.sz - covered;
+    if (indexing || 0 == tail || (0 != covered && tail <= HISTORY_TAIL_MAX)) {
+        return;
+    }
+    if (history->indexer_started) {
+        pthread_join(history->indexer, NULL);
+        history->indexer_started = 0;
+    }
+    history_trigrams_t * trigrams = calloc(1, sizeof(history_trigrams_t));
+    if (NULL == trigrams) {
+        return;
+    }
+    trigrams->map_sz = history->parsed;
+    trigrams->generation = history->generation;
+    trigrams->map = history_map_parsed(history);
+    if (NULL == trigrams->map) {
+        free(trigrams);
+        return;
+    }
+    history->indexing = 1;
+    void ** args = malloc(2 * sizeof(void *));
+    if (NULL != args) {
+        args[0] = history;
+        args[1] = trigrams;
+    }
+    if (NULL == args ||
+            0 != pthread_create(&history->indexer, NULL, history_trigrams_worker, args)) {
+        history->indexing = 0;
+        free(args);
+        history_trigrams_delete(trigrams);
+        return;
+    }
+    history->indexer_started = 1;
+}
+
+static void * history_trigrams_worker(void * arg)
+{
+    history_t * history = ((void **) arg)[0];
+    history_trigrams_t * trigrams = ((void **) arg)[1];
+    free(arg);
+    history_lines_t lines = { NULL, 0, 0 };
+    history_parse(trigrams->map, 0, trigrams->map_sz, &lines);
+    int built = history_index(trigrams, trigrams->map, &lines);
+    free(lines.data);
+    munmap(trigrams->map, trigrams->map_sz);
+    trigrams->map = NULL;
+    if (!built) {
+        // Out of memory: searches go on checking every entry.
+        history_trigrams_delete(trigrams);
+        trigrams = NULL;
+    }
+    pthread_mutex_lock(&history->lock);
+    history->trigrams_ready = trigrams;
+    history->indexing = 0;
+    pthread_mutex_unlock(&history->lock);
+    return NULL;
+}
+
+/**
+ * Adds the trigrams of lines, which are found in map, to the index. Returns
+ * 0 if it runs out of memory.
+ */
+static int history_index(history_trigrams_t * trigrams,
+                         const char * map,
+                         const history_lines_t * lines)
+{
+    for (uint32_t id = 0; id < lines->sz; ++id) {
+        size_t entry_sz = lines->data[id].length;
+        const unsigned char * entry = (const unsigned char *) map + lines->data[id].offset;
+        for (size_t i = 0; i + 3 <= entry_sz; ++i) {
+            history_postings_t * postings = history_postings(trigrams,
+                (entry[i] << 16) | (entry[i + 1] << 8) | entry[i + 2], 1);
+            if (NULL == postings) {
+                return 0;
+            }
+            // An entry is listed once however often the trigram occurs.
+            if (postings->ids_sz > 0 && id == postings->ids[postings->ids_sz - 1]) {
+                continue;
+            }
+            if (postings->ids_sz == postings->ids_capacity) {
+                uint32_t capacity = (0 == postings->ids_capacity)
+                                    ? 4 : 2 * postings->ids_capacity;
+                uint32_t * ids = realloc(postings->ids, capacity * sizeof(uint32_t));
+                if (NULL == ids) {
+                    return 0;
+                }
+                postings->ids = ids;
+                postings->ids_capacity = capacity;
+            }
+            postings->ids[postings->ids_sz++] = id;
+        }
+        trigrams->covered = id + 1;
+    }
+    return 1;
+}
+
+/**
+ * Returns the postings of trigram, or NULL if it has none and create is 0,
+ * or if there is no memory to add them.
+ */
+static history_postings_t * history_postings(history_trigrams_t * trigrams,
+                                             uint32_t trigram,
+                                             int create)
+{
+    if (create && 2 * (trigrams->postings_sz + 1) > trigrams->postings_capacity) {
+        size_t old_capacity = trigrams->postings_capacity;
+        history_postings_t * old = trigrams->postings;
+        size_t capacity = (0 == old_capacity) ? 4096 : 2 * old_capacity;
+        history_postings_t * grown = calloc(capacity, sizeof(history_postings_t));
+        if (NULL == grown) {
+            return NULL;
+        }
+        trigrams->postings = grown;
+        trigrams->postings_capacity = capacity;
+        trigrams->postings_sz = 0;
+        for (size_t i = 0; i < old_capacity; ++i) {
+            if (0 != old[i].trigram) {
+                *history_postings(trigrams, old[i].trigram - 1, 1) = old[i];
+            }
+        }
+        free(old);
+    }
+    if (0 == trigrams->postings_capacity) {
+        return NULL;
+    }
+    size_t mask = trigrams->postings_capacity - 1;
+    size_t slot = (trigram * 2654435761u) & mask;
+    while (0 != trigrams->postings[slot].trigram) {
+        if (trigram + 1 == trigrams->postings[slot].trigram) {
+            return &trigrams->postings[slot];
+        }
+        slot = (slot + 1) & mask;
+    }
+    if (!create) {
+        return NULL;
+    }
+    trigrams->postings[slot].trigram = trigram + 1;
+    trigrams->postings_sz++;
+    return &trigrams->postings[slot];
+}
+
+static void history_trigrams_delete(history_trigrams_t * trigrams)
+{
+    if (NULL != trigrams->map) {
+        munmap(trigrams->map, trigrams->map_sz);
+    }
+    for (size_t i = 0; i < trigrams->postings_capacity; ++i) {
+        free(trigrams->postings[i].ids);
+    }
+    free(trigrams->postings);
+    free(trigrams);
+}
+
+/**
+ * Answers a query by checking every entry from the from-th one up to the
+ * before-th one, for a query too short to have trigrams or entries the
+ * trigram index does not cover.
+ */
+static size_t history_scan(history_t * history,
+                           const char * query,
+                           size_t query_sz,
+                           size_t from,
+                           size_t before)
+{
+    while (before-- > from) {
+        size_t entry_sz;
+        const char * entry = history_entry(history, before, &entry_sz);
+        if (NULL != memmem(entry, entry_sz, query, query_sz)) {
+            return before;
+        }
+    }
+    return HISTORY_NONE;
+}
@@ -0,0 +1,80 @@
+#ifndef HISTORY_H_
+#define HISTORY_H_
+
+#include <stddef.h>
+
+/**
+ * Returned by history_search when nothing matches.
+ */
+#define HISTORY_NONE ((size_t) -1)
+
+/**
+ * The user's command history: an append-only file of newline-terminated
+ * lines, shared by every running shell. Each line is appended with a single
+ * write to a descriptor opened with O_APPEND, so the lines of concurrent
+ * sessions never interleave, and the file is read through a shared mapping
+ * without taking any locks; a line that is still being written is simply
+ * not seen until its newline is.
+ */
+typedef struct history_t history_t;
+
+/**
+ * Opens the history file at path, creating it if need be. A NULL path
+ * means $NEPHESH_HISTORY, or nephesh/history under $XDG_DATA_HOME (or
+ * ~/.local/share). Returns NULL if there is no history file to be had.
+ */
+history_t * history_open(const char * path);
+void history_close(history_t * history);
+
+/**
+ * Picks up lines appended to the file since the last call, by this or any
+ * other session. Invalidates pointers returned by history_entry.
+ */
+void history_sync(history_t * history);
+
+/**
+ * Appends line to the file, unless it is empty or repeats the most recent
+ * entry, and syncs. Returns 0 if the line could not be written.
+ */
+int history_add(history_t * history,
+                const char * line);
+
+/**
+ * Returns the number of entries, oldest first.
+ */
+size_t history_count(history_t * history);
+
+/**
+ * Returns the i-th entry, which is not NUL-terminated, and stores its
+ * length in entry_sz.
+ */
+const char * history_entry(history_t * history,
+                           size_t i,
+                           size_t * entry_sz);
+
+/**
+ * Returns the index of the most recent entry before the before-th one that
+ * contains query, or HISTORY_NONE. Queries of three bytes or more are
+ * answered from a trigram index, so that the cost depends on the number of
+ * candidate entries rather than the size of the history. The index is built
+ * by a background thread, as the prefix index is; entries it does not cover
+ * yet, which until it is first built are all of them, are checked one by
+ * one.
+ */
+size_t history_search(history_t * history,
+                      const char * query,
+                      size_t query_sz,
+                      size_t before);
+
+/**
+ * Returns the index of the most recent entry that starts with, and is longer
+ * than, prefix, or HISTORY_NONE. Lookups go through a sorted index of the
+ * entries that is built by a background thread, so that neither building it
+ * nor using it ever holds up the caller for long; entries the index does not
+ * cover yet are checked one by one.
+ */
+size_t history_suggest(history_t * history,
+                       const char * prefix,
+                       size_t prefix_sz);
+
+#endif
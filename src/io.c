@@ -0,0 +1,53 @@
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "io.h"
+
+int io_write_all(int fd,
+                 const void * buffer,
+                 size_t size)
+{
+    const char * data = buffer;
+    while (size > 0) {
+        ssize_t n = write(fd, data, size);
+        if (n < 0) {
+            if (EINTR == errno) {
+                continue;
+            }
+            return 0;
+        }
+        data += n;
+        size -= n;
+    }
+    return 1;
+}
+
+int io_xdg_dir(const char * env,
+               const char * fallback,
+               const char * sub,
+               char * out,
+               size_t out_sz)
+{
+    const char * xdg = getenv(env);
+    const char * home = getenv("HOME");
+    int n;
+    if (NULL != xdg && '\0' != xdg[0]) {
+        n = snprintf(out, out_sz, "%s/%s", xdg, sub);
+    } else if (NULL != home && '\0' != home[0]) {
+        n = snprintf(out, out_sz, "%s/%s/%s", home, fallback, sub);
+    } else {
+        return 0;
+    }
+    if (n < 0 || (size_t) n >= out_sz) {
+        return 0;
+    }
+    for (char * slash = strchr(out + 1, '/'); NULL != slash; slash = strchr(slash + 1, '/')) {
+        *slash = '\0';
+        mkdir(out, 0700);
+        *slash = '/';
+    }
+    return 0 == mkdir(out, 0700) || EEXIST == errno;
+}
@@ -0,0 +1,29 @@
+#ifndef IO_H_
+#define IO_H_
+
+#include <stdlib.h>
+
+/**
+ * Writes all of buffer to fd, going on after partial writes and interrupted
+ * calls. Returns a boolean indicating success. Only calls write, so it may be
+ * used in a child forked from the threaded shell.
+ */
+int io_write_all(int fd,
+                 const void * buffer,
+                 size_t size);
+
+/**
+ * Puts the path of the directory sub under the base directory named by the
+ * environment variable env, or under fallback in the home directory when env
+ * is unset or empty, into out, and creates it and any missing parents, as
+ * mkdir -p does. For example, ("XDG_CACHE_HOME", ".cache", "nephesh/memo")
+ * gives ~/.cache/nephesh/memo. Returns 0 if there is no home directory, the
+ * path does not fit in out_sz bytes or the directory cannot be created.
+ */
+int io_xdg_dir(const char * env,
+               const char * fallback,
+               const char * sub,
+               char * out,
+               size_t out_sz);
+
+#endif
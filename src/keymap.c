@@ -0,0 +1,90 @@
+#include <stdlib.h>
+#include <string.h>
+#include "keymap.h"
+
+typedef struct keymap_node_t {
+    /**
+     * Index of the child node for each possible next byte, or KEYMAP_ROOT if
+     * there is none (the root is never anybody's child).
+     */
+    unsigned int next[256];
+    unsigned int children;
+    kb_callback action;
+} keymap_node_t;
+
+struct keymap_t {
+    keymap_node_t * nodes;
+    unsigned int nodes_sz;
+    unsigned int nodes_capacity;
+};
+
+static unsigned int keymap_node_new(keymap_t * keymap);
+
+keymap_t * keymap_new(void)
+{
+    keymap_t * keymap = malloc(sizeof(keymap_t));
+    keymap->nodes = NULL;
+    keymap->nodes_sz = 0;
+    keymap->nodes_capacity = 0;
+    keymap_node_new(keymap);
+    return keymap;
+}
+
+void keymap_delete(keymap_t * keymap)
+{
+    free(keymap->nodes);
+    free(keymap);
+}
+
+int keymap_add(keymap_t * keymap,
+               const char * sequence,
+               kb_callback action)
+{
+    if (NULL == sequence || '\0' == sequence[0]) {
+        return 0;
+    }
+    unsigned int state = KEYMAP_ROOT;
+    for (const unsigned char * byte = (const unsigned char *) sequence;
+         '\0' != *byte; ++byte) {
+        unsigned int next = keymap->nodes[state].next[*byte];
+        if (KEYMAP_ROOT == next) {
+            next = keymap_node_new(keymap);
+            keymap->nodes[state].next[*byte] = next;
+            keymap->nodes[state].children++;
+        }
+        state = next;
+    }
+    keymap->nodes[state].action = action;
+    return 1;
+}
+
+unsigned int keymap_next(const keymap_t * keymap,
+                         unsigned int state,
+                         unsigned char byte)
+{
+    return keymap->nodes[state].next[byte];
+}
+
+kb_callback keymap_action(const keymap_t * keymap,
+                          unsigned int state)
+{
+    return keymap->nodes[state].action;
+}
+
+int keymap_is_final(const keymap_t * keymap,
+                    unsigned int state)
+{
+    return 0 == keymap->nodes[state].children;
+}
+
+static unsigned int keymap_node_new(keymap_t * keymap)
+{
+    if (keymap->nodes_sz == keymap->nodes_capacity) {
+        keymap->nodes_capacity = (0 == keymap->nodes_capacity)
+                                 ? 16 : 2 * keymap->nodes_capacity;
+        keymap->nodes = realloc(keymap->nodes,
+                                keymap->nodes_capacity * sizeof(keymap_node_t));
+    }
+    memset(&keymap->nodes[keymap->nodes_sz], 0, sizeof(keymap_node_t));
+    return keymap->nodes_sz++;
+}
@@ -0,0 +1,51 @@
+#ifndef KEYMAP_H_
+#define KEYMAP_H_
+
+#include "editor.h"
+
+/**
+ * The state before any byte of a key sequence has been seen.
+ */
+#define KEYMAP_ROOT 0
+
+/**
+ * Key bindings compiled into a trie over the bytes of their sequences. Input
+ * is matched by stepping from state to state one byte at a time, which takes
+ * constant time and never allocates.
+ */
+typedef struct keymap_t keymap_t;
+
+keymap_t * keymap_new(void);
+void keymap_delete(keymap_t * keymap);
+
+/**
+ * Binds sequence to action, replacing any earlier binding of the same
+ * sequence. Returns 0 if the sequence is empty.
+ */
+int keymap_add(keymap_t * keymap,
+               const char * sequence,
+               kb_callback action);
+
+/**
+ * Returns the state reached from state by byte, or KEYMAP_ROOT if no binding
+ * continues that way.
+ */
+unsigned int keymap_next(const keymap_t * keymap,
+                         unsigned int state,
+                         unsigned char byte);
+
+/**
+ * Returns the action bound to the sequence that leads to state, or NULL if
+ * that sequence is only a prefix of longer ones.
+ */
+kb_callback keymap_action(const keymap_t * keymap,
+                          unsigned int state);
+
+/**
+ * Returns non-zero if no binding extends the sequence that leads to state, so
+ * that its action can run without waiting for more input.
+ */
+int keymap_is_final(const keymap_t * keymap,
+                    unsigned int state);
+
+#endif
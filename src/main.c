@@ -8,15 +8,15 @@
 #include <term.h>
 #include <utlist.h>
 #include "editor.h"
+#include "exec.h"
 #include "scanner.h"
 #include "parser.h"
-#include <wait.h>
-#include <sys/stat.h>
-#include <fcntl.h>
+#include "rewrite.h"
+#include "script.h"
+#include "stats.h"
 
-extern char **environ;
-
-static int nfsh_execute_pipeline(command_t * commands);
+static int nfsh_run_script(const char * path);
+static int nfsh_explain_script(const char * path);
 
 int main(int argc, char * argv[])
 {
@@ -24,6 +24,17 @@ int main(int argc, char * argv[])
 
     // TODO: verify that locale is UTF-8.
 
+    if (argc > 2 && 0 == strcmp(argv[1], "--builtin")) {
+        return exec_helper(&argv[2]);
+    }
+    if (argc > 2 && 0 == strcmp(argv[1], "--explain")) {
+        return nfsh_explain_script(argv[2]);
+    }
+    if (argc > 1) {
+        exec_init(0);
+        return nfsh_run_script(argv[1]);
+    }
+
     if (!isatty(STDIN_FILENO)) {
         fputs("Not a terminal.\n", stderr);
         return 1;
@@ -49,39 +60,58 @@ int main(int argc, char * argv[])
     tcsetattr(STDIN_FILENO, TCSANOW, &nfsh_term_settings);
 
     ed_t * ed = ed_new(STDIN_FILENO, STDOUT_FILENO);
+    exec_init(1);
 
     fprintf(stdout, "Type 'exit' to quit.\n");
     fflush(stdout);
 
     while (1) {
+        uint64_t allocations = stats_allocations();
         const char * line = ed_readline(ed);
-        if (0 == strlen(line)) {
+        if (NULL == line) {
+            break;
+        } else if (0 == strlen(line)) {
             continue;
         } else if (0 == strcmp(line, "exit")) {
             break;
         } else {
+            stats_add(STATS_LINES, 1);
+            uint64_t start = stats_now();
             scanner_t * scanner = scanner_new(line);
             if (NULL == scanner) {
                 goto error0;
             }
             token_t * tokens = scanner_scan(scanner);
-            token_debug_dump(tokens);
+            stats_record(STATS_SCAN_NS, stats_now() - start);
+            if (stats_verbosity() > 0) {
+                token_debug_dump(tokens);
+            }
+            start = stats_now();
             parser_t * parser = parser_new(tokens);
             if (NULL == parser) {
                 goto error1;
             }
             command_t * commands = parser_parse(parser);
-            command_debug_dump(commands);
+            stats_record(STATS_PARSE_NS, stats_now() - start);
+            if (stats_verbosity() > 0) {
+                command_debug_dump(commands);
+            }
             if (NULL == commands) {
                 fprintf(stdout, "Parse error: %s\n", parser_get_error(parser));
                 fflush(stdout);
+                ed_set_status(ed, 2, 0);
                 goto error2;
             }
+            rewrite_pipeline(commands, (stats_verbosity() > 0) ? stderr : NULL);
             tcsetattr(STDIN_FILENO, TCSANOW, &term_settings);
-            if (nfsh_execute_pipeline(commands) < 0) {
+            start = stats_now();
+            int status = exec_pipeline(commands);
+            if (status < 0) {
                 fprintf(stdout, "Unable to execute one or more commands.\n");
                 fflush(stdout);
+                status = 1;
             }
+            ed_set_status(ed, status, stats_now() - start);
             tcsetattr(STDIN_FILENO, TCSANOW, &nfsh_term_settings);
         error2:
                 parser_delete(parser);
@@ -94,6 +124,7 @@ int main(int argc, char * argv[])
                     free(tt1);
                 }
         error0:
+                stats_record(STATS_LINE_ALLOCATIONS, stats_allocations() - allocations);
                 continue;
         }
     }
@@ -106,70 +137,50 @@ int main(int argc, char * argv[])
     return 0;
 }
 
-static int nfsh_execute_pipeline(command_t * commands)
+static int nfsh_run_script(const char * path)
 {
-    command_t * command = NULL;
-    command_t * command_prev = NULL;
-    int end_of_pipeline = 0;
-    DL_FOREACH(commands, command) {
-        command_prev = command->prev;
-        // Create legitimate pipes. TODO: algorithm sucks
-        for (unsigned int i = 0; i < command->pipec; ++i) {
-            unsigned int found = 0;
-            for (unsigned int j = 0; j < command->pipec; ++j) {
-                if (command->pipes[j][1] == command->pipes[i][1]) {
-                    found = j;
-                    break;
-                }
-            }
-            if (found < i) {
-                command->pipes_legit[i][0] = command->pipes_legit[found][0];
-                command->pipes_legit[i][1] = command->pipes_legit[found][1];
-            } else {
-                pipe(command->pipes_legit[i]);
-            }
-        }
-        if (0 == fork()) {
-            // Input pipes.
-            if (NULL != command_prev) {
-                for (unsigned int i = 0; i < command_prev->pipec; ++i) {
-                    close(command_prev->pipes_legit[i][1]);
-                    dup2(command_prev->pipes_legit[i][0], command_prev->pipes[i][1]);
-                }
-            }
-            // Output pipes.
-            for (unsigned int i = 0; i < command->pipec; ++i) {
-                if (-1 == command->pipes[i][1]) {
-                    int open_file = open(command->next->argv[0], O_CREAT | O_WRONLY, 0644);
-                    dup2(open_file, command->pipes_legit[i][1]);
-                    end_of_pipeline = 1;
-                }
-                close(command->pipes_legit[i][0]);
-                dup2(command->pipes_legit[i][1], command->pipes[i][0]);
-            }
-            execvpe(command->argv[0], command->argv, environ);
-            exit(1);
-        }
-        // Cleanup previous pipes.
-        if (NULL != command_prev) {
-            for (unsigned int i = 0; i < command_prev->pipec; ++i) {
-                close(command_prev->pipes_legit[i][0]);
-                close(command_prev->pipes_legit[i][1]);
-            }
+    script_t * script = script_load(path);
+    if (NULL == script) {
+        return 1;
+    }
+    int status = 0;
+    for (unsigned int i = 0; i < script_pipeline_count(script); ++i) {
+        command_t * commands = script_pipeline(script, i);
+        rewrite_pipeline(commands, NULL);
+        // As in sh, the script exits with the status of its last pipeline.
+        status = exec_pipeline(commands);
+        if (status < 0) {
+            fprintf(stderr, "%s: Unable to execute one or more commands.\n", path);
+            status = 1;
         }
-        // Reached the end.
-        if (end_of_pipeline) {
+        if (exec_interrupted()) {
+            status = 130;
             break;
         }
     }
-    // Cleanup previous pipes (final run).
-    if (NULL != command_prev) {
-        for (unsigned int i = 0; i < command_prev->pipec; ++i) {
-            close(command_prev->pipes_legit[i][0]);
-            close(command_prev->pipes_legit[i][1]);
+    script_delete(script);
+    return status;
+}
+
+/**
+ * Writes each pipeline of the script at path as it is written and, if the
+ * rewrite pass changes it, the changes and what runs instead, without
+ * running anything.
+ */
+static int nfsh_explain_script(const char * path)
+{
+    script_t * script = script_load(path);
+    if (NULL == script) {
+        return 1;
+    }
+    for (unsigned int i = 0; i < script_pipeline_count(script); ++i) {
+        command_t * commands = script_pipeline(script, i);
+        command_print(commands, stdout);
+        if (rewrite_pipeline(commands, stdout) > 0) {
+            fputs("=> ", stdout);
+            command_print(commands, stdout);
         }
     }
-    // Wait for children.
-    while (wait(NULL) > 0);
+    script_delete(script);
     return 0;
 }
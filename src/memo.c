@@ -0,0 +1,494 @@
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/sendfile.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <wait.h>
+#include "memo.h"
+#include "hash.h"
+#include "io.h"
+#include "version.h"
+
+/**
+ * Bytes read or written at a time.
+ */
+#define MEMO_BUFFER_SIZE 65536
+
+extern char **environ;
+
+/**
+ * A stored output, as seen when making room.
+ */
+typedef struct memo_entry_t {
+    char * name;
+    off_t size;
+    struct timespec used;
+} memo_entry_t;
+
+static char * memo_dir(void);
+static void memo_key(hash_t * hash,
+                     char * const command[]);
+static void memo_key_file(hash_t * hash,
+                          const char * path);
+static int memo_key_env(const char * entry);
+static int memo_spool(const char * dir,
+                      hash_t * hash);
+static int memo_replay(int fd);
+static int memo_record(const char * path,
+                       char * const command[],
+                       int input);
+static void memo_evict(const char * dir);
+static int memo_entry_compare(const void * a,
+                              const void * b);
+
+int memo_run(char * const argv[],
+             memo_input_t input)
+{
+    if (NULL == argv[1]) {
+        fputs("Usage: cached COMMAND [ARG]...\n", stderr);
+        return 2;
+    }
+    char * const * command = &argv[1];
+    // Stages after this one that stop reading early show up as write errors.
+    signal(SIGPIPE, SIG_IGN);
+    int spool = (MEMO_INPUT_PIPED == input);
+    if (MEMO_INPUT_INHERITED == input && !isatty(STDIN_FILENO)) {
+        struct stat st;
+        if (0 == fstat(STDIN_FILENO, &st) && S_ISREG(st.st_mode)) {
+            spool = 1;
+        } else {
+            input = MEMO_INPUT_UNKEYED;
+        }
+    }
+    // Data the key cannot cover would have a stale output replayed.
+    char * dir = (MEMO_INPUT_UNKEYED == input) ? NULL : memo_dir();
+    hash_t hash;
+    hash_init(&hash);
+    memo_key(&hash, command);
+    int spooled = -1;
+    if (NULL != dir && spool) {
+        spooled = memo_spool(dir, &hash);
+        if (spooled < 0) {
+            free(dir);
+            return 1;
+        }
+    }
+    char * path = NULL;
+    if (NULL != dir) {
+        unsigned char key[HASH_SIZE];
+        char hex[HASH_HEX_SIZE + 1];
+        hash_final(&hash, key);
+        hash_hex(key, hex);
+        size_t path_sz = strlen(dir) + 1 + HASH_HEX_SIZE + 1;
+        path = malloc(path_sz);
+        if (NULL != path) {
+            snprintf(path, path_sz, "%s/%s", dir, hex);
+        }
+        // Without a path the command runs as if nothing were stored.
+        int fd = (NULL != path) ? open(path, O_RDONLY | O_CLOEXEC) : -1;
+        if (fd >= 0) {
+            // The modification time of an entry is when it was last used.
+            futimens(fd, NULL);
+            int status = memo_replay(fd);
+            close(fd);
+            if (spooled >= 0) {
+                close(spooled);
+            }
+            free(path);
+            free(dir);
+            return status;
+        }
+    }
+    int status = memo_record(path, command, spooled);
+    if (NULL != path && 0 == access(path, F_OK)) {
+        memo_evict(dir);
+    }
+    free(path);
+    free(dir);
+    return status;
+}
+
+/**
+ * Returns the directory outputs are stored in, creating it if necessary, or
+ * NULL if there is nowhere to store them.
+ */
+static char * memo_dir(void)
+{
+    char base[4096];
+    if (!io_xdg_dir("XDG_CACHE_HOME", ".cache", "nephesh/memo", base, sizeof(base))) {
+        return NULL;
+    }
+    return strdup(base);
+}
+
+/**
+ * Hashes what the output of command depends on besides its input: the
+ * shell version, the arguments, the working directory, the environment
+ * variables that may change what it does, and the identity and modification
+ * times of the program and of every argument that names a file, whose
+ * contents are too costly to hash.
+ */
+static void memo_key(hash_t * hash,
+                     char * const command[])
+{
+    const char * version = "nephesh " NFSH_VERSION;
+    hash_update(hash, version, strlen(version) + 1);
+    size_t argc = 0;
+    while (NULL != command[argc]) {
+        argc++;
+    }
+    hash_update(hash, &argc, sizeof(argc));
+    for (size_t i = 0; i < argc; ++i) {
+        hash_update(hash, command[i], strlen(command[i]) + 1);
+    }
+    char * cwd = getcwd(NULL, 0);
+    if (NULL != cwd) {
+        hash_update(hash, cwd, strlen(cwd) + 1);
+        free(cwd);
+    }
+    for (size_t i = 0; NULL != environ[i]; ++i) {
+        if (memo_key_env(environ[i])) {
+            hash_update(hash, environ[i], strlen(environ[i]) + 1);
+        }
+    }
+    // The program, as execvp would find it.
+    const char * path_env = getenv("PATH");
+    if (NULL != strchr(command[0], '/') || NULL == path_env) {
+        memo_key_file(hash, command[0]);
+    } else {
+        const char * at = path_env;
+        while (1) {
+            size_t dir_sz = strcspn(at, ":");
+            char program[PATH_MAX];
+            snprintf(program, sizeof(program), "%.*s%s%s", (int) dir_sz, at,
+                     (0 == dir_sz) ? "" : "/", command[0]);
+            if (0 == access(program, X_OK)) {
+                memo_key_file(hash, program);
+                break;
+            }
+            if ('\0' == at[dir_sz]) {
+                break;
+            }
+            at += dir_sz + 1;
+        }
+    }
+    for (size_t i = 1; i < argc; ++i) {
+        memo_key_file(hash, command[i]);
+    }
+}
+
+static void memo_key_file(hash_t * hash,
+                          const char * path)
+{
+    struct stat st;
+    unsigned char exists = (0 == stat(path, &st));
+    hash_update(hash, &exists, sizeof(exists));
+    if (exists) {
+        hash_update(hash, &st.st_dev, sizeof(st.st_dev));
+        hash_update(hash, &st.st_ino, sizeof(st.st_ino));
+        hash_update(hash, &st.st_size, sizeof(st.st_size));
+        hash_update(hash, &st.st_mtim.tv_sec, sizeof(st.st_mtim.tv_sec));
+        hash_update(hash, &st.st_mtim.tv_nsec, sizeof(st.st_mtim.tv_nsec));
+    }
+}
+
+/**
+ * Returns a boolean indicating whether the environment entry may change
+ * what a command does: PATH, TZ, the locale, and the variables named in
+ * $NEPHESH_CACHE_ENV.
+ */
+static int memo_key_env(const char * entry)
+{
+    size_t name_sz = strcspn(entry, "=");
+    static const char * names[] = { "PATH", "TZ", "LANG", "LANGUAGE" };
+    for (size_t i = 0; i < sizeof(names) / sizeof(names[0]); ++i) {
+        if (strlen(names[i]) == name_sz && 0 == strncmp(entry, names[i], name_sz)) {
+            return 1;
+        }
+    }
+    if (0 == strncmp(entry, "LC_", 3)) {
+        return 1;
+    }
+    const char * listed = getenv("NEPHESH_CACHE_ENV");
+    while (NULL != listed && '\0' != *listed) {
+        size_t listed_sz = strcspn(listed, " \t,");
+        if (listed_sz == name_sz && 0 == strncmp(entry, listed, name_sz)) {
+            return 1;
+        }
+        listed += listed_sz;
+        listed += strspn(listed, " \t,");
+    }
+    return 0;
+}
+
+/**
+ * Reads standard input to its end into an unnamed file in dir, hashing it
+ * on the way. Returns the file, positioned at its start, or -1.
+ */
+static int memo_spool(const char * dir,
+                      hash_t * hash)
+{
+    int fd = open(dir, O_TMPFILE | O_RDWR | O_CLOEXEC, 0600);
+    if (fd < 0) {
+        // Not every file system has unnamed files.
+        size_t template_sz = strlen(dir) + 32;
+        char * template = malloc(template_sz);
+        if (NULL != template) {
+            // Hidden, like outputs being stored, from memo_evict.
+            snprintf(template, template_sz, "%s/.input.XXXXXX", dir);
+            fd = mkostemp(template, O_CLOEXEC);
+            if (fd >= 0) {
+                unlink(template);
+            }
+            free(template);
+        }
+    }
+    if (fd < 0) {
+        perror("cached");
+        return -1;
+    }
+    char * buffer = malloc(MEMO_BUFFER_SIZE);
+    if (NULL == buffer) {
+        perror("cached");
+        close(fd);
+        return -1;
+    }
+    ssize_t n;
+    while ((n = read(STDIN_FILENO, buffer, MEMO_BUFFER_SIZE)) != 0) {
+        if (n < 0) {
+            if (EINTR == errno) {
+                continue;
+            }
+            break;
+        }
+        hash_update(hash, buffer, n);
+        if (!io_write_all(fd, buffer, n)) {
+            break;
+        }
+    }
+    free(buffer);
+    if (0 != n || 0 != lseek(fd, 0, SEEK_SET)) {
+        perror("cached");
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+/**
+ * Writes a stored output to standard output, with sendfile where the kernel
+ * can, and by reading and writing where it cannot. Returns 0, or the status
+ * of a command that could not write all of it.
+ */
+static int memo_replay(int fd)
+{
+    struct stat st;
+    if (0 != fstat(fd, &st)) {
+        perror("cached");
+        return 1;
+    }
+    off_t offset = 0;
+    while (offset < st.st_size) {
+        ssize_t n = sendfile(STDOUT_FILENO, fd, &offset, st.st_size - offset);
+        if (n > 0) {
+            continue;
+        } else if (n < 0 && EINTR == errno) {
+            continue;
+        } else if (n < 0 && (EINVAL == errno || ENOSYS == errno)) {
+            break;
+        }
+        return (n < 0 && EPIPE == errno) ? 128 + SIGPIPE : 1;
+    }
+    char * buffer = malloc(MEMO_BUFFER_SIZE);
+    if (NULL == buffer) {
+        perror("cached");
+        return 1;
+    }
+    int status = 0;
+    while (offset < st.st_size) {
+        ssize_t n = pread(fd, buffer, MEMO_BUFFER_SIZE, offset);
+        if (n < 0 && EINTR == errno) {
+            continue;
+        } else if (n <= 0) {
+            perror("cached");
+            status = 1;
+            break;
+        }
+        if (!io_write_all(STDOUT_FILENO, buffer, n)) {
+            status = (EPIPE == errno) ? 128 + SIGPIPE : 1;
+            break;
+        }
+        offset += n;
+    }
+    free(buffer);
+    return status;
+}
+
+/**
+ * Runs command on input, or on the inherited standard input if that is -1,
+ * passing its output on and storing it at path, unless path is NULL, if it
+ * exits with status 0 and is no larger than MEMO_ENTRY_MAX. Returns its exit
+ * status.
+ */
+static int memo_record(const char * path,
+                       char * const command[],
+                       int input)
+{
+    char * buffer = malloc(MEMO_BUFFER_SIZE);
+    int output[2];
+    if (NULL == buffer || 0 != pipe2(output, O_CLOEXEC)) {
+        perror("cached");
+        free(buffer);
+        return 1;
+    }
+    pid_t pid = fork();
+    if (0 == pid) {
+        signal(SIGPIPE, SIG_DFL);
+        if (input >= 0) {
+            dup2(input, STDIN_FILENO);
+        }
+        dup2(output[1], STDOUT_FILENO);
+        execvp(command[0], command);
+        fprintf(stderr, "%s: %s\n", command[0], strerror(errno));
+        _exit((ENOENT == errno) ? 127 : 126);
+    }
+    close(output[1]);
+    if (input >= 0) {
+        close(input);
+    }
+    if (pid < 0) {
+        perror("cached");
+        close(output[0]);
+        free(buffer);
+        return 1;
+    }
+    // Written under a private, hidden name and renamed into place, so that
+    // concurrent runs never replay a partial output nor evict it.
+    char * temp_path = NULL;
+    int store = -1;
+    if (NULL != path) {
+        size_t temp_sz = strlen(path) + 32;
+        temp_path = malloc(temp_sz);
+        const char * name = strrchr(path, '/') + 1;
+        if (NULL != temp_path) {
+            snprintf(temp_path, temp_sz, "%.*s.%s.%ld.tmp", (int) (name - path), path,
+                     name, (long) getpid());
+            store = open(temp_path, O_CREAT | O_EXCL | O_WRONLY | O_CLOEXEC, 0600);
+        }
+    }
+    long long stored = 0;
+    int complete = 1;
+    ssize_t n;
+    while ((n = read(output[0], buffer, MEMO_BUFFER_SIZE)) != 0) {
+        if (n < 0) {
+            if (EINTR == errno) {
+                continue;
+            }
+            complete = 0;
+            break;
+        }
+        // Once the output has nowhere to go, the command is not run to the
+        // end just to store it.
+        if (!io_write_all(STDOUT_FILENO, buffer, n)) {
+            complete = 0;
+            break;
+        }
+        if (store >= 0 && (stored + n > MEMO_ENTRY_MAX || !io_write_all(store, buffer, n))) {
+            close(store);
+            unlink(temp_path);
+            store = -1;
+        }
+        stored += n;
+    }
+    free(buffer);
+    close(output[0]);
+    int status;
+    while (waitpid(pid, &status, 0) < 0 && EINTR == errno);
+    int code = WIFSIGNALED(status) ? 128 + WTERMSIG(status) : WEXITSTATUS(status);
+    if (store >= 0) {
+        close(store);
+        if (!complete || 0 != code || 0 != rename(temp_path, path)) {
+            unlink(temp_path);
+        }
+    }
+    free(temp_path);
+    return code;
+}
+
+/**
+ * Removes the least recently used outputs in dir until those left take up
+ * no more than MEMO_SIZE_MAX bytes.
+ */
+static void memo_evict(const char * dir)
+{
+    DIR * listing = opendir(dir);
+    if (NULL == listing) {
+        return;
+    }
+    memo_entry_t * entries = NULL;
+    size_t entries_sz = 0;
+    size_t entries_capacity = 0;
+    long long total = 0;
+    struct dirent * dirent;
+    while (NULL != (dirent = readdir(listing))) {
+        struct stat st;
+        if ('.' == dirent->d_name[0] ||
+                0 != fstatat(dirfd(listing), dirent->d_name, &st, AT_SYMLINK_NOFOLLOW) ||
+                !S_ISREG(st.st_mode)) {
+            continue;
+        }
+        if (entries_sz == entries_capacity) {
+            size_t capacity = (0 == entries_capacity) ? 64 : 2 * entries_capacity;
+            memo_entry_t * grown = realloc(entries, capacity * sizeof(memo_entry_t));
+            if (NULL == grown) {
+                break;
+            }
+            entries = grown;
+            entries_capacity = capacity;
+        }
+        // Out of memory, what has been listed so far is evicted from.
+        entries[entries_sz].name = strdup(dirent->d_name);
+        if (NULL == entries[entries_sz].name) {
+            break;
+        }
+        entries[entries_sz].size = st.st_size;
+        entries[entries_sz++].used = st.st_mtim;
+        total += st.st_size;
+    }
+    if (total > MEMO_SIZE_MAX) {
+        qsort(entries, entries_sz, sizeof(memo_entry_t), memo_entry_compare);
+        for (size_t i = 0; i < entries_sz && total > MEMO_SIZE_MAX; ++i) {
+            if (0 == unlinkat(dirfd(listing), entries[i].name, 0)) {
+                total -= entries[i].size;
+            }
+        }
+    }
+    for (size_t i = 0; i < entries_sz; ++i) {
+        free(entries[i].name);
+    }
+    free(entries);
+    closedir(listing);
+}
+
+/**
+ * Orders entries from the least to the most recently used.
+ */
+static int memo_entry_compare(const void * a,
+                              const void * b)
+{
+    const struct timespec * used_a = &((const memo_entry_t *) a)->used;
+    const struct timespec * used_b = &((const memo_entry_t *) b)->used;
+    if (used_a->tv_sec != used_b->tv_sec) {
+        return (used_a->tv_sec < used_b->tv_sec) ? -1 : 1;
+    }
+    if (used_a->tv_nsec != used_b->tv_nsec) {
+        return (used_a->tv_nsec < used_b->tv_nsec) ? -1 : 1;
+    }
+    return 0;
+}
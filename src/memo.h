@@ -0,0 +1,48 @@
+#ifndef MEMO_H_
+#define MEMO_H_
+
+/**
+ * The largest output that is stored, and the most the stored outputs may
+ * take up together, in bytes.
+ */
+#define MEMO_ENTRY_MAX ((long long) 256 << 20)
+#define MEMO_SIZE_MAX ((long long) 1 << 30)
+
+/**
+ * Where the data a cached stage reads reaches it from.
+ */
+typedef enum memo_input_t {
+    /**
+     * Standard input is the shell's own. A regular file is read to the end
+     * and keyed on like an edge; a terminal is left to the command and not
+     * keyed on, as what is typed at it is not the stage's data; anything
+     * else may never end, and the command runs without being cached.
+     */
+    MEMO_INPUT_INHERITED,
+    /**
+     * Standard input is an edge into fd 0 or a file the stage reads.
+     */
+    MEMO_INPUT_PIPED,
+    /**
+     * Edges reach descriptors other than fd 0, whose data the key cannot
+     * cover; the command runs without being cached.
+     */
+    MEMO_INPUT_UNKEYED
+} memo_input_t;
+
+/**
+ * Runs `cached COMMAND [ARG]...`: reads all of standard input, if input says
+ * it is data, and looks up the output of COMMAND by a hash of its
+ * arguments, the environment that may change what it does, the files that
+ * it and its arguments name, and that input. A stored output is written to
+ * standard output instead of running COMMAND; otherwise COMMAND runs on the
+ * input, and its output is passed on and, if it exits with status 0, stored
+ * for next time under $XDG_CACHE_HOME/nephesh/memo (~/.cache/nephesh/memo).
+ * Meant to be run by a forked stage, in place of executing a command.
+ * Returns the exit status of COMMAND, 0 for a stored output, or 2 if argv is
+ * not understood.
+ */
+int memo_run(char * const argv[],
+             memo_input_t input);
+
+#endif
@@ -1,4 +1,5 @@
 #include "parser.h"
+#include "stats.h"
 #include <stdio.h>
 #include <stdlib.h>
 #include <utlist.h>
@@ -27,6 +28,7 @@ static int parser_match(parser_t * parser,
 
 parser_t * parser_new(token_t * tokens)
 {
+    stats_allocated();
     parser_t * parser = malloc(sizeof(parser_t));
     parser->tokens = tokens;
     parser->token = tokens;
@@ -98,9 +100,12 @@ static int parser_parse_pipeline(parser_t * parser)
         command_delete(parser->command);
         return 0;
     }
-    parser->command->argv[0] = backtrack->aux;
-    parser->command->argv[1] = NULL;
-    parser->command->argc = 1;
+    if (!command_add_arg(parser->command, backtrack->aux)) {
+        parser->token = backtrack;
+        parser->error = "Out of memory.";
+        command_delete(parser->command);
+        return 0;
+    }
     // <str-more>
     if (!parser_parse_str_more(parser)) {
         parser->token = backtrack;
@@ -120,18 +125,17 @@ static int parser_parse_pipeline(parser_t * parser)
 
 static int parser_parse_str_more(parser_t * parser)
 {
+    // STR <str-more>, as a loop rather than by recursion, as a command may
+    // have any number of arguments.
     token_t * backtrack = parser->token;
-    // STR
-    if (parser_match(parser, TOKEN_TYPE_STR)) {
-        parser->command->argv[parser->command->argc] = backtrack->aux;
-        parser->command->argc++;
-        parser->command->argv[parser->command->argc] = NULL;
-        // <str-more>
-        return parser_parse_str_more(parser);
-    } else {
-        // LAMBDA
-        return 1;
+    while (parser_match(parser, TOKEN_TYPE_STR)) {
+        if (!command_add_arg(parser->command, backtrack->aux)) {
+            return 0;
+        }
+        backtrack = parser->token;
     }
+    // LAMBDA
+    return 1;
 }
 
 static int parser_parse_pipeline_more(parser_t * parser)
@@ -0,0 +1,746 @@
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <poll.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/eventfd.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <wait.h>
+#include <utlist.h>
+#include "prompt.h"
+#include "stats.h"
+
+/**
+ * Works out the value of a segment for the directory dir. A segment that
+ * runs a command gives up on it after timeout_ms milliseconds, if that is
+ * not 0, and returns 0; otherwise 1 is returned.
+ */
+typedef int (*prompt_segment_fn)(prompt_t * prompt,
+                                 const char * dir,
+                                 unsigned int timeout_ms,
+                                 char * value,
+                                 size_t value_sz);
+
+/**
+ * A value of a slow segment remembered for a directory, and until when it
+ * may be shown without being worked out again.
+ */
+typedef struct prompt_cache_t {
+    char * dir;
+    char value[PROMPT_VALUE_MAX];
+    uint64_t expires;
+    int timed_out;
+    struct prompt_cache_t * prev;
+    struct prompt_cache_t * next;
+} prompt_cache_t;
+
+/**
+ * The worker of a slow segment.
+ */
+typedef struct prompt_worker_t {
+    prompt_t * prompt;
+    prompt_segment_fn run;
+    unsigned int timeout_ms;
+    pthread_t thread;
+    int started;
+    /**
+     * The directory to work the value out for next, or NULL, and the value
+     * last worked out and the directory it is for, or NULL, shared with the
+     * worker under the prompt's lock.
+     */
+    char * request;
+    char * result_dir;
+    char result[PROMPT_VALUE_MAX];
+    int result_timed_out;
+    /**
+     * State below is only ever touched by the shell: the values remembered,
+     * most recently used first, and the value shown.
+     */
+    prompt_cache_t * cache;
+    unsigned int cache_sz;
+    char value[PROMPT_VALUE_MAX];
+} prompt_worker_t;
+
+/**
+ * A piece of the prompt: literal text, a quick segment or the worker of a
+ * slow one.
+ */
+typedef struct prompt_piece_t {
+    char * text;
+    prompt_segment_fn run;
+    prompt_worker_t * worker;
+} prompt_piece_t;
+
+struct prompt_t {
+    prompt_piece_t * pieces;
+    size_t pieces_sz;
+    /**
+     * A worker for every kind of segment, started if the prompt has one of
+     * that kind and it is slow.
+     */
+    prompt_worker_t * workers;
+    pthread_mutex_t lock;
+    pthread_cond_t wake;
+    int stop;
+    /**
+     * An eventfd signalled whenever a worker posts a value, and another
+     * signalled when the workers are to stop, which cuts short any command
+     * they are waiting for.
+     */
+    int notify;
+    int cancel;
+    /**
+     * The working directory, how the last pipeline went, and the prompt as
+     * last made.
+     */
+    char * dir;
+    int status;
+    uint64_t duration_ns;
+    char * text;
+};
+
+static void * prompt_worker(void * arg);
+static int prompt_render(prompt_t * prompt);
+static prompt_cache_t * prompt_cache_find(prompt_worker_t * worker,
+                                          const char * dir);
+static int prompt_git_dir(const char * dir,
+                          char * git_dir,
+                          size_t git_dir_sz);
+static int prompt_cwd(prompt_t * prompt,
+                      const char * dir,
+                      unsigned int timeout_ms,
+                      char * value,
+                      size_t value_sz);
+static int prompt_status(prompt_t * prompt,
+                         const char * dir,
+                         unsigned int timeout_ms,
+                         char * value,
+                         size_t value_sz);
+static int prompt_duration(prompt_t * prompt,
+                           const char * dir,
+                           unsigned int timeout_ms,
+                           char * value,
+                           size_t value_sz);
+static int prompt_branch(prompt_t * prompt,
+                         const char * dir,
+                         unsigned int timeout_ms,
+                         char * value,
+                         size_t value_sz);
+static int prompt_dirty(prompt_t * prompt,
+                        const char * dir,
+                        unsigned int timeout_ms,
+                        char * value,
+                        size_t value_sz);
+
+static const struct {
+    const char * name;
+    prompt_segment_fn run;
+    /**
+     * A boolean indicating whether the segment may take long enough to
+     * hold up typing, and is worked out by a worker.
+     */
+    int slow;
+    /**
+     * How long, in milliseconds, a command the segment runs may take,
+     * unless the format says otherwise; 0 for no limit.
+     */
+    unsigned int timeout_ms;
+} prompt_kinds[] = {
+    { "cwd", prompt_cwd, 0, 0 },
+    { "status", prompt_status, 0, 0 },
+    { "duration", prompt_duration, 0, 0 },
+    { "branch", prompt_branch, 1, 0 },
+    { "dirty", prompt_dirty, 1, 2000 }
+};
+
+#define PROMPT_KINDS (sizeof(prompt_kinds) / sizeof(prompt_kinds[0]))
+
+prompt_t * prompt_new(const char * format)
+{
+    prompt_t * prompt = malloc(sizeof(prompt_t));
+    if (NULL == prompt) {
+        return NULL;
+    }
+    memset(prompt, 0, sizeof(prompt_t));
+    pthread_mutex_init(&prompt->lock, NULL);
+    pthread_cond_init(&prompt->wake, NULL);
+    prompt->notify = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+    prompt->cancel = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+    prompt->workers = calloc(PROMPT_KINDS, sizeof(prompt_worker_t));
+    // There are never more pieces than bytes in the format.
+    prompt->pieces = calloc(strlen(format) + 1, sizeof(prompt_piece_t));
+    if (prompt->notify < 0 || prompt->cancel < 0 || NULL == prompt->workers ||
+            NULL == prompt->pieces) {
+        prompt_delete(prompt);
+        return NULL;
+    }
+    const char * at = format;
+    while ('\0' != *at) {
+        prompt_piece_t * piece = &prompt->pieces[prompt->pieces_sz++];
+        const char * end = strchr(at, '}');
+        if ('{' != *at || NULL == end) {
+            const char * brace = strchr(at + 1, '{');
+            size_t text_sz = (NULL != brace) ? (size_t) (brace - at) : strlen(at);
+            piece->text = strndup(at, text_sz);
+            if (NULL == piece->text) {
+                prompt_delete(prompt);
+                return NULL;
+            }
+            at += text_sz;
+            continue;
+        }
+        // {name} or {name:timeout}
+        size_t name_sz = strcspn(at + 1, ":}");
+        size_t kind = 0;
+        while (kind < PROMPT_KINDS &&
+               (strlen(prompt_kinds[kind].name) != name_sz ||
+                0 != strncmp(prompt_kinds[kind].name, at + 1, name_sz))) {
+            kind++;
+        }
+        unsigned int timeout_ms = (kind < PROMPT_KINDS) ? prompt_kinds[kind].timeout_ms : 0;
+        char * timeout_end = (char *) at + 1 + name_sz;
+        if (':' == *timeout_end) {
+            timeout_ms = strtoul(timeout_end + 1, &timeout_end, 10);
+        }
+        if (PROMPT_KINDS == kind || timeout_end != end) {
+            fprintf(stderr, "Invalid prompt segment: %.*s\n", (int) (end - at + 1), at);
+            prompt_delete(prompt);
+            return NULL;
+        }
+        if (!prompt_kinds[kind].slow) {
+            piece->run = prompt_kinds[kind].run;
+        } else {
+            piece->worker = &prompt->workers[kind];
+            if (NULL == piece->worker->run) {
+                piece->worker->prompt = prompt;
+                piece->worker->run = prompt_kinds[kind].run;
+                piece->worker->timeout_ms = timeout_ms;
+            }
+        }
+        at = end + 1;
+    }
+    for (size_t i = 0; i < PROMPT_KINDS; ++i) {
+        prompt_worker_t * worker = &prompt->workers[i];
+        if (NULL == worker->run) {
+            continue;
+        }
+        if (0 != pthread_create(&worker->thread, NULL, prompt_worker, worker)) {
+            prompt_delete(prompt);
+            return NULL;
+        }
+        worker->started = 1;
+    }
+    prompt->dir = strdup("");
+    if (NULL == prompt->dir) {
+        prompt_delete(prompt);
+        return NULL;
+    }
+    prompt_render(prompt);
+    if (NULL == prompt->text) {
+        prompt_delete(prompt);
+        return NULL;
+    }
+    return prompt;
+}
+
+void prompt_delete(prompt_t * prompt)
+{
+    pthread_mutex_lock(&prompt->lock);
+    prompt->stop = 1;
+    pthread_cond_broadcast(&prompt->wake);
+    pthread_mutex_unlock(&prompt->lock);
+    if (prompt->cancel >= 0) {
+        uint64_t one = 1;
+        write(prompt->cancel, &one, sizeof(one));
+    }
+    for (size_t i = 0; NULL != prompt->workers && i < PROMPT_KINDS; ++i) {
+        prompt_worker_t * worker = &prompt->workers[i];
+        if (worker->started) {
+            pthread_join(worker->thread, NULL);
+        }
+        free(worker->request);
+        free(worker->result_dir);
+        prompt_cache_t * entry, * temp;
+        DL_FOREACH_SAFE(worker->cache, entry, temp) {
+            DL_DELETE(worker->cache, entry);
+            free(entry->dir);
+            free(entry);
+        }
+    }
+    for (size_t i = 0; i < prompt->pieces_sz; ++i) {
+        free(prompt->pieces[i].text);
+    }
+    pthread_cond_destroy(&prompt->wake);
+    pthread_mutex_destroy(&prompt->lock);
+    if (prompt->notify >= 0) {
+        close(prompt->notify);
+    }
+    if (prompt->cancel >= 0) {
+        close(prompt->cancel);
+    }
+    free(prompt->pieces);
+    free(prompt->workers);
+    free(prompt->dir);
+    free(prompt->text);
+    free(prompt);
+}
+
+int prompt_fd(prompt_t * prompt)
+{
+    return prompt->notify;
+}
+
+void prompt_set_status(prompt_t * prompt,
+                       int status,
+                       uint64_t duration_ns)
+{
+    prompt->status = status;
+    prompt->duration_ns = duration_ns;
+    // Values that timed out are still not tried again before their time.
+    for (size_t i = 0; i < PROMPT_KINDS; ++i) {
+        prompt_cache_t * entry;
+        DL_FOREACH(prompt->workers[i].cache, entry) {
+            if (!entry->timed_out) {
+                entry->expires = 0;
+            }
+        }
+    }
+}
+
+void prompt_begin(prompt_t * prompt)
+{
+    char * dir = getcwd(NULL, 0);
+    if (NULL == dir) {
+        dir = strdup("");
+    }
+    // Out of memory, the prompt stays as it was for the last directory.
+    if (NULL != dir) {
+        free(prompt->dir);
+        prompt->dir = dir;
+    }
+    uint64_t now = stats_now();
+    for (size_t i = 0; i < PROMPT_KINDS; ++i) {
+        prompt_worker_t * worker = &prompt->workers[i];
+        if (!worker->started) {
+            continue;
+        }
+        // Show what was last known, until the worker has something newer.
+        prompt_cache_t * entry = prompt_cache_find(worker, prompt->dir);
+        memcpy(worker->value, (NULL != entry) ? entry->value : "",
+               (NULL != entry) ? sizeof(worker->value) : 1);
+        if ((NULL == entry || now >= entry->expires) && '\0' != prompt->dir[0]) {
+            char * request = strdup(prompt->dir);
+            if (NULL == request) {
+                continue;
+            }
+            pthread_mutex_lock(&prompt->lock);
+            free(worker->request);
+            worker->request = request;
+            pthread_cond_broadcast(&prompt->wake);
+            pthread_mutex_unlock(&prompt->lock);
+        }
+    }
+    prompt_render(prompt);
+}
+
+int prompt_update(prompt_t * prompt)
+{
+    uint64_t count;
+    while (read(prompt->notify, &count, sizeof(count)) < 0 && EINTR == errno);
+    uint64_t now = stats_now();
+    for (size_t i = 0; i < PROMPT_KINDS; ++i) {
+        prompt_worker_t * worker = &prompt->workers[i];
+        if (!worker->started) {
+            continue;
+        }
+        char value[PROMPT_VALUE_MAX];
+        pthread_mutex_lock(&prompt->lock);
+        char * dir = worker->result_dir;
+        worker->result_dir = NULL;
+        memcpy(value, worker->result, sizeof(value));
+        int timed_out = worker->result_timed_out;
+        pthread_mutex_unlock(&prompt->lock);
+        if (NULL == dir) {
+            continue;
+        }
+        if (0 == strcmp(dir, prompt->dir)) {
+            memcpy(worker->value, value, sizeof(value));
+        }
+        prompt_cache_t * entry = prompt_cache_find(worker, dir);
+        if (NULL != entry) {
+            free(dir);
+        } else {
+            entry = malloc(sizeof(prompt_cache_t));
+            if (NULL == entry) {
+                free(dir);
+                continue;
+            }
+            entry->dir = dir;
+            DL_PREPEND(worker->cache, entry);
+            if (++worker->cache_sz > PROMPT_CACHE_MAX) {
+                prompt_cache_t * last = worker->cache->prev;
+                DL_DELETE(worker->cache, last);
+                free(last->dir);
+                free(last);
+                worker->cache_sz--;
+            }
+        }
+        memcpy(entry->value, value, sizeof(value));
+        entry->timed_out = timed_out;
+        entry->expires = now +
+            (uint64_t) (timed_out ? PROMPT_BACKOFF_MS : PROMPT_CACHE_MS) * 1000000;
+    }
+    return prompt_render(prompt);
+}
+
+const char * prompt_text(prompt_t * prompt)
+{
+    return prompt->text;
+}
+
+static void * prompt_worker(void * arg)
+{
+    prompt_worker_t * worker = arg;
+    prompt_t * prompt = worker->prompt;
+    pthread_mutex_lock(&prompt->lock);
+    while (1) {
+        while (!prompt->stop && NULL == worker->request) {
+            pthread_cond_wait(&prompt->wake, &prompt->lock);
+        }
+        if (prompt->stop) {
+            break;
+        }
+        char * dir = worker->request;
+        worker->request = NULL;
+        pthread_mutex_unlock(&prompt->lock);
+
+        char value[PROMPT_VALUE_MAX];
+        int timed_out = !worker->run(prompt, dir, worker->timeout_ms, value, sizeof(value));
+
+        // Posted even if a newer request has come in, to be remembered.
+        pthread_mutex_lock(&prompt->lock);
+        free(worker->result_dir);
+        worker->result_dir = dir;
+        memcpy(worker->result, value, sizeof(value));
+        worker->result_timed_out = timed_out;
+        uint64_t one = 1;
+        write(prompt->notify, &one, sizeof(one));
+    }
+    pthread_mutex_unlock(&prompt->lock);
+    return NULL;
+}
+
+/**
+ * Makes the prompt from its pieces. A segment with nothing to show takes the
+ * space before it along, and control characters in the value of a segment,
+ * which could be anywhere in a path, are shown as '?'. Returns a boolean
+ * indicating whether the prompt has changed, which it does not if there is
+ * no memory for the new one.
+ */
+static int prompt_render(prompt_t * prompt)
+{
+    size_t text_capacity = 64;
+    size_t text_sz = 0;
+    char * text = malloc(text_capacity);
+    if (NULL == text) {
+        return 0;
+    }
+    for (size_t i = 0; i < prompt->pieces_sz; ++i) {
+        prompt_piece_t * piece = &prompt->pieces[i];
+        char buffer[PATH_MAX];
+        const char * value = buffer;
+        if (NULL != piece->text) {
+            value = piece->text;
+        } else if (NULL != piece->worker) {
+            value = piece->worker->value;
+        } else {
+            piece->run(prompt, prompt->dir, 0, buffer, sizeof(buffer));
+        }
+        size_t value_sz = strlen(value);
+        if (NULL == piece->text && 0 == value_sz && text_sz > 0 &&
+                ' ' == text[text_sz - 1]) {
+            text_sz--;
+        }
+        if (text_sz + value_sz + 1 > text_capacity) {
+            while (text_sz + value_sz + 1 > text_capacity) {
+                text_capacity *= 2;
+            }
+            char * grown = realloc(text, text_capacity);
+            if (NULL == grown) {
+                free(text);
+                return 0;
+            }
+            text = grown;
+        }
+        for (size_t j = 0; j < value_sz; ++j) {
+            unsigned char byte = value[j];
+            text[text_sz++] = (NULL == piece->text && (byte < 0x20 || 0x7f == byte)) ?
+                '?' : value[j];
+        }
+    }
+    text[text_sz] = '\0';
+    int changed = NULL == prompt->text || 0 != strcmp(prompt->text, text);
+    free(prompt->text);
+    prompt->text = text;
+    return changed;
+}
+
+/**
+ * Looks up the value remembered for dir, making it the most recently used.
+ */
+static prompt_cache_t * prompt_cache_find(prompt_worker_t * worker,
+                                          const char * dir)
+{
+    prompt_cache_t * entry;
+    DL_FOREACH(worker->cache, entry) {
+        if (0 == strcmp(entry->dir, dir)) {
+            DL_DELETE(worker->cache, entry);
+            DL_PREPEND(worker->cache, entry);
+            return entry;
+        }
+    }
+    return NULL;
+}
+
+/**
+ * Finds the git directory of the repository that dir is in, following a
+ * .git file, as worktrees and submodules have, to the directory it names.
+ * Returns 0 if dir is in no repository.
+ */
+static int prompt_git_dir(const char * dir,
+                          char * git_dir,
+                          size_t git_dir_sz)
+{
+    char path[PATH_MAX];
+    snprintf(path, sizeof(path), "%s", dir);
+    size_t path_sz = strlen(path);
+    while (1) {
+        snprintf(git_dir, git_dir_sz, "%.*s/.git", (int) path_sz, path);
+        struct stat st;
+        if (0 == stat(git_dir, &st)) {
+            if (S_ISDIR(st.st_mode)) {
+                return 1;
+            }
+            FILE * file = fopen(git_dir, "re");
+            if (NULL == file) {
+                return 0;
+            }
+            char line[PATH_MAX];
+            int found = NULL != fgets(line, sizeof(line), file) &&
+                0 == strncmp(line, "gitdir: ", 8);
+            fclose(file);
+            if (found) {
+                line[strcspn(line, "\n")] = '\0';
+                if ('/' == line[8]) {
+                    snprintf(git_dir, git_dir_sz, "%s", line + 8);
+                } else {
+                    snprintf(git_dir, git_dir_sz, "%.*s/%s", (int) path_sz, path, line + 8);
+                }
+            }
+            return found;
+        }
+        if (path_sz <= 1) {
+            return 0;
+        }
+        // Up to the parent, keeping the root's slash.
+        while (path_sz > 1 && '/' != path[path_sz - 1]) {
+            path_sz--;
+        }
+        if (path_sz > 1) {
+            path_sz--;
+        }
+    }
+}
+
+/**
+ * The working directory, with the home directory shown as ~.
+ */
+static int prompt_cwd(prompt_t * prompt,
+                      const char * dir,
+                      unsigned int timeout_ms,
+                      char * value,
+                      size_t value_sz)
+{
+    const char * home = getenv("HOME");
+    size_t home_sz = (NULL != home) ? strlen(home) : 0;
+    if (home_sz > 1 && 0 == strncmp(dir, home, home_sz) &&
+            ('/' == dir[home_sz] || '\0' == dir[home_sz])) {
+        snprintf(value, value_sz, "~%s", dir + home_sz);
+    } else {
+        snprintf(value, value_sz, "%s", dir);
+    }
+    return 1;
+}
+
+/**
+ * The exit status of the last pipeline, unless it succeeded.
+ */
+static int prompt_status(prompt_t * prompt,
+                         const char * dir,
+                         unsigned int timeout_ms,
+                         char * value,
+                         size_t value_sz)
+{
+    value[0] = '\0';
+    if (0 != prompt->status) {
+        snprintf(value, value_sz, "%d", prompt->status);
+    }
+    return 1;
+}
+
+/**
+ * How long the last pipeline ran, if it was at least PROMPT_DURATION_MIN_MS.
+ */
+static int prompt_duration(prompt_t * prompt,
+                           const char * dir,
+                           unsigned int timeout_ms,
+                           char * value,
+                           size_t value_sz)
+{
+    uint64_t ms = prompt->duration_ns / 1000000;
+    value[0] = '\0';
+    if (ms < PROMPT_DURATION_MIN_MS) {
+        return 1;
+    } else if (ms < 60000) {
+        snprintf(value, value_sz, "%.1fs", ms / 1000.0);
+    } else if (ms < 3600000) {
+        snprintf(value, value_sz, "%um%02us", (unsigned int) (ms / 60000),
+                 (unsigned int) (ms / 1000 % 60));
+    } else {
+        snprintf(value, value_sz, "%uh%02um", (unsigned int) (ms / 3600000),
+                 (unsigned int) (ms / 60000 % 60));
+    }
+    return 1;
+}
+
+/**
+ * The branch checked out in the repository that dir is in, read from its
+ * HEAD, or the abbreviated commit if none is.
+ */
+static int prompt_branch(prompt_t * prompt,
+                         const char * dir,
+                         unsigned int timeout_ms,
+                         char * value,
+                         size_t value_sz)
+{
+    char path[PATH_MAX];
+    value[0] = '\0';
+    if (!prompt_git_dir(dir, path, sizeof(path) - strlen("/HEAD"))) {
+        return 1;
+    }
+    strcat(path, "/HEAD");
+    FILE * head = fopen(path, "re");
+    if (NULL == head) {
+        return 1;
+    }
+    char line[PROMPT_VALUE_MAX];
+    if (NULL != fgets(line, sizeof(line), head)) {
+        line[strcspn(line, "\n")] = '\0';
+        if (0 == strncmp(line, "ref: refs/heads/", 16)) {
+            snprintf(value, value_sz, "%s", line + 16);
+        } else if (0 == strncmp(line, "ref: ", 5)) {
+            snprintf(value, value_sz, "%s", line + 5);
+        } else {
+            snprintf(value, value_sz, "%.7s", line);
+        }
+    }
+    fclose(head);
+    return 1;
+}
+
+/**
+ * '*' if a tracked file in the repository that dir is in has changes, as
+ * git status tells. git is stopped as soon as it reports the first one, and
+ * killed, leaving '?', if it takes longer than timeout_ms.
+ */
+static int prompt_dirty(prompt_t * prompt,
+                        const char * dir,
+                        unsigned int timeout_ms,
+                        char * value,
+                        size_t value_sz)
+{
+    char git_dir[PATH_MAX];
+    value[0] = '\0';
+    if (!prompt_git_dir(dir, git_dir, sizeof(git_dir))) {
+        return 1;
+    }
+    int output[2];
+    if (0 != pipe2(output, O_CLOEXEC)) {
+        return 1;
+    }
+    uint64_t deadline = stats_now() + (uint64_t) timeout_ms * 1000000;
+    pid_t pid = fork();
+    if (0 == pid) {
+        // A group of its own, so that whatever git starts is killed with it,
+        // and that the shell never waits for it along with a pipeline.
+        setpgid(0, 0);
+        signal(SIGPIPE, SIG_DFL);
+        int null = open("/dev/null", O_RDWR);
+        dup2(null, STDIN_FILENO);
+        dup2(output[1], STDOUT_FILENO);
+        dup2(null, STDERR_FILENO);
+        execlp("git", "git", "--no-optional-locks", "-C", dir, "status", "--porcelain",
+               "--untracked-files=no", "--ignore-submodules=dirty", (char *) NULL);
+        _exit(127);
+    }
+    close(output[1]);
+    if (pid < 0) {
+        close(output[0]);
+        return 1;
+    }
+    setpgid(pid, pid);
+    int done = 0;
+    int dirty = 0;
+    while (!done) {
+        int wait_ms = -1;
+        if (0 != timeout_ms) {
+            uint64_t now = stats_now();
+            if (now >= deadline) {
+                break;
+            }
+            wait_ms = (deadline - now) / 1000000 + 1;
+        }
+        struct pollfd fds[2] = {
+            { output[0], POLLIN, 0 },
+            { prompt->cancel, POLLIN, 0 }
+        };
+        if (poll(fds, 2, wait_ms) < 0) {
+            if (EINTR == errno) {
+                continue;
+            }
+            break;
+        }
+        if (fds[1].revents) {
+            break;
+        }
+        if (fds[0].revents) {
+            char byte;
+            ssize_t n = read(output[0], &byte, 1);
+            if (n >= 0) {
+                dirty = (n > 0);
+                done = 1;
+            } else if (EINTR != errno) {
+                break;
+            }
+        }
+    }
+    close(output[0]);
+    if (!done || dirty) {
+        kill(-pid, SIGKILL);
+    }
+    int status;
+    while (waitpid(pid, &status, 0) < 0 && EINTR == errno);
+    if (!done) {
+        snprintf(value, value_sz, "?");
+        return 0;
+    }
+    if (dirty) {
+        snprintf(value, value_sz, "*");
+    }
+    return 1;
+}
@@ -0,0 +1,88 @@
+#ifndef PROMPT_H_
+#define PROMPT_H_
+
+#include <stdint.h>
+
+/**
+ * The prompt used unless another is configured.
+ */
+#define PROMPT_DEFAULT "nephesh/\xd7\xa9\xd7\xa4\xd7\xa0> "
+
+/**
+ * The longest value a slow segment may have, in bytes.
+ */
+#define PROMPT_VALUE_MAX 256
+
+/**
+ * How long, in milliseconds, the value of a slow segment is used without
+ * being worked out again, unless a pipeline has run since.
+ */
+#define PROMPT_CACHE_MS 2000
+
+/**
+ * How long, in milliseconds, a slow segment that timed out in a directory
+ * is left alone there before it is tried again.
+ */
+#define PROMPT_BACKOFF_MS 30000
+
+/**
+ * The directories for which the values of each slow segment are kept.
+ */
+#define PROMPT_CACHE_MAX 16
+
+/**
+ * How long, in milliseconds, a pipeline must have run for the duration
+ * segment to show.
+ */
+#define PROMPT_DURATION_MIN_MS 2000
+
+/**
+ * A prompt made of literal text and segments such as {cwd} and {branch}.
+ * Segments that are quick to work out are worked out whenever the prompt is
+ * made; slow ones, which may have to wait on the file system or run a
+ * command, are worked out by worker threads, one per segment, and shown as
+ * they were last known until their results arrive.
+ */
+typedef struct prompt_t prompt_t;
+
+/**
+ * Parses format and starts a worker for each slow segment in it. Returns
+ * NULL, and writes a message to stderr, if the format is not understood.
+ */
+prompt_t * prompt_new(const char * format);
+void prompt_delete(prompt_t * prompt);
+
+/**
+ * Returns a file descriptor that becomes readable when the value of a slow
+ * segment arrives.
+ */
+int prompt_fd(prompt_t * prompt);
+
+/**
+ * Records how the last pipeline went, for the status and duration segments:
+ * its exit status and how long it ran. Slow segments are worked out afresh
+ * for the next prompt, as the pipeline may have changed what they show.
+ */
+void prompt_set_status(prompt_t * prompt,
+                       int status,
+                       uint64_t duration_ns);
+
+/**
+ * Makes the prompt for the working directory, without waiting on any slow
+ * segment, and has the workers bring theirs up to date.
+ */
+void prompt_begin(prompt_t * prompt);
+
+/**
+ * Takes in the values that have arrived from the workers. Returns a boolean
+ * indicating whether the prompt has changed.
+ */
+int prompt_update(prompt_t * prompt);
+
+/**
+ * Returns the prompt as last made, which stays valid until the next call to
+ * prompt_begin or prompt_update.
+ */
+const char * prompt_text(prompt_t * prompt);
+
+#endif
@@ -0,0 +1,123 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <utlist.h>
+#include "rewrite.h"
+#include "stats.h"
+
+static int rewrite_cat_input(command_t * commands,
+                             FILE * explain);
+static int rewrite_pass_through(command_t * commands,
+                                FILE * explain);
+static int rewrite_feeds_next(command_t * command);
+
+unsigned int rewrite_pipeline(command_t * commands,
+                              FILE * explain)
+{
+    const char * enabled = getenv("NEPHESH_REWRITE");
+    if (NULL == commands || (NULL != enabled && 0 == strcmp(enabled, "0"))) {
+        return 0;
+    }
+    unsigned int rewrites = 0;
+    int changed;
+    // Taking one cat out may leave another at the head or between two commands.
+    do {
+        changed = rewrite_cat_input(commands, explain) +
+                  rewrite_pass_through(commands, explain);
+        rewrites += changed;
+    } while (changed > 0);
+    stats_add(STATS_REWRITES, rewrites);
+    return rewrites;
+}
+
+/**
+ * Takes out cat FILE at the head of the pipeline when it feeds only the next
+ * command's input, which then reads FILE itself. Only a regular file is
+ * considered, so that opening it in the next command instead changes
+ * nothing but who reads it; a missing file is left for cat to report.
+ */
+static int rewrite_cat_input(command_t * commands,
+                             FILE * explain)
+{
+    command_t * cat = commands;
+    if (0 != strcmp(cat->argv[0], "cat") || !rewrite_feeds_next(cat)) {
+        return 0;
+    }
+    char * path;
+    if (2 == cat->argc && NULL == cat->input && '-' != cat->argv[1][0]) {
+        path = cat->argv[1];
+    } else if (1 == cat->argc && NULL != cat->input) {
+        path = cat->input;
+    } else {
+        return 0;
+    }
+    struct stat st;
+    if (0 != stat(path, &st) || !S_ISREG(st.st_mode)) {
+        return 0;
+    }
+    command_t * next = cat->next;
+    if (NULL != explain) {
+        fprintf(explain, "rewrite: %s reads %s itself instead of through cat\n",
+                next->argv[0], path);
+    }
+    // The head keeps its place in the list and takes on the next command.
+    char ** argv = cat->argv;
+    unsigned int argc = cat->argc;
+    unsigned int argv_capacity = cat->argv_capacity;
+    cat->argv = next->argv;
+    cat->argc = next->argc;
+    cat->argv_capacity = next->argv_capacity;
+    next->argv = argv;
+    next->argc = argc;
+    next->argv_capacity = argv_capacity;
+    memcpy(cat->pipes, next->pipes, sizeof(cat->pipes));
+    cat->pipec = next->pipec;
+    cat->input = path;
+    DL_DELETE(commands, next);
+    command_delete(next);
+    return 1;
+}
+
+/**
+ * Takes out a bare cat between two commands, when everything the command
+ * before it writes goes into its input and it writes only to the input of
+ * the command after it.
+ */
+static int rewrite_pass_through(command_t * commands,
+                                FILE * explain)
+{
+    command_t * command;
+    for (command = commands->next; NULL != command; command = command->next) {
+        if (0 != strcmp(command->argv[0], "cat") || NULL != command->input ||
+            !(1 == command->argc ||
+              (2 == command->argc && 0 == strcmp(command->argv[1], "-"))) ||
+            !rewrite_feeds_next(command)) {
+            continue;
+        }
+        command_t * prev = command->prev;
+        unsigned int i;
+        for (i = 0; i < prev->pipec && 0 == prev->pipes[i][1]; ++i);
+        if (i < prev->pipec) {
+            continue;
+        }
+        if (NULL != explain) {
+            fprintf(explain, "rewrite: cat between %s and %s is taken out\n",
+                    prev->argv[0], command->next->argv[0]);
+        }
+        DL_DELETE(commands, command);
+        command_delete(command);
+        return 1;
+    }
+    return 0;
+}
+
+/**
+ * Returns a boolean indicating whether command writes only its standard
+ * output, and that to the next command's input.
+ */
+static int rewrite_feeds_next(command_t * command)
+{
+    return NULL != command->next && 1 == command->pipec &&
+           1 == command->pipes[0][0] && 0 == command->pipes[0][1];
+}
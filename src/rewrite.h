@@ -0,0 +1,21 @@
+#ifndef REWRITE_H_
+#define REWRITE_H_
+
+#include <stdio.h>
+#include "command.h"
+
+/**
+ * Rewrites a parsed pipeline into one that writes the same output with less
+ * work, before it runs:
+ *   - cat FILE at the head, feeding only the next command's input, is taken
+ *     out and the next command reads FILE itself, so that it can seek in it;
+ *   - a bare cat that passes one command's output on to the next is taken
+ *     out, and the two are joined.
+ * The head of the pipeline stays the same node; removed commands are freed.
+ * Each change is described by a line written to explain, unless it is NULL.
+ * Does nothing if $NEPHESH_REWRITE is 0. Returns the number of changes.
+ */
+unsigned int rewrite_pipeline(command_t * commands,
+                              FILE * explain);
+
+#endif
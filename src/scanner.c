@@ -1,14 +1,30 @@
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <utlist.h>
 #include "scanner.h"
+#include "stats.h"
 
 struct scanner_t {
     char * str;
+    /**
+     * The string may be split in two, as the content of a gap buffer is:
+     * its first str_sz bytes are at str, and the rest, tail_sz bytes, at
+     * tail. A string that is not split ends at its NUL instead.
+     */
+    size_t str_sz;
+    const char * tail;
+    size_t tail_sz;
     unsigned int index;
+    int owned;
 };
 
+/**
+ * Returns the byte at offset index, or NUL past the end of the stream.
+ */
+static char scanner_byte(scanner_t * scanner,
+                         unsigned int index);
 /**
  * Returns the next byte in the stream.
  */
@@ -33,76 +49,111 @@ static void scanner_scan_string_quoted(scanner_t * scanner,
 
 scanner_t * scanner_new(const char * str)
 {
+    stats_allocated();
     scanner_t * scanner = malloc(sizeof(scanner_t));
     size_t len = strlen(str) + 1;
+    stats_allocated();
     scanner->str = malloc(sizeof(char) * len);
     memcpy(scanner->str, str, len);
+    scanner->str_sz = SIZE_MAX;
+    scanner->tail = NULL;
+    scanner->tail_sz = 0;
+    scanner->index = 0;
+    scanner->owned = 1;
+    return scanner;
+}
+
+scanner_t * scanner_view(const char * str)
+{
+    return scanner_view_split(str, SIZE_MAX, NULL, 0);
+}
+
+scanner_t * scanner_view_split(const char * str,
+                               size_t str_sz,
+                               const char * tail,
+                               size_t tail_sz)
+{
+    stats_allocated();
+    scanner_t * scanner = malloc(sizeof(scanner_t));
+    scanner->str = (char *) str;
+    scanner->str_sz = str_sz;
+    scanner->tail = tail;
+    scanner->tail_sz = tail_sz;
     scanner->index = 0;
+    scanner->owned = 0;
     return scanner;
 }
 
 void scanner_delete(scanner_t * scanner)
 {
-    free(scanner->str);
+    if (scanner->owned) {
+        free(scanner->str);
+    }
     free(scanner);
 }
 
 token_t * scanner_scan(scanner_t * scanner)
 {
     token_t * tokens = NULL;
+    token_t * next_token;
+    while (NULL != (next_token = scanner_next(scanner))) {
+        DL_APPEND(tokens, next_token);
+    }
+    return tokens;
+}
+
+token_t * scanner_next(scanner_t * scanner)
+{
     while (1) {
+        unsigned int start = scanner->index;
         char next_byte = scanner_advance(scanner);
-        token_t * next_token = malloc(sizeof(token_t));
+        token_t * next_token;
         switch (next_byte) {
             case '\0':
-                free(next_token);
-                return tokens;
+                return NULL;
 
             case '<':
-                next_token->type = TOKEN_TYPE_LT;
-                next_token->aux[0] = next_byte;
-                next_token->aux[1] = '\0';
-                DL_APPEND(tokens, next_token);
-                break;
-
             case '>':
-                next_token->type = TOKEN_TYPE_GT;
-                next_token->aux[0] = next_byte;
-                next_token->aux[1] = '\0';
-                DL_APPEND(tokens, next_token);
-                break;
-
             case '|':
-                next_token->type = TOKEN_TYPE_PIPE;
-                next_token->aux[0] = next_byte;
-                next_token->aux[1] = '\0';
-                DL_APPEND(tokens, next_token);
-                break;
-
             case '@':
-                next_token->type = TOKEN_TYPE_AT;
+                stats_allocated();
+                next_token = malloc(sizeof(token_t));
+                next_token->type = ('<' == next_byte) ? TOKEN_TYPE_LT
+                                 : ('>' == next_byte) ? TOKEN_TYPE_GT
+                                 : ('|' == next_byte) ? TOKEN_TYPE_PIPE
+                                 : TOKEN_TYPE_AT;
                 next_token->aux[0] = next_byte;
                 next_token->aux[1] = '\0';
-                DL_APPEND(tokens, next_token);
                 break;
 
             case ' ':
             case '\t':
-                break;
+                continue;
 
             case '\'':
+                stats_allocated();
+                next_token = malloc(sizeof(token_t));
                 scanner_scan_string_quoted(scanner, next_token);
-                DL_APPEND(tokens, next_token);
                 break;
 
             default:
+                stats_allocated();
+                next_token = malloc(sizeof(token_t));
                 scanner_scan_string(scanner, next_token, next_byte);
-                DL_APPEND(tokens, next_token);
                 break;
         }
+        next_token->start = start;
+        next_token->end = scanner->index;
+        return next_token;
     }
 }
 
+void scanner_seek(scanner_t * scanner,
+                  unsigned int index)
+{
+    scanner->index = index;
+}
+
 void token_debug_dump(token_t * tokens)
 {
     token_t * token = NULL;
@@ -165,14 +216,24 @@ static void scanner_scan_string_quoted(scanner_t * scanner,
     token->aux[i - 1] = '\0';
 }
 
+static char scanner_byte(scanner_t * scanner,
+                         unsigned int index)
+{
+    if (index < scanner->str_sz) {
+        return scanner->str[index];
+    }
+    index -= scanner->str_sz;
+    return (index < scanner->tail_sz) ? scanner->tail[index] : '\0';
+}
+
 static char scanner_peek(scanner_t * scanner)
 {
-    return scanner->str[scanner->index];
+    return scanner_byte(scanner, scanner->index);
 }
 
 static char scanner_advance(scanner_t * scanner)
 {
-    char next_byte = scanner->str[scanner->index];
+    char next_byte = scanner_byte(scanner, scanner->index);
     if ('\0' != next_byte) {
         scanner->index++;
     }
@@ -1,6 +1,8 @@
 #ifndef SCANNER_H_
 #define SCANNER_H_
 
+#include <stddef.h>
+
 #define TOKEN_MAX_SIZE 1024
 
 typedef enum token_type_t {
@@ -14,6 +16,12 @@ typedef enum token_type_t {
 typedef struct token_t {
     char aux[TOKEN_MAX_SIZE];
     token_type_t type;
+    /**
+     * The byte offsets of the start of the token in the scanned string and
+     * of the byte just past its end, quotes included.
+     */
+    unsigned int start;
+    unsigned int end;
     struct token_t * prev;
     struct token_t * next;
 } token_t;
@@ -21,6 +29,21 @@ typedef struct token_t {
 typedef struct scanner_t scanner_t;
 
 scanner_t * scanner_new(const char * str);
+/**
+ * Returns a scanner over str that does not copy it; str must outlive the
+ * scanner.
+ */
+scanner_t * scanner_view(const char * str);
+/**
+ * Returns a scanner that does not copy a string split in two, as the content
+ * of a gap buffer is: str_sz bytes at str followed by tail_sz bytes at tail.
+ * Neither part needs to be NUL-terminated, and both must outlive the
+ * scanner.
+ */
+scanner_t * scanner_view_split(const char * str,
+                               size_t str_sz,
+                               const char * tail,
+                               size_t tail_sz);
 void scanner_delete(scanner_t * scanner);
 
 /**
@@ -28,6 +51,20 @@ void scanner_delete(scanner_t * scanner);
  */
 token_t * scanner_scan(scanner_t * scanner);
 
+/**
+ * Returns the next token, or NULL at the end of the stream. The token
+ * belongs to the caller.
+ */
+token_t * scanner_next(scanner_t * scanner);
+
+/**
+ * Moves the scanner to byte offset index, which must be at most the length
+ * of the string. Scanning resumes from there as if from a fresh start, which
+ * makes it possible to rescan only part of a string that has changed.
+ */
+void scanner_seek(scanner_t * scanner,
+                  unsigned int index);
+
 void token_debug_dump(token_t * tokens);
 
 #endif
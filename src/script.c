@@ -0,0 +1,448 @@
+#include <errno.h>
+#include <fcntl.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <utlist.h>
+#include "script.h"
+#include "scanner.h"
+#include "parser.h"
+#include "hash.h"
+#include "io.h"
+#include "version.h"
+
+#define SCRIPT_CACHE_MAGIC "NFSC"
+
+/**
+ * Compiled scripts are a header followed by a stream of 32-bit words
+ * describing the pipelines, followed by a table of null terminated strings.
+ * For each pipeline the stream holds the number of commands and then, for
+ * each command, argc, pipec, argc string table offsets and pipec pairs of
+ * file descriptors. The image is position independent so that it can be used
+ * directly out of a read-only mapping.
+ */
+typedef struct script_header_t {
+    char magic[4];
+    uint32_t format;
+    unsigned char key[HASH_SIZE];
+    uint32_t pipeline_count;
+    uint32_t strings_offset;
+    uint32_t size;
+} script_header_t;
+
+typedef struct script_buffer_t {
+    char * data;
+    size_t sz;
+    size_t capacity;
+} script_buffer_t;
+
+struct script_t {
+    /**
+     * The compiled image, either mapped from the cache or built in memory.
+     * Command arguments point directly into it.
+     */
+    char * image;
+    size_t image_sz;
+    int mapped;
+    command_t ** pipelines;
+    unsigned int pipeline_count;
+};
+
+static void script_key(const char * source,
+                       size_t source_sz,
+                       unsigned char * key);
+static char * script_cache_path(const unsigned char * key);
+static char * script_cache_read(const char * cache_path,
+                                const unsigned char * key,
+                                size_t * image_sz);
+static void script_cache_write(const char * cache_path,
+                               const char * image,
+                               size_t image_sz);
+static char * script_compile(const char * path,
+                             const char * source,
+                             size_t source_sz,
+                             const unsigned char * key,
+                             size_t * image_sz);
+static int script_compile_pipeline(command_t * commands,
+                                   script_buffer_t * code,
+                                   script_buffer_t * strings);
+static int script_decode(script_t * script);
+static void script_release(script_t * script);
+static void script_buffer_append(script_buffer_t * buffer,
+                                 const void * data,
+                                 size_t data_sz);
+static void script_buffer_append_word(script_buffer_t * buffer,
+                                      uint32_t word);
+
+script_t * script_load(const char * path)
+{
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        fprintf(stderr, "%s: %s\n", path, strerror(errno));
+        return NULL;
+    }
+    struct stat st;
+    if (0 != fstat(fd, &st)) {
+        fprintf(stderr, "%s: %s\n", path, strerror(errno));
+        close(fd);
+        return NULL;
+    }
+    size_t source_sz = st.st_size;
+    char * source = NULL;
+    if (source_sz > 0) {
+        source = mmap(NULL, source_sz, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (MAP_FAILED == source) {
+            fprintf(stderr, "%s: %s\n", path, strerror(errno));
+            close(fd);
+            return NULL;
+        }
+    }
+    close(fd);
+
+    script_t * script = malloc(sizeof(script_t));
+    memset(script, 0, sizeof(script_t));
+
+    unsigned char key[HASH_SIZE];
+    script_key(source, source_sz, key);
+    char * cache_path = script_cache_path(key);
+    if (NULL != cache_path) {
+        script->image = script_cache_read(cache_path, key, &script->image_sz);
+        script->mapped = (NULL != script->image);
+        if (script->mapped && !script_decode(script)) {
+            // A damaged entry is simply replaced.
+            script_release(script);
+        }
+    }
+    int ok = script->mapped;
+    if (!ok) {
+        script->image = script_compile(path, source, source_sz, key,
+                                       &script->image_sz);
+        ok = (NULL != script->image && script_decode(script));
+        if (ok && NULL != cache_path) {
+            script_cache_write(cache_path, script->image, script->image_sz);
+        }
+    }
+    free(cache_path);
+    if (source_sz > 0) {
+        munmap(source, source_sz);
+    }
+    if (!ok) {
+        script_delete(script);
+        return NULL;
+    }
+    return script;
+}
+
+void script_delete(script_t * script)
+{
+    script_release(script);
+    free(script);
+}
+
+unsigned int script_pipeline_count(script_t * script)
+{
+    return script->pipeline_count;
+}
+
+command_t * script_pipeline(script_t * script,
+                            unsigned int i)
+{
+    return (i < script->pipeline_count) ? script->pipelines[i] : NULL;
+}
+
+/**
+ * Frees the decoded pipelines and the image, leaving an empty script.
+ */
+static void script_release(script_t * script)
+{
+    for (unsigned int i = 0; i < script->pipeline_count; ++i) {
+        command_t * t1, * t2;
+        DL_FOREACH_SAFE(script->pipelines[i], t1, t2) {
+            DL_DELETE(script->pipelines[i], t1);
+            command_delete(t1);
+        }
+    }
+    free(script->pipelines);
+    if (script->mapped) {
+        munmap(script->image, script->image_sz);
+    } else {
+        free(script->image);
+    }
+    memset(script, 0, sizeof(script_t));
+}
+
+static void script_key(const char * source,
+                       size_t source_sz,
+                       unsigned char * key)
+{
+    const char * version = "nephesh " NFSH_VERSION;
+    uint32_t format = SCRIPT_CACHE_FORMAT;
+    hash_t hash;
+    hash_init(&hash);
+    hash_update(&hash, version, strlen(version) + 1);
+    hash_update(&hash, &format, sizeof(format));
+    hash_update(&hash, source, source_sz);
+    hash_final(&hash, key);
+}
+
+/**
+ * Returns the path of the cache entry for key, creating the cache directory
+ * if necessary, or NULL if there is nowhere to cache.
+ */
+static char * script_cache_path(const unsigned char * key)
+{
+    char base[4096];
+    if (!io_xdg_dir("XDG_CACHE_HOME", ".cache", "nephesh/scripts", base, sizeof(base))) {
+        return NULL;
+    }
+    char hex[HASH_HEX_SIZE + 1];
+    hash_hex(key, hex);
+    size_t path_sz = strlen(base) + 1 + HASH_HEX_SIZE + 1;
+    char * path = malloc(path_sz);
+    snprintf(path, path_sz, "%s/%s", base, hex);
+    return path;
+}
+
+/**
+ * Maps a cache entry into memory. Returns NULL if there is no entry or it
+ * does not look like a complete image for key.
+ */
+static char * script_cache_read(const char * cache_path,
+                                const unsigned char * key,
+                                size_t * image_sz)
+{
+    int fd = open(cache_path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        return NULL;
+    }
+    struct stat st;
+    if (0 != fstat(fd, &st) || st.st_size < (off_t) sizeof(script_header_t)) {
+        close(fd);
+        return NULL;
+    }
+    char * image = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (MAP_FAILED == image) {
+        return NULL;
+    }
+    const script_header_t * header = (const script_header_t *) image;
+    if (0 != memcmp(header->magic, SCRIPT_CACHE_MAGIC, 4) ||
+            SCRIPT_CACHE_FORMAT != header->format ||
+            0 != memcmp(header->key, key, HASH_SIZE) ||
+            header->size != (uint64_t) st.st_size) {
+        munmap(image, st.st_size);
+        return NULL;
+    }
+    *image_sz = st.st_size;
+    return image;
+}
+
+static void script_cache_write(const char * cache_path,
+                               const char * image,
+                               size_t image_sz)
+{
+    // Write to a private name and rename into place, so that concurrent
+    // invocations never map a partially written entry.
+    size_t temp_sz = strlen(cache_path) + 32;
+    char * temp_path = malloc(temp_sz);
+    snprintf(temp_path, temp_sz, "%s.%ld.tmp", cache_path, (long) getpid());
+    int fd = open(temp_path, O_CREAT | O_EXCL | O_WRONLY | O_CLOEXEC, 0600);
+    if (fd < 0) {
+        free(temp_path);
+        return;
+    }
+    int written = io_write_all(fd, image, image_sz);
+    close(fd);
+    if (!written || 0 != rename(temp_path, cache_path)) {
+        unlink(temp_path);
+    }
+    free(temp_path);
+}
+
+/**
+ * Scans and parses every line of source into a compiled image. Empty lines
+ * and lines starting with '#' are skipped. Returns NULL and reports the
+ * offending line if any pipeline fails to parse.
+ */
+static char * script_compile(const char * path,
+                             const char * source,
+                             size_t source_sz,
+                             const unsigned char * key,
+                             size_t * image_sz)
+{
+    script_buffer_t code = { NULL, 0, 0 };
+    script_buffer_t strings = { NULL, 0, 0 };
+    uint32_t pipeline_count = 0;
+    unsigned int line_number = 0;
+    int ok = 1;
+    size_t start = 0;
+    while (ok && start < source_sz) {
+        line_number++;
+        const char * end = memchr(source + start, '\n', source_sz - start);
+        size_t line_sz = (NULL == end) ? source_sz - start
+                                       : (size_t) (end - source) - start;
+        char * line = malloc(line_sz + 1);
+        memcpy(line, source + start, line_sz);
+        line[line_sz] = '\0';
+        start += line_sz + 1;
+        const char * first = line + strspn(line, " \t");
+        if ('\0' == first[0] || '#' == first[0]) {
+            free(line);
+            continue;
+        }
+        scanner_t * scanner = scanner_new(line);
+        token_t * tokens = scanner_scan(scanner);
+        parser_t * parser = parser_new(tokens);
+        command_t * commands = parser_parse(parser);
+        if (NULL == commands) {
+            fprintf(stderr, "%s:%u: Parse error: %s\n", path, line_number,
+                    parser_get_error(parser));
+            ok = 0;
+        } else if (!script_compile_pipeline(commands, &code, &strings)) {
+            fprintf(stderr, "%s:%u: Pipeline too large.\n", path, line_number);
+            ok = 0;
+        } else {
+            pipeline_count++;
+        }
+        parser_delete(parser);
+        scanner_delete(scanner);
+        token_t * tt1, * tt2;
+        DL_FOREACH_SAFE(tokens, tt1, tt2) {
+            DL_DELETE(tokens, tt1);
+            free(tt1);
+        }
+        free(line);
+    }
+    char * image = NULL;
+    if (ok) {
+        script_header_t header;
+        memcpy(header.magic, SCRIPT_CACHE_MAGIC, 4);
+        header.format = SCRIPT_CACHE_FORMAT;
+        memcpy(header.key, key, HASH_SIZE);
+        header.pipeline_count = pipeline_count;
+        header.strings_offset = sizeof(header) + code.sz;
+        header.size = header.strings_offset + strings.sz;
+        *image_sz = header.size;
+        image = malloc(*image_sz);
+        memcpy(image, &header, sizeof(header));
+        if (code.sz > 0) {
+            memcpy(image + sizeof(header), code.data, code.sz);
+        }
+        if (strings.sz > 0) {
+            memcpy(image + header.strings_offset, strings.data, strings.sz);
+        }
+    }
+    free(code.data);
+    free(strings.data);
+    return image;
+}
+
+static int script_compile_pipeline(command_t * commands,
+                                   script_buffer_t * code,
+                                   script_buffer_t * strings)
+{
+    command_t * command = NULL;
+    uint32_t command_count = 0;
+    DL_COUNT(commands, command, command_count);
+    script_buffer_append_word(code, command_count);
+    DL_FOREACH(commands, command) {
+        script_buffer_append_word(code, command->argc);
+        script_buffer_append_word(code, command->pipec);
+        for (unsigned int i = 0; i < command->argc; ++i) {
+            if (strings->sz > UINT32_MAX / 2) {
+                return 0;
+            }
+            script_buffer_append_word(code, strings->sz);
+            script_buffer_append(strings, command->argv[i],
+                                 strlen(command->argv[i]) + 1);
+        }
+        for (unsigned int i = 0; i < command->pipec; ++i) {
+            script_buffer_append_word(code, (uint32_t) command->pipes[i][0]);
+            script_buffer_append_word(code, (uint32_t) command->pipes[i][1]);
+        }
+    }
+    return 1;
+}
+
+/**
+ * Rebuilds command lists from the image. Every count and offset is bounds
+ * checked, since the image may come from a damaged cache file.
+ */
+static int script_decode(script_t * script)
+{
+    const script_header_t * header = (const script_header_t *) script->image;
+    const uint32_t * word = (const uint32_t *) (script->image + sizeof(*header));
+    const uint32_t * words_end = (const uint32_t *) (script->image +
+                                                     header->strings_offset);
+    if (header->strings_offset < sizeof(*header) ||
+            header->strings_offset > script->image_sz ||
+            0 != (header->strings_offset % sizeof(uint32_t)) ||
+            (script->image_sz > header->strings_offset &&
+             '\0' != script->image[script->image_sz - 1])) {
+        return 0;
+    }
+    const char * strings = script->image + header->strings_offset;
+    size_t strings_sz = script->image_sz - header->strings_offset;
+    if (header->pipeline_count > (size_t) (words_end - word)) {
+        return 0;
+    }
+    script->pipelines = calloc(header->pipeline_count + 1, sizeof(command_t *));
+    for (unsigned int p = 0; p < header->pipeline_count; ++p) {
+        if (word >= words_end) {
+            return 0;
+        }
+        uint32_t command_count = *word++;
+        script->pipeline_count++;
+        for (unsigned int c = 0; c < command_count; ++c) {
+            if (words_end - word < 2) {
+                return 0;
+            }
+            uint32_t argc = *word++;
+            uint32_t pipec = *word++;
+            if (argc < 1 || pipec > COMMAND_MAX_PIPES ||
+                    (size_t) (words_end - word) < argc + 2 * (size_t) pipec) {
+                return 0;
+            }
+            command_t * command = command_new();
+            if (NULL == command) {
+                return 0;
+            }
+            DL_APPEND(script->pipelines[p], command);
+            for (unsigned int i = 0; i < argc; ++i) {
+                uint32_t offset = *word++;
+                if (offset >= strings_sz ||
+                        !command_add_arg(command, (char *) strings + offset)) {
+                    return 0;
+                }
+            }
+            for (unsigned int i = 0; i < pipec; ++i) {
+                command->pipes[i][0] = (int) *word++;
+                command->pipes[i][1] = (int) *word++;
+            }
+            command->pipec = pipec;
+        }
+    }
+    return 1;
+}
+
+static void script_buffer_append(script_buffer_t * buffer,
+                                 const void * data,
+                                 size_t data_sz)
+{
+    if (buffer->sz + data_sz > buffer->capacity) {
+        buffer->capacity = 2 * (buffer->sz + data_sz) + 64;
+        buffer->data = realloc(buffer->data, buffer->capacity);
+    }
+    memcpy(buffer->data + buffer->sz, data, data_sz);
+    buffer->sz += data_sz;
+}
+
+static void script_buffer_append_word(script_buffer_t * buffer,
+                                      uint32_t word)
+{
+    script_buffer_append(buffer, &word, sizeof(word));
+}
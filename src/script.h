@@ -0,0 +1,33 @@
+#ifndef SCRIPT_H_
+#define SCRIPT_H_
+
+#include "command.h"
+
+/**
+ * Format revision of the compiled script cache. Bump whenever the on-disk
+ * layout changes.
+ */
+#define SCRIPT_CACHE_FORMAT 1
+
+typedef struct script_t script_t;
+
+/**
+ * Loads the script at path as a sequence of pipelines, one per non-empty
+ * line. A compiled form of the script is kept in the user's cache directory,
+ * keyed by the script's content and the shell version, so that subsequent
+ * loads of an unchanged script map it into memory instead of scanning and
+ * parsing it again. Returns NULL on failure with a message on stderr.
+ */
+script_t * script_load(const char * path);
+void script_delete(script_t * script);
+
+unsigned int script_pipeline_count(script_t * script);
+
+/**
+ * Returns the commands of the i-th pipeline. They remain owned by the script
+ * and are valid until script_delete.
+ */
+command_t * script_pipeline(script_t * script,
+                            unsigned int i);
+
+#endif
@@ -0,0 +1,443 @@
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <wait.h>
+#include "shard.h"
+#include "io.h"
+
+/**
+ * Bytes read or written at a time.
+ */
+#define SHARD_BUFFER_SIZE 65536
+
+/**
+ * A copy of the command, running on one chunk. Its output is held back
+ * until every copy before it has finished, and written straight through
+ * from then on.
+ */
+typedef struct shard_job_t {
+    pid_t pid;
+    /**
+     * The pipe to its standard input, until the chunk has been written, and
+     * that from its standard output, until end of file.
+     */
+    int input;
+    int output;
+    char * chunk;
+    size_t chunk_sz;
+    size_t chunk_written;
+    char * held;
+    size_t held_sz;
+    size_t held_capacity;
+} shard_job_t;
+
+typedef struct shard_t {
+    char * const * argv;
+    char delimiter;
+    /**
+     * The running copies, a ring of jobs_max in the order of their chunks,
+     * starting at head.
+     */
+    shard_job_t * jobs;
+    unsigned int jobs_max;
+    unsigned int jobs_sz;
+    unsigned int head;
+    /**
+     * Input read but not yet handed out.
+     */
+    char * pending;
+    size_t pending_sz;
+    size_t pending_capacity;
+    int input_done;
+    int status;
+} shard_t;
+
+static pid_t shard_reduce(const char * reduce);
+static size_t shard_cut(shard_t * shard);
+static int shard_spawn(shard_t * shard,
+                       size_t chunk_sz);
+static int shard_read_input(shard_t * shard);
+static void shard_feed(shard_job_t * job);
+static int shard_drain(shard_t * shard,
+                       shard_job_t * job,
+                       int is_head);
+static int shard_retire(shard_t * shard);
+static void shard_reap(shard_t * shard,
+                       shard_job_t * job);
+
+int shard_run(char * const argv[])
+{
+    const char * usage = "Usage: shard [-z] [-r REDUCE] N COMMAND [ARG]...\n";
+    shard_t shard;
+    memset(&shard, 0, sizeof(shard));
+    shard.delimiter = '\n';
+    const char * reduce = NULL;
+    unsigned int i = 1;
+    while (NULL != argv[i]) {
+        if (0 == strcmp(argv[i], "-z")) {
+            shard.delimiter = '\0';
+            i++;
+        } else if (0 == strcmp(argv[i], "-r") && NULL != argv[i + 1]) {
+            reduce = argv[i + 1];
+            i += 2;
+        } else {
+            break;
+        }
+    }
+    char * end = NULL;
+    long jobs_max = (NULL != argv[i]) ? strtol(argv[i], &end, 10) : 0;
+    if (NULL == end || '\0' != *end || jobs_max < 1 || jobs_max > SHARD_MAX ||
+            NULL == argv[i + 1]) {
+        fputs(usage, stderr);
+        return 2;
+    }
+    shard.argv = &argv[i + 1];
+    shard.jobs_max = jobs_max;
+    shard.jobs = calloc(shard.jobs_max, sizeof(shard_job_t));
+    struct pollfd * fds = calloc(2 * shard.jobs_max + 1, sizeof(struct pollfd));
+    if (NULL == shard.jobs || NULL == fds) {
+        fputs("shard: out of memory\n", stderr);
+        return 1;
+    }
+    // Copies that stop reading early show up as write errors.
+    signal(SIGPIPE, SIG_IGN);
+    pid_t reducer = (NULL != reduce) ? shard_reduce(reduce) : -1;
+    if (NULL != reduce && reducer < 0) {
+        free(shard.jobs);
+        free(fds);
+        return 1;
+    }
+    int broken = 0;
+    while (!broken && !(shard.input_done && 0 == shard.pending_sz && 0 == shard.jobs_sz)) {
+        // Hand out whole chunks while there is room for another copy, and
+        // read more input only when there is no chunk to hand out.
+        size_t cut = shard_cut(&shard);
+        if (cut > 0 && shard.jobs_sz < shard.jobs_max) {
+            if (!shard_spawn(&shard, cut)) {
+                broken = 1;
+            }
+            continue;
+        }
+        nfds_t fds_sz = 0;
+        if (0 == cut && !shard.input_done) {
+            fds[fds_sz].fd = STDIN_FILENO;
+            fds[fds_sz++].events = POLLIN;
+        }
+        for (unsigned int j = 0; j < shard.jobs_sz; ++j) {
+            shard_job_t * job = &shard.jobs[(shard.head + j) % shard.jobs_max];
+            if (job->input >= 0) {
+                fds[fds_sz].fd = job->input;
+                fds[fds_sz++].events = POLLOUT;
+            }
+            if (job->output >= 0) {
+                fds[fds_sz].fd = job->output;
+                fds[fds_sz++].events = POLLIN;
+            }
+        }
+        if (poll(fds, fds_sz, -1) < 0) {
+            if (EINTR == errno) {
+                continue;
+            }
+            perror("shard");
+            break;
+        }
+        nfds_t k = 0;
+        if (0 == cut && !shard.input_done) {
+            if (0 != fds[k++].revents && !shard_read_input(&shard)) {
+                broken = 1;
+            }
+        }
+        for (unsigned int j = 0; j < shard.jobs_sz; ++j) {
+            shard_job_t * job = &shard.jobs[(shard.head + j) % shard.jobs_max];
+            if (job->input >= 0 && 0 != fds[k++].revents) {
+                shard_feed(job);
+            }
+            if (job->output >= 0 && 0 != fds[k++].revents &&
+                    !shard_drain(&shard, job, 0 == j)) {
+                broken = 1;
+            }
+        }
+        if (!shard_retire(&shard)) {
+            broken = 1;
+        }
+    }
+    // Whatever still runs is of no use once the output has gone away.
+    while (shard.jobs_sz > 0) {
+        shard_job_t * job = &shard.jobs[shard.head];
+        kill(job->pid, SIGTERM);
+        shard_reap(&shard, job);
+        shard.head = (shard.head + 1) % shard.jobs_max;
+        shard.jobs_sz--;
+    }
+    free(shard.pending);
+    free(shard.jobs);
+    free(fds);
+    if (reducer >= 0) {
+        // The reduction ends with the last output.
+        close(STDOUT_FILENO);
+        shard_job_t job = { .pid = reducer, .input = -1, .output = -1 };
+        shard_reap(&shard, &job);
+    }
+    return broken ? 1 : shard.status;
+}
+
+/**
+ * Starts reduce, run by sh, on everything written to standard output from
+ * here on: the outputs of the copies, in order. Returns its process, or -1
+ * if it could not be started.
+ */
+static pid_t shard_reduce(const char * reduce)
+{
+    int pipefd[2];
+    if (0 != pipe2(pipefd, O_CLOEXEC)) {
+        perror("shard");
+        return -1;
+    }
+    pid_t pid = fork();
+    if (pid < 0) {
+        perror("shard");
+        close(pipefd[0]);
+        close(pipefd[1]);
+        return -1;
+    }
+    if (0 == pid) {
+        dup2(pipefd[0], STDIN_FILENO);
+        signal(SIGPIPE, SIG_DFL);
+        execl("/bin/sh", "sh", "-c", reduce, (char *) NULL);
+        fprintf(stderr, "sh: %s\n", strerror(errno));
+        _exit(127);
+    }
+    dup2(pipefd[1], STDOUT_FILENO);
+    close(pipefd[0]);
+    close(pipefd[1]);
+    return pid;
+}
+
+/**
+ * Returns how many bytes of pending input make the next chunk: whole
+ * records, at least SHARD_CHUNK_SIZE of them unless the input has ended, or
+ * 0 if there is not enough yet.
+ */
+static size_t shard_cut(shard_t * shard)
+{
+    if (0 == shard->pending_sz) {
+        return 0;
+    }
+    if (shard->pending_sz < SHARD_CHUNK_SIZE) {
+        return shard->input_done ? shard->pending_sz : 0;
+    }
+    const char * last = memrchr(shard->pending, shard->delimiter, shard->pending_sz);
+    if (NULL == last) {
+        return shard->input_done ? shard->pending_sz : 0;
+    }
+    return (size_t) (last - shard->pending) + 1;
+}
+
+/**
+ * Starts a copy of the command on the first chunk_sz bytes of pending
+ * input. Returns a boolean indicating success.
+ */
+static int shard_spawn(shard_t * shard,
+                       size_t chunk_sz)
+{
+    shard_job_t * job = &shard->jobs[(shard->head + shard->jobs_sz) % shard->jobs_max];
+    memset(job, 0, sizeof(shard_job_t));
+    job->chunk = malloc(chunk_sz);
+    if (NULL == job->chunk) {
+        fputs("shard: out of memory\n", stderr);
+        return 0;
+    }
+    memcpy(job->chunk, shard->pending, chunk_sz);
+    job->chunk_sz = chunk_sz;
+    memmove(shard->pending, &shard->pending[chunk_sz], shard->pending_sz - chunk_sz);
+    shard->pending_sz -= chunk_sz;
+    int input[2];
+    int output[2];
+    if (0 != pipe2(input, O_CLOEXEC)) {
+        goto error0;
+    }
+    if (0 != pipe2(output, O_CLOEXEC)) {
+        goto error1;
+    }
+    job->pid = fork();
+    if (job->pid < 0) {
+        goto error2;
+    }
+    if (0 == job->pid) {
+        dup2(input[0], STDIN_FILENO);
+        dup2(output[1], STDOUT_FILENO);
+        signal(SIGPIPE, SIG_DFL);
+        execvp(shard->argv[0], shard->argv);
+        fprintf(stderr, "%s: %s\n", shard->argv[0], strerror(errno));
+        _exit(127);
+    }
+    close(input[0]);
+    close(output[1]);
+    // The chunk is written as the copy takes it, between reads of outputs.
+    fcntl(input[1], F_SETFL, O_NONBLOCK);
+    job->input = input[1];
+    job->output = output[0];
+    shard->jobs_sz++;
+    return 1;
+error2:
+    close(output[0]);
+    close(output[1]);
+error1:
+    close(input[0]);
+    close(input[1]);
+error0:
+    perror("shard");
+    free(job->chunk);
+    job->chunk = NULL;
+    return 0;
+}
+
+/**
+ * Reads what input is available into pending. Returns a boolean indicating
+ * success; end of file is success.
+ */
+static int shard_read_input(shard_t * shard)
+{
+    if (shard->pending_capacity - shard->pending_sz < SHARD_BUFFER_SIZE) {
+        size_t capacity = 2 * shard->pending_capacity + SHARD_BUFFER_SIZE;
+        char * grown = realloc(shard->pending, capacity);
+        if (NULL == grown) {
+            fputs("shard: out of memory\n", stderr);
+            return 0;
+        }
+        shard->pending = grown;
+        shard->pending_capacity = capacity;
+    }
+    ssize_t n = read(STDIN_FILENO, &shard->pending[shard->pending_sz], SHARD_BUFFER_SIZE);
+    if (n < 0) {
+        if (EINTR == errno || EAGAIN == errno) {
+            return 1;
+        }
+        perror("shard");
+        return 0;
+    }
+    if (0 == n) {
+        shard->input_done = 1;
+    }
+    shard->pending_sz += n;
+    return 1;
+}
+
+/**
+ * Writes as much of the chunk to the copy as it takes without blocking, and
+ * closes its input once it has the whole chunk or has stopped reading.
+ */
+static void shard_feed(shard_job_t * job)
+{
+    size_t left = job->chunk_sz - job->chunk_written;
+    ssize_t n = write(job->input, &job->chunk[job->chunk_written],
+                      (left < SHARD_BUFFER_SIZE) ? left : SHARD_BUFFER_SIZE);
+    if (n > 0) {
+        job->chunk_written += n;
+    } else if (n < 0 && EINTR != errno && EAGAIN != errno) {
+        job->chunk_written = job->chunk_sz;
+    }
+    if (job->chunk_written == job->chunk_sz) {
+        close(job->input);
+        job->input = -1;
+        free(job->chunk);
+        job->chunk = NULL;
+    }
+}
+
+/**
+ * Reads what output the copy has, writing it out if the copy is at the head
+ * and holding it back otherwise. Returns 0 if the output has gone away.
+ */
+static int shard_drain(shard_t * shard,
+                       shard_job_t * job,
+                       int is_head)
+{
+    char buffer[SHARD_BUFFER_SIZE];
+    ssize_t n = read(job->output, buffer, sizeof(buffer));
+    if (n < 0 && EINTR == errno) {
+        return 1;
+    }
+    if (n <= 0) {
+        close(job->output);
+        job->output = -1;
+        return 1;
+    }
+    if (is_head) {
+        return io_write_all(STDOUT_FILENO, buffer, n);
+    }
+    if (job->held_capacity - job->held_sz < (size_t) n) {
+        size_t capacity = 2 * job->held_capacity + n;
+        char * grown = realloc(job->held, capacity);
+        if (NULL == grown) {
+            fputs("shard: out of memory\n", stderr);
+            return 0;
+        }
+        job->held = grown;
+        job->held_capacity = capacity;
+    }
+    memcpy(&job->held[job->held_sz], buffer, n);
+    job->held_sz += n;
+    return 1;
+}
+
+/**
+ * Retires the copies at the head that have finished, writing out what the
+ * next one has held back. Returns 0 if the output has gone away.
+ */
+static int shard_retire(shard_t * shard)
+{
+    while (shard->jobs_sz > 0) {
+        shard_job_t * job = &shard->jobs[shard->head];
+        if (job->output >= 0) {
+            return 1;
+        }
+        shard_reap(shard, job);
+        shard->head = (shard->head + 1) % shard->jobs_max;
+        shard->jobs_sz--;
+        if (shard->jobs_sz > 0) {
+            shard_job_t * next = &shard->jobs[shard->head];
+            int written = io_write_all(STDOUT_FILENO, next->held, next->held_sz);
+            free(next->held);
+            next->held = NULL;
+            next->held_sz = next->held_capacity = 0;
+            if (!written) {
+                return 0;
+            }
+        }
+    }
+    return 1;
+}
+
+/**
+ * Waits for the copy to exit, keeping the highest exit status, and releases
+ * what it holds.
+ */
+static void shard_reap(shard_t * shard,
+                       shard_job_t * job)
+{
+    if (job->input >= 0) {
+        close(job->input);
+    }
+    if (job->output >= 0) {
+        close(job->output);
+    }
+    int status;
+    while (waitpid(job->pid, &status, 0) < 0) {
+        if (EINTR != errno) {
+            status = 0;
+            break;
+        }
+    }
+    int code = WIFSIGNALED(status) ? 128 + WTERMSIG(status) : WEXITSTATUS(status);
+    if (code > shard->status) {
+        shard->status = code;
+    }
+    free(job->chunk);
+    free(job->held);
+}
@@ -0,0 +1,26 @@
+#ifndef SHARD_H_
+#define SHARD_H_
+
+/**
+ * Bytes of input handed to each copy of the command, give or take a record.
+ */
+#define SHARD_CHUNK_SIZE (1 << 20)
+
+/**
+ * The most copies of the command that may run at once.
+ */
+#define SHARD_MAX 1024
+
+/**
+ * Runs `shard [-z] [-r REDUCE] N COMMAND [ARG]...`: splits standard input
+ * into chunks of whole records, which are lines or, with -z, NUL-terminated,
+ * runs a copy of COMMAND on each chunk, at most N at a time, and writes the
+ * outputs of the copies to standard output in the order of their chunks, or
+ * to the shell command REDUCE, run by sh, which combines them. Meant to be
+ * run by a forked stage, in place of executing a command. Returns the exit
+ * status: the highest of any copy and of REDUCE, or 2 if argv is not
+ * understood.
+ */
+int shard_run(char * const argv[]);
+
+#endif
@@ -0,0 +1,187 @@
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "stats.h"
+
+typedef struct stats_histogram_data_t {
+    uint64_t count;
+    uint64_t sum;
+    uint64_t min;
+    uint64_t max;
+    uint64_t buckets[STATS_BUCKETS];
+} stats_histogram_data_t;
+
+static const char * stats_counter_names[STATS_COUNTERS_SZ] = {
+    "lines",
+    "stages",
+    "exec_failures",
+    "filter_stages",
+    "rewrites"
+};
+
+static const char * stats_histogram_names[STATS_HISTOGRAMS_SZ] = {
+    "scan_ns",
+    "parse_ns",
+    "fork_ns",
+    "exec_ns",
+    "dispatch_ns",
+    "redraw_bytes",
+    "line_allocations"
+};
+
+static uint64_t stats_counters[STATS_COUNTERS_SZ];
+static stats_histogram_data_t stats_histograms[STATS_HISTOGRAMS_SZ];
+static uint64_t stats_allocation_count;
+/**
+ * The verbosity, or -1 until $NEPHESH_VERBOSE has been read.
+ */
+static int stats_verbosity_level = -1;
+
+static unsigned int stats_bucket(uint64_t value);
+static uint64_t stats_quantile(const stats_histogram_data_t * data,
+                               double q);
+
+void stats_add(stats_counter_t counter,
+               uint64_t n)
+{
+    stats_counters[counter] += n;
+}
+
+void stats_record(stats_histogram_t histogram,
+                  uint64_t value)
+{
+    stats_histogram_data_t * data = &stats_histograms[histogram];
+    if (0 == data->count || value < data->min) {
+        data->min = value;
+    }
+    if (value > data->max) {
+        data->max = value;
+    }
+    data->count++;
+    data->sum += value;
+    data->buckets[stats_bucket(value)]++;
+}
+
+uint64_t stats_now(void)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t) now.tv_sec * 1000000000 + now.tv_nsec;
+}
+
+void stats_allocated(void)
+{
+    stats_allocation_count++;
+}
+
+uint64_t stats_allocations(void)
+{
+    return stats_allocation_count;
+}
+
+void stats_reset(void)
+{
+    memset(stats_counters, 0, sizeof(stats_counters));
+    memset(stats_histograms, 0, sizeof(stats_histograms));
+}
+
+void stats_print(FILE * out)
+{
+    for (unsigned int i = 0; i < STATS_COUNTERS_SZ; ++i) {
+        fprintf(out, "%-17s %llu\n", stats_counter_names[i],
+                (unsigned long long) stats_counters[i]);
+    }
+    fprintf(out, "%-17s %llu\n", "allocations",
+            (unsigned long long) stats_allocations());
+    fprintf(out, "%-17s %10s %10s %10s %10s %10s %10s\n",
+            "", "count", "min", "mean", "p50", "p99", "max");
+    for (unsigned int i = 0; i < STATS_HISTOGRAMS_SZ; ++i) {
+        const stats_histogram_data_t * data = &stats_histograms[i];
+        fprintf(out, "%-17s %10llu %10llu %10llu %10llu %10llu %10llu\n",
+                stats_histogram_names[i],
+                (unsigned long long) data->count,
+                (unsigned long long) data->min,
+                (unsigned long long) (data->count ? data->sum / data->count : 0),
+                (unsigned long long) stats_quantile(data, 0.5),
+                (unsigned long long) stats_quantile(data, 0.99),
+                (unsigned long long) data->max);
+    }
+}
+
+void stats_print_json(FILE * out)
+{
+    fputs("{\"counters\":{", out);
+    for (unsigned int i = 0; i < STATS_COUNTERS_SZ; ++i) {
+        fprintf(out, "\"%s\":%llu,", stats_counter_names[i],
+                (unsigned long long) stats_counters[i]);
+    }
+    fprintf(out, "\"allocations\":%llu},\"histograms\":{",
+            (unsigned long long) stats_allocations());
+    for (unsigned int i = 0; i < STATS_HISTOGRAMS_SZ; ++i) {
+        const stats_histogram_data_t * data = &stats_histograms[i];
+        fprintf(out, "%s\"%s\":{\"count\":%llu,\"sum\":%llu,\"min\":%llu,"
+                "\"max\":%llu,\"buckets\":[", (0 == i) ? "" : ",",
+                stats_histogram_names[i],
+                (unsigned long long) data->count, (unsigned long long) data->sum,
+                (unsigned long long) data->min, (unsigned long long) data->max);
+        // Only the buckets in use, as [upper bound, count] pairs.
+        int first = 1;
+        for (unsigned int j = 0; j < STATS_BUCKETS; ++j) {
+            if (0 == data->buckets[j]) {
+                continue;
+            }
+            fprintf(out, "%s[%llu,%llu]", first ? "" : ",",
+                    (unsigned long long) ((0 == j) ? 0 : UINT64_MAX >> (64 - j)),
+                    (unsigned long long) data->buckets[j]);
+            first = 0;
+        }
+        fputs("]}", out);
+    }
+    fputs("}}\n", out);
+}
+
+int stats_verbosity(void)
+{
+    if (stats_verbosity_level < 0) {
+        const char * env = getenv("NEPHESH_VERBOSE");
+        stats_verbosity_level = (NULL != env) ? atoi(env) : 0;
+    }
+    return stats_verbosity_level;
+}
+
+void stats_set_verbosity(int verbosity)
+{
+    stats_verbosity_level = (verbosity < 0) ? 0 : verbosity;
+}
+
+static unsigned int stats_bucket(uint64_t value)
+{
+    return (0 == value) ? 0 : 64 - __builtin_clzll(value);
+}
+
+/**
+ * Returns the upper bound of the bucket the q-quantile falls in, or the
+ * maximum if that is lower.
+ */
+static uint64_t stats_quantile(const stats_histogram_data_t * data,
+                               double q)
+{
+    if (0 == data->count) {
+        return 0;
+    }
+    // The nearest rank: the smallest value with at least q of all at or
+    // below it.
+    uint64_t rank = (uint64_t) (q * data->count);
+    if (rank < q * data->count || 0 == rank) {
+        rank++;
+    }
+    uint64_t seen = 0;
+    for (unsigned int i = 0; i < STATS_BUCKETS; ++i) {
+        seen += data->buckets[i];
+        if (seen >= rank) {
+            uint64_t upper = (0 == i) ? 0 : UINT64_MAX >> (64 - i);
+            return (upper < data->max) ? upper : data->max;
+        }
+    }
+    return data->max;
+}
@@ -0,0 +1,97 @@
+#ifndef STATS_H_
+#define STATS_H_
+
+#include <stdint.h>
+#include <stdio.h>
+
+/**
+ * Histograms have one bucket per power of two: bucket 0 holds zero, and
+ * bucket i holds values from 2^(i-1) up to 2^i - 1.
+ */
+#define STATS_BUCKETS 65
+
+/**
+ * Running totals.
+ */
+typedef enum stats_counter_t {
+    STATS_LINES,
+    STATS_STAGES,
+    STATS_EXEC_FAILURES,
+    /**
+     * Stages run by a built-in filter rather than forked, out of all stages.
+     */
+    STATS_FILTER_STAGES,
+    /**
+     * Changes made to pipelines by the rewrite pass before they run.
+     */
+    STATS_REWRITES,
+    STATS_COUNTERS_SZ
+} stats_counter_t;
+
+/**
+ * Distributions of values, times being in nanoseconds.
+ */
+typedef enum stats_histogram_t {
+    STATS_SCAN_NS,
+    STATS_PARSE_NS,
+    /**
+     * How long fork takes in the shell, and how long after it the command
+     * has been executed.
+     */
+    STATS_FORK_NS,
+    STATS_EXEC_NS,
+    /**
+     * How long it takes to act on a key, and how many bytes each redraw
+     * sends to the terminal.
+     */
+    STATS_DISPATCH_NS,
+    STATS_REDRAW_BYTES,
+    /**
+     * Memory allocations made to scan, parse and run a line, and to
+     * highlight it as it is typed.
+     */
+    STATS_LINE_ALLOCATIONS,
+    STATS_HISTOGRAMS_SZ
+} stats_histogram_t;
+
+/**
+ * The shell's own instrumentation: a fixed set of counters and histograms
+ * that cost a few additions to update, so that they can always be on. They
+ * are only updated from the main thread.
+ */
+void stats_add(stats_counter_t counter,
+               uint64_t n);
+void stats_record(stats_histogram_t histogram,
+                  uint64_t value);
+
+/**
+ * Returns a monotonic time in nanoseconds, for measuring intervals.
+ */
+uint64_t stats_now(void);
+
+/**
+ * Memory allocations are counted where the scanner, the parser and exec
+ * make them, each calling stats_allocated next to its own, and
+ * stats_allocations returns how many have been counted so far. Allocations
+ * made elsewhere, such as by worker threads or the C library, are not.
+ */
+void stats_allocated(void);
+uint64_t stats_allocations(void);
+
+void stats_reset(void);
+
+/**
+ * Writes every counter and histogram to out, as aligned text or as a JSON
+ * object.
+ */
+void stats_print(FILE * out);
+void stats_print_json(FILE * out);
+
+/**
+ * How much the shell says about what it does on stderr: at 0 nothing, at 1
+ * the tokens and commands of every line. Starts out as $NEPHESH_VERBOSE.
+ */
+int stats_verbosity(void);
+void stats_set_verbosity(int verbosity);
+
+#endif
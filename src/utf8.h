@@ -5,17 +5,74 @@
 
 /**
  * Maximum number of bytes necessary to encode *any* code point in UTF-8.
+ * RFC 3629 restricts UTF-8 to U+10FFFF, which needs at most four bytes.
  */
-#define U8_MAX_BYTES 6
+#define U8_MAX_BYTES 4
 
+/**
+ * Returns the number of code points in the first str_sz bytes of str, which
+ * is assumed to be valid UTF-8 (see u8_validate). Counting is done a machine
+ * word (or vector register) at a time.
+ */
 unsigned int u8_strlen_b(const char * str,
                          size_t str_sz);
 
 unsigned int u8_strlen(const char * str);
 
+/**
+ * Returns the byte offset of the n-th code point of the first str_sz bytes of
+ * str, or str_sz if there are fewer than n code points.
+ */
+unsigned int u8_byte_offset_b(const char * str,
+                              size_t str_sz,
+                              unsigned int n);
+
 unsigned int u8_byte_offset(const char * str,
                             unsigned int n);
 
+/**
+ * Returns the total length of the UTF-8 sequence introduced by lead, or 0 if
+ * lead cannot start a well-formed sequence.
+ */
+size_t u8_sequence_sz(char lead);
+
+/**
+ * Returns the length of the longest prefix of str that is well-formed UTF-8,
+ * so a return value of str_sz means the whole string is valid. Overlong
+ * encodings, surrogates, code points above U+10FFFF and truncated sequences
+ * are rejected.
+ */
+size_t u8_validate(const char * str,
+                   size_t str_sz);
+
+/**
+ * Returns the code point encoded by the well-formed sequence at str.
+ */
+unsigned int u8_decode(const char * str);
+
+/**
+ * Returns the byte offset of the code point preceding byte offset i of str,
+ * or 0 if i is 0.
+ */
+size_t u8_prev(const char * str,
+               size_t i);
+
+/**
+ * Returns the number of terminal columns occupied by a code point, in the
+ * manner of wcwidth(3): 0 for control characters and combining marks, 2 for
+ * East Asian wide and fullwidth characters and most emoji, and 1 otherwise.
+ * Unlike wcwidth(3), the answer does not depend on the C library's locale
+ * data.
+ */
+unsigned int u8_width(unsigned int codepoint);
+
+/**
+ * Returns the number of terminal columns occupied by the first str_sz bytes of
+ * str, which is assumed to be valid UTF-8.
+ */
+unsigned int u8_strwidth_b(const char * str,
+                           size_t str_sz);
+
 /**
  * Attempts to read a UTF-8 encoded character from fd. The supplied buffer
  * should be at least as large as U8_MAX_BYTES. Returns the number of bytes
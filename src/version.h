@@ -0,0 +1,6 @@
+#ifndef VERSION_H_
+#define VERSION_H_
+
+#define NFSH_VERSION "0.1.0"
+
+#endif
@@ -0,0 +1,104 @@
+/*
+ * Checks that cancelling a filter stops it at once, even while it waits on
+ * an input that nothing ever writes to, here an idle FIFO read as its input
+ * or opened by name, or on an output that nothing reads. Each filter is started, given time to block, and
+ * cancelled; it must then finish within a second.
+ */
+#include <fcntl.h>
+#include <poll.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "filter.h"
+
+/**
+ * How long a filter is given to block, and then to finish once cancelled.
+ */
+#define FILTER_TEST_SETTLE_US 50000
+#define FILTER_TEST_TIMEOUT_MS 1000
+
+/**
+ * Runs the filter argv on input, writing to a pipe that nothing reads,
+ * cancels it, and exits unless it finishes in good time.
+ */
+static void filter_test_cancel(char * const argv[],
+                               int input,
+                               const char * what)
+{
+    int output[2];
+    int notify[2];
+    if (0 != pipe2(output, O_CLOEXEC) || 0 != pipe2(notify, O_CLOEXEC)) {
+        perror("pipe2");
+        exit(1);
+    }
+    filter_t * filter = filter_new(argv);
+    if (NULL == filter || !filter_start(filter, input, output[1], notify[1])) {
+        fprintf(stderr, "%s: could not start %s\n", what, argv[0]);
+        exit(1);
+    }
+    usleep(FILTER_TEST_SETTLE_US);
+    filter_cancel(filter);
+    struct pollfd done = { .fd = notify[0], .events = POLLIN };
+    if (poll(&done, 1, FILTER_TEST_TIMEOUT_MS) <= 0) {
+        // The thread cannot be joined, nor the process go on with it stuck.
+        fprintf(stderr, "%s: %s was not stopped by its cancel\n", what, argv[0]);
+        exit(1);
+    }
+    filter_join(filter);
+    close(output[0]);
+    close(notify[0]);
+    close(notify[1]);
+}
+
+int main(void)
+{
+    char dir[] = "/tmp/filter_test.XXXXXX";
+    if (NULL == mkdtemp(dir)) {
+        perror("mkdtemp");
+        return 1;
+    }
+    char fifo[sizeof(dir) + 8];
+    snprintf(fifo, sizeof(fifo), "%s/fifo", dir);
+    if (0 != mkfifo(fifo, 0600)) {
+        perror("mkfifo");
+        return 1;
+    }
+    char * cat[] = { "cat", NULL };
+    char * head[] = { "head", "-n", "5", NULL };
+    char * head_bytes[] = { "head", "-c", "5", NULL };
+    char * tail[] = { "tail", NULL };
+    char * wc[] = { "wc", "-l", NULL };
+    char * tee[] = { "tee", NULL };
+    char ** idle[] = { cat, head, head_bytes, tail, wc, tee };
+    for (size_t i = 0; i < sizeof(idle) / sizeof(idle[0]); ++i) {
+        // Opening the FIFO for writing too keeps it from ever reaching end
+        // of file, with nothing written to it.
+        int input = open(fifo, O_RDWR | O_CLOEXEC);
+        if (input < 0) {
+            perror(fifo);
+            return 1;
+        }
+        filter_test_cancel(idle[i], input, "idle FIFO");
+    }
+    // Named, the FIFO has never had a writer.
+    char * cat_fifo[] = { "cat", fifo, NULL };
+    char * head_fifo[] = { "head", fifo, NULL };
+    filter_test_cancel(cat_fifo, -1, "unopened FIFO");
+    filter_test_cancel(head_fifo, -1, "unopened FIFO");
+    // cat and tee go on writing until the pipe they write to is full.
+    char ** flooding[] = { cat, tee };
+    for (size_t i = 0; i < sizeof(flooding) / sizeof(flooding[0]); ++i) {
+        int input = open("/dev/zero", O_RDONLY | O_CLOEXEC);
+        if (input < 0) {
+            perror("/dev/zero");
+            return 1;
+        }
+        filter_test_cancel(flooding[i], input, "full pipe");
+    }
+    unlink(fifo);
+    rmdir(dir);
+    puts("filter: ok");
+    return 0;
+}
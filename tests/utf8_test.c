@@ -0,0 +1,247 @@
+/*
+ * Checks the word and vector code paths of utf8.c against plain
+ * byte-at-a-time versions, in three passes:
+ *
+ * - every sequence of up to four bytes on its own, for the rules about which
+ *   bytes may follow which; in the fourth byte's pass ASCII is represented
+ *   by 0x00, 'A' and 0x7F, since nothing tells ASCII bytes apart by more
+ *   than their high bit, and every other byte value is tried;
+ * - every sequence of up to four bytes drawn from one byte of each range the
+ *   code tells apart, placed in ASCII so that it ends just before, straddles
+ *   and starts on both a word and a 16-byte block boundary;
+ * - random strings, whose multibyte runs fall anywhere in the blocks.
+ */
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "utf8.h"
+
+/**
+ * The random strings checked, and how long they may be.
+ */
+#define UTF8_TEST_FUZZ_RUNS 200000
+#define UTF8_TEST_FUZZ_MAX 80
+
+/**
+ * The ASCII a sequence is placed in: one 16-byte block and one word.
+ */
+#define UTF8_TEST_PADDED_SZ 24
+
+/**
+ * The bytes each position of a four-byte sequence runs through: the three
+ * ASCII stand-ins followed by every byte with the high bit set.
+ */
+#define UTF8_TEST_ALPHABET_SZ (3 + 128)
+
+/**
+ * One byte of each range the code tells apart, ends included.
+ */
+static const unsigned char utf8_test_classes[] = {
+    'A', 0x80, 0x8F, 0x90, 0x9F, 0xA0, 0xBF, 0xC0, 0xC1, 0xC2, 0xDF,
+    0xE0, 0xE1, 0xED, 0xEF, 0xF0, 0xF1, 0xF4, 0xF5, 0xFF,
+};
+
+static unsigned long utf8_test_failures;
+
+static int utf8_test_is_lead(unsigned char byte)
+{
+    return 0x80 != (byte & 0xC0);
+}
+
+static unsigned int utf8_test_strlen(const unsigned char * str,
+                                     size_t str_sz)
+{
+    unsigned int n = 0;
+    for (size_t i = 0; i < str_sz; ++i) {
+        n += utf8_test_is_lead(str[i]);
+    }
+    return n;
+}
+
+static unsigned int utf8_test_byte_offset(const unsigned char * str,
+                                          size_t str_sz,
+                                          unsigned int n)
+{
+    for (size_t i = 0; i < str_sz; ++i) {
+        if (utf8_test_is_lead(str[i]) && 0 == n--) {
+            return i;
+        }
+    }
+    return str_sz;
+}
+
+/**
+ * Validates by decoding each sequence and checking its code point, as RFC
+ * 3629 describes, rather than by the ranges of its bytes.
+ */
+static size_t utf8_test_validate(const unsigned char * str,
+                                 size_t str_sz)
+{
+    size_t i = 0;
+    while (i < str_sz) {
+        unsigned char lead = str[i];
+        size_t sequence_sz;
+        uint32_t codepoint;
+        if (lead < 0x80) {
+            i++;
+            continue;
+        } else if (0xC0 == (lead & 0xE0)) {
+            sequence_sz = 2;
+            codepoint = lead & 0x1F;
+        } else if (0xE0 == (lead & 0xF0)) {
+            sequence_sz = 3;
+            codepoint = lead & 0x0F;
+        } else if (0xF0 == (lead & 0xF8)) {
+            sequence_sz = 4;
+            codepoint = lead & 0x07;
+        } else {
+            return i;
+        }
+        if (i + sequence_sz > str_sz) {
+            return i;
+        }
+        for (size_t j = 1; j < sequence_sz; ++j) {
+            if (0x80 != (str[i + j] & 0xC0)) {
+                return i;
+            }
+            codepoint = (codepoint << 6) | (str[i + j] & 0x3F);
+        }
+        static const uint32_t minimum[] = { 0, 0, 0x80, 0x800, 0x10000 };
+        if (codepoint < minimum[sequence_sz] || codepoint > 0x10FFFF ||
+                (codepoint >= 0xD800 && codepoint <= 0xDFFF)) {
+            return i;
+        }
+        i += sequence_sz;
+    }
+    return str_sz;
+}
+
+/**
+ * Compares the fast and plain versions on str, looking up the offsets of the
+ * from-th to the to-th code point; past the last one, the end is expected.
+ */
+static void utf8_test_check(const unsigned char * str,
+                            size_t str_sz,
+                            unsigned int from,
+                            unsigned int to)
+{
+    const char * s = (const char *) str;
+    unsigned int n = utf8_test_strlen(str, str_sz);
+    int failed = u8_strlen_b(s, str_sz) != n ||
+                 u8_validate(s, str_sz) != utf8_test_validate(str, str_sz);
+    if (to > n + 1) {
+        to = n + 1;
+    }
+    for (unsigned int k = from; k <= to && !failed; ++k) {
+        failed = u8_byte_offset_b(s, str_sz, k) != utf8_test_byte_offset(str, str_sz, k);
+    }
+    if (failed && utf8_test_failures++ < 10) {
+        fputs("mismatch on", stderr);
+        for (size_t i = 0; i < str_sz; ++i) {
+            fprintf(stderr, " %02x", str[i]);
+        }
+        fputc('\n', stderr);
+    }
+}
+
+/**
+ * Checks sequence at each place around the boundaries in padded, looking up
+ * only the offsets of the code points around it; the others are not for it
+ * to throw off.
+ */
+static void utf8_test_place(unsigned char * padded,
+                            const unsigned char * sequence,
+                            size_t sequence_sz)
+{
+    static const size_t boundaries[] = { 8, 16 };
+    for (size_t b = 0; b < 2; ++b) {
+        for (size_t at = boundaries[b] - sequence_sz; at <= boundaries[b]; ++at) {
+            memcpy(padded + at, sequence, sequence_sz);
+            utf8_test_check(padded, UTF8_TEST_PADDED_SZ, at - 1, at + sequence_sz);
+            memset(padded + at, 'a', sequence_sz);
+        }
+    }
+}
+
+int main(void)
+{
+    // Every sequence of up to three bytes on its own.
+    for (uint32_t value = 0; value < (1u << 24); ++value) {
+        unsigned char sequence[3] = { value >> 16, value >> 8, value };
+        for (size_t sz = 1; sz <= 3; ++sz) {
+            if (sz == 3 || 0 == value >> (8 * sz)) {
+                utf8_test_check(sequence + 3 - sz, sz, 0, UINT32_MAX);
+            }
+        }
+    }
+    // Every sequence of four bytes on its own, over the alphabet.
+    unsigned char alphabet[UTF8_TEST_ALPHABET_SZ] = { 0x00, 'A', 0x7F };
+    for (int i = 0; i < 128; ++i) {
+        alphabet[3 + i] = 0x80 + i;
+    }
+    unsigned char sequence[4];
+    for (int b0 = 0; b0 < UTF8_TEST_ALPHABET_SZ; ++b0) {
+        sequence[0] = alphabet[b0];
+        for (int b1 = 0; b1 < UTF8_TEST_ALPHABET_SZ; ++b1) {
+            sequence[1] = alphabet[b1];
+            for (int b2 = 0; b2 < UTF8_TEST_ALPHABET_SZ; ++b2) {
+                sequence[2] = alphabet[b2];
+                for (int b3 = 0; b3 < UTF8_TEST_ALPHABET_SZ; ++b3) {
+                    sequence[3] = alphabet[b3];
+                    utf8_test_check(sequence, 4, 0, UINT32_MAX);
+                }
+            }
+        }
+    }
+    // Every sequence of up to four bytes over the classes, around the
+    // boundaries.
+    unsigned char padded[UTF8_TEST_PADDED_SZ];
+    memset(padded, 'a', sizeof(padded));
+    const size_t classes_sz = sizeof(utf8_test_classes);
+    for (size_t sz = 1; sz <= 4; ++sz) {
+        size_t count = 1;
+        for (size_t i = 0; i < sz; ++i) {
+            count *= classes_sz;
+        }
+        for (size_t value = 0; value < count; ++value) {
+            size_t rest = value;
+            for (size_t i = 0; i < sz; ++i) {
+                sequence[i] = utf8_test_classes[rest % classes_sz];
+                rest /= classes_sz;
+            }
+            utf8_test_place(padded, sequence, sz);
+        }
+    }
+    // Random strings, mostly ASCII with runs of multibyte sequences so that
+    // the word and vector paths are taken, and some bytes anything at all.
+    srand(1);
+    unsigned char fuzz[UTF8_TEST_FUZZ_MAX];
+    for (long run = 0; run < UTF8_TEST_FUZZ_RUNS; ++run) {
+        size_t fuzz_sz = rand() % (UTF8_TEST_FUZZ_MAX + 1);
+        for (size_t i = 0; i < fuzz_sz; ++i) {
+            switch (rand() % 8) {
+                case 0:
+                    fuzz[i] = rand() % 256;
+                    break;
+                case 1:
+                case 2:
+                    fuzz[i] = 0x80 + rand() % 64;
+                    break;
+                case 3:
+                    fuzz[i] = 0xC2 + rand() % 51;
+                    break;
+                default:
+                    fuzz[i] = 'a' + rand() % 26;
+                    break;
+            }
+        }
+        utf8_test_check(fuzz, fuzz_sz, 0, UINT32_MAX);
+    }
+    if (0 != utf8_test_failures) {
+        fprintf(stderr, "utf8: %lu mismatches\n", utf8_test_failures);
+        return 1;
+    }
+    puts("utf8: ok");
+    return 0;
+}